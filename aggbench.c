@@ -0,0 +1,500 @@
+#include "include/bench.h"
+#include "include/hash_func.h"
+#include "include/pld_hash_map.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define u64cmp(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+
+/* counts are bumped in place, so key and count share a line */
+PLD_HASH_MAP_DEFINE_FLAGS(uint64_t, uint64_t, aggmap, hash_mix, u64cmp,
+                          PLD_HASH_MAP_AOS)
+
+/* aggregation settings */
+enum {
+        AGGBENCH_BLOCK     = 1024,    /* keys decoded and hashed at once */
+        AGGBENCH_MAX_PARTS = 256,     /* most partition maps */
+        AGGBENCH_TOP       = 10,      /* default top keys printed */
+        AGGBENCH_MAX_TOP   = 1 << 20, /* most top keys printed */
+        AGGBENCH_DISTINCT  = 1 << 20, /* default distinct keys generated */
+};
+
+/* keys of one partition waiting to be counted */
+struct aggbench_part {
+        struct aggmap  *a_map;                  /* counts */
+        size_t          a_len;                  /* keys waiting */
+        uint64_t        a_key[AGGBENCH_BLOCK];  /* keys */
+        hash_map_size_t a_hash[AGGBENCH_BLOCK]; /* hashes of keys */
+};
+
+/* key and its count */
+struct aggbench_top {
+        uint64_t t_key;   /* key */
+        uint64_t t_count; /* times seen */
+};
+
+/* keys counted most often so far, a min-heap on t_count */
+struct aggbench_heap {
+        struct aggbench_top *h_top; /* heap */
+        size_t               h_len; /* entries in heap */
+        size_t               h_cap; /* most entries kept */
+};
+
+/**
+ * Count a run of hashed keys into an aggmap{}:
+ *
+ * Arguments:
+ *  @ppp:  pointer to pointer to aggmap{}
+ *  @keys: keys
+ *  @hash: hash of each key
+ *  @n:    number of keys
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set, keys before the failing one counted
+ *
+ * Notes:
+ *  each key's home slot is prefetched PLD_HASH_MAP_BATCH keys before
+ *  it is upserted, as _set_batch() does, so cache misses overlap
+ */
+static int
+count_keys(struct aggmap **ppp, const uint64_t *keys,
+           const hash_map_size_t *hash, size_t n)
+{
+        uint64_t *vp = NULL;
+        bool inserted = false;
+        size_t i = 0;
+
+        for (i = 0; i < n && i < PLD_HASH_MAP_BATCH; i++)
+                aggmap_prefetch(*ppp, hash[i], true);
+
+        for (i = 0; i < n; i++) {
+                if (i + PLD_HASH_MAP_BATCH < n)
+                        aggmap_prefetch(*ppp, hash[i + PLD_HASH_MAP_BATCH],
+                                        true);
+
+                vp = aggmap_insert_hash(ppp, hash[i], keys[i], 0,
+                                        &inserted);
+                if (vp == NULL)
+                        return -1;
+                (*vp)++;
+        }
+
+        return 0;
+}
+
+/**
+ * Count keys of a mapped file into partition maps:
+ *
+ * Arguments:
+ *  @parts:  partitions, a_map set and a_len 0
+ *  @nparts: number of partitions, a power of 2
+ *  @data:   file contents
+ *  @n:      number of keys in data
+ *  @width:  bytes per key, 4 or 8
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set
+ *
+ * Notes:
+ *  keys are decoded and hashed a block at a time; with more than one
+ *  partition they are then scattered by the top bits of their hash,
+ *  and a partition is counted once a block of its keys is waiting, so
+ *  each run of upserts stays in one smaller table
+ */
+static int
+count_file(struct aggbench_part *parts, size_t nparts,
+           const uint8_t *data, size_t n, size_t width)
+{
+        uint64_t keys[AGGBENCH_BLOCK];
+        hash_map_size_t hash[AGGBENCH_BLOCK];
+        struct aggbench_part *ap = NULL;
+        int bits = __builtin_ctzll(nparts);
+        size_t len = 0;
+        size_t off = 0;
+        size_t i = 0;
+
+        for (off = 0; off < n; off += len) {
+                len = n - off;
+                if (len > AGGBENCH_BLOCK)
+                        len = AGGBENCH_BLOCK;
+
+                for (i = 0; i < len; i++) {
+                        if (width == 8)
+                                keys[i] = hash_read64(data +
+                                                      (off + i) * 8);
+                        else
+                                keys[i] = hash_read32(data +
+                                                      (off + i) * 4);
+                }
+                for (i = 0; i < len; i++)
+                        hash[i] = hash_mix(keys[i]);
+
+                if (nparts == 1) {
+                        if (count_keys(&parts->a_map, keys, hash,
+                                       len) < 0)
+                                return -1;
+                        continue;
+                }
+
+                for (i = 0; i < len; i++) {
+                        ap = &parts[hash[i] >> (64 - bits)];
+                        ap->a_key[ap->a_len] = keys[i];
+                        ap->a_hash[ap->a_len] = hash[i];
+                        if (++ap->a_len < AGGBENCH_BLOCK)
+                                continue;
+
+                        if (count_keys(&ap->a_map, ap->a_key, ap->a_hash,
+                                       ap->a_len) < 0)
+                                return -1;
+                        ap->a_len = 0;
+                }
+        }
+
+        for (i = 0; i < nparts; i++) {
+                ap = &parts[i];
+                if (count_keys(&ap->a_map, ap->a_key, ap->a_hash,
+                               ap->a_len) < 0)
+                        return -1;
+                ap->a_len = 0;
+        }
+
+        return 0;
+}
+
+/**
+ * Move a heap entry down to its place:
+ *
+ * Arguments:
+ *  @hp: pointer to aggbench_heap{}
+ *  @i:  index of entry
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+heap_down(struct aggbench_heap *hp, size_t i)
+{
+        struct aggbench_top *top = hp->h_top;
+        struct aggbench_top t;
+        size_t c = 0;
+
+        for (;;) {
+                c = 2 * i + 1;
+                if (c >= hp->h_len)
+                        break;
+                if (c + 1 < hp->h_len &&
+                    top[c + 1].t_count < top[c].t_count)
+                        c++;
+                if (top[i].t_count <= top[c].t_count)
+                        break;
+
+                t = top[i];
+                top[i] = top[c];
+                top[c] = t;
+                i = c;
+        }
+}
+
+/**
+ * Offer a key and its count to the heap of top keys:
+ *
+ * Arguments:
+ *  @k:   key
+ *  @vp:  pointer to count
+ *  @ctx: pointer to aggbench_heap{}
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+heap_offer(uint64_t k, uint64_t *vp, void *ctx)
+{
+        struct aggbench_heap *hp = ctx;
+        struct aggbench_top t = { k, *vp };
+        size_t i = 0;
+
+        if (hp->h_len < hp->h_cap) {
+                /* move up from the end */
+                i = hp->h_len++;
+                while (i > 0 && hp->h_top[(i - 1) / 2].t_count >
+                                t.t_count) {
+                        hp->h_top[i] = hp->h_top[(i - 1) / 2];
+                        i = (i - 1) / 2;
+                }
+                hp->h_top[i] = t;
+                return;
+        }
+
+        if (hp->h_len == 0 || t.t_count <= hp->h_top[0].t_count)
+                return;
+
+        hp->h_top[0] = t;
+        heap_down(hp, 0);
+}
+
+/**
+ * Compare two top keys, most counted first:
+ *
+ * Arguments:
+ *  @a: pointer to aggbench_top{}
+ *  @b: pointer to aggbench_top{}
+ *
+ * Returns:
+ *  @success: <0, 0 or >0 as for qsort()
+ *  @failure: does not
+ */
+static int
+top_cmp(const void *a, const void *b)
+{
+        const struct aggbench_top *ta = a;
+        const struct aggbench_top *tb = b;
+
+        if (ta->t_count != tb->t_count)
+                return ta->t_count < tb->t_count ? 1 : -1;
+
+        return u64cmp(ta->t_key, tb->t_key);
+}
+
+/**
+ * Write a file of keys, skewed towards a few heavy ones:
+ *
+ * Arguments:
+ *  @path:     file to write
+ *  @n:        number of keys
+ *  @distinct: most distinct keys
+ *  @width:    bytes per key, 4 or 8
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set
+ *
+ * Notes:
+ *  key r2 % (1 + r1 % distinct) for random r1 and r2 turns up about
+ *  ln(distinct / key) / distinct of the time; keys are then scrambled
+ *  so heavy ones are not also the smallest
+ */
+static int
+generate(const char *path, size_t n, size_t distinct, size_t width)
+{
+        FILE *fp = fopen(path, "wb");
+        uint64_t x = HASH_FIB;
+        uint64_t y = 0;
+        uint64_t k = 0;
+        uint32_t k32 = 0;
+        size_t i = 0;
+        int ret = -1;
+
+        if (fp == NULL)
+                return -1;
+
+        for (i = 0; i < n; i++) {
+                x = hash_mix(x + HASH_FIB);
+                y = hash_mix(x);
+                k = y % (1 + x % distinct);
+                k = hash_mix(k + 1);
+                k32 = (uint32_t)k;
+                if (fwrite(width == 8 ? (void *)&k : (void *)&k32, width,
+                           1, fp) != 1)
+                        goto close;
+        }
+        ret = 0;
+
+close:
+        if (fclose(fp) != 0)
+                ret = -1;
+        return ret;
+}
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        fprintf(stderr, "usage: %s [-w width] [-p parts] [-k top] "
+                "[-o file] input\n"
+                "       %s -g keys [-d distinct] [-w width] output\n"
+                "  counts the width byte keys (4 or 8, default 8) of "
+                "input into parts\n"
+                "  hash-partitioned maps (default 1) and prints the top "
+                "keys (default %d)\n"
+                "  as key,count; -g writes keys skewed over distinct "
+                "values (default %d)\n",
+                prog, prog, AGGBENCH_TOP, AGGBENCH_DISTINCT);
+}
+
+int
+main(int argc, char **argv)
+{
+        struct aggbench_heap heap = { NULL, 0, 0 };
+        struct aggbench_part *parts = NULL;
+        struct timespec start;
+        struct stat st;
+        FILE *out = NULL;
+        const char *path = NULL;
+        const uint8_t *data = NULL;
+        size_t width = 8;
+        size_t nparts = 1;
+        size_t top = AGGBENCH_TOP;
+        size_t gen = 0;
+        size_t distinct = AGGBENCH_DISTINCT;
+        size_t size = 0;
+        size_t n = 0;
+        size_t total = 0;
+        size_t i = 0;
+        uint64_t ns = 0;
+        int ret = 1;
+        int opt = 0;
+        int fd = -1;
+
+        while ((opt = getopt(argc, argv, "w:p:k:g:d:o:h")) != -1) {
+                switch (opt) {
+                case 'w':
+                        width = strtoul(optarg, NULL, 0);
+                        break;
+                case 'p':
+                        nparts = strtoul(optarg, NULL, 0);
+                        break;
+                case 'k':
+                        top = strtoul(optarg, NULL, 0);
+                        break;
+                case 'g':
+                        gen = strtoul(optarg, NULL, 0);
+                        break;
+                case 'd':
+                        distinct = strtoul(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind + 1 != argc || (width != 4 && width != 8) ||
+            nparts == 0 || nparts > AGGBENCH_MAX_PARTS ||
+            (nparts & (nparts - 1)) != 0 || top > AGGBENCH_MAX_TOP ||
+            distinct == 0)
+                goto usage;
+
+        /* opened once the arguments are known good, so usage leaks none */
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        if (gen > 0) {
+                if (generate(argv[optind], gen, distinct, width) < 0) {
+                        perror(argv[optind]);
+                        goto close;
+                }
+                ret = 0;
+                goto close;
+        }
+
+        fd = open(argv[optind], O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+                perror(argv[optind]);
+                goto close_fd;
+        }
+
+        size = (size_t)st.st_size;
+        n = size / width;
+        if (size % width != 0)
+                fprintf(stderr, "%s: ignoring %zu trailing bytes\n",
+                        argv[optind], size % width);
+
+        if (size > 0) {
+                data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                        data = NULL;
+                        perror("mmap");
+                        goto close_fd;
+                }
+                (void)madvise((void *)data, size, MADV_SEQUENTIAL);
+        }
+
+        parts = calloc(nparts, sizeof(*parts));
+        heap.h_top = malloc(sizeof(*heap.h_top) * (top > 0 ? top : 1));
+        if (parts == NULL || heap.h_top == NULL) {
+                perror("malloc");
+                goto free;
+        }
+        heap.h_cap = top;
+
+        for (i = 0; i < nparts; i++) {
+                parts[i].a_map = aggmap_new(0);
+                if (parts[i].a_map == NULL) {
+                        perror("aggmap_new");
+                        goto free;
+                }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (count_file(parts, nparts, data, n, width) < 0) {
+                perror("aggmap_insert_hash");
+                goto free;
+        }
+        ns = since(&start);
+
+        for (i = 0; i < nparts; i++) {
+                total += aggmap_len(parts[i].a_map);
+                aggmap_foreach(parts[i].a_map, heap_offer, &heap);
+        }
+
+        qsort(heap.h_top, heap.h_len, sizeof(*heap.h_top), top_cmp);
+        fprintf(out, "key,count\n");
+        for (i = 0; i < heap.h_len; i++)
+                fprintf(out, "%llu,%llu\n",
+                        (unsigned long long)heap.h_top[i].t_key,
+                        (unsigned long long)heap.h_top[i].t_count);
+
+        fprintf(stderr, "%s: %zu keys, %zu distinct, %zu parts, "
+                "%.3f s, %.3f GB/s, %.1f Mkeys/s\n", argv[optind], n,
+                total, nparts, (double)ns / 1e9,
+                ns > 0 ? (double)(n * width) / (double)ns : 0.0,
+                ns > 0 ? (double)n * 1000 / (double)ns : 0.0);
+        ret = 0;
+
+free:
+        for (i = 0; parts != NULL && i < nparts; i++) {
+                if (parts[i].a_map != NULL)
+                        aggmap_free(&parts[i].a_map);
+        }
+        free(parts);
+        parts = NULL;
+        free(heap.h_top);
+        heap.h_top = NULL;
+
+        if (data != NULL)
+                munmap((void *)data, size);
+
+close_fd:
+        if (fd >= 0)
+                close(fd);
+
+close:
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
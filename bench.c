@@ -0,0 +1,690 @@
+#include "include/bench.h"
+#include "include/chain_hash_map.h"
+#include "include/cuckoo_hash_map.h"
+#include "include/pld_hash_map.h"
+#include "include/swiss_hash_map.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+PLD_HASH_MAP_DEFINE(int, int, int2intmap, inthash, intcmp)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_bs, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_simd, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_SIMD)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_aos, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_AOS)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_nohash, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOHASH)
+CHAIN_HASH_MAP_DEFINE(int, int, int2intmap_chain, inthash, intcmp)
+CUCKOO_HASH_MAP_DEFINE(int, int, int2intmap_cuckoo, inthash, intcmp)
+SWISS_HASH_MAP_DEFINE(int, int, int2intmap_swiss, inthash, intcmp)
+
+/* benchmark sizes */
+enum {
+        BENCH_MIN_LEN   = 1 << 10, /* smallest table swept, about L1 */
+        BENCH_MAX_LEN   = 1 << 22, /* largest table swept, far past LLC */
+        BENCH_LIMIT_LEN = 1 << 26, /* largest table keys can be made for */
+        BENCH_CLUST_LEN = 1 << 24, /* same, for clustered keys */
+        BENCH_MIN_OPS   = 1 << 20, /* ops timed per phase at least */
+        BENCH_CLUSTER   = 0x7,     /* clustered keys have these hash bits 0 */
+        BENCH_CALIBRATE = 1 << 16, /* timer calls to measure overhead */
+};
+
+/* benchmark phases */
+enum bench_phase {
+        BENCH_INSERT, /* _set of absent keys into a growing table */
+        BENCH_HIT,    /* _get of present keys */
+        BENCH_MISS,   /* _get of absent keys */
+        BENCH_ERASE,  /* _unset of every key */
+        BENCH_CHURN,  /* _get, and _unset + _set keeping len constant */
+        BENCH_NPHASE,
+};
+
+/* key distributions */
+enum bench_dist {
+        BENCH_SEQ,       /* keys 0..n-1, queried in order */
+        BENCH_UNIFORM,   /* scrambled keys, queried uniformly */
+        BENCH_ZIPF,      /* scrambled keys, queried with zipf(0.99) */
+        BENCH_CLUSTERED, /* keys whose hashes share low bits */
+        BENCH_NDIST,
+};
+
+/* output formats */
+enum bench_fmt {
+        BENCH_CSV,
+        BENCH_JSON,
+};
+
+static const char *const bench_phase_name[BENCH_NPHASE] = {
+        "insert", "hit", "miss", "erase", "churn",
+};
+
+static const char *const bench_dist_name[BENCH_NDIST] = {
+        "seq", "uniform", "zipf", "clustered",
+};
+
+/* result of one phase */
+struct bench_res {
+        const char *r_map;   /* map name */
+        const char *r_dist;  /* key distribution */
+        const char *r_phase; /* phase */
+        size_t      r_len;   /* entries in table */
+        size_t      r_ops;   /* operations timed */
+        double      r_ns;    /* mean ns per op */
+        uint32_t    r_p50;   /* latency percentiles, ns */
+        uint32_t    r_p90;
+        uint32_t    r_p99;
+        uint32_t    r_p999;
+        uint32_t    r_max;
+};
+
+/* benchmark state shared by all maps */
+static int *keys = NULL;       /* 2n distinct keys, n present n absent */
+static int *vals = NULL;       /* values of keys */
+static uint32_t *qidx = NULL;  /* query ranks in [0, n) */
+static uint32_t *lat = NULL;   /* per-op latencies */
+static uint32_t overhead = 0;  /* ns a timer read pair costs */
+static enum bench_fmt fmt = BENCH_CSV;
+static FILE *out = NULL;
+static size_t nres = 0;
+static volatile size_t sink = 0;
+
+/**
+ * Compare two latencies for qsort():
+ *
+ * Arguments:
+ *  @a: pointer to first latency
+ *  @b: pointer to second latency
+ *
+ * Returns:
+ *  @success: <0, 0 or >0 like strcmp()
+ *  @failure: does not
+ */
+static int
+latcmp(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+/**
+ * Record latency of one op started at a clock reading:
+ *
+ * Arguments:
+ *  @start: clock reading
+ *  @lp:    where to save latency
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+record(const struct timespec *start, uint32_t *lp)
+{
+        uint64_t ns = since(start);
+
+        ns = ns > overhead ? ns - overhead : 0;
+        *lp = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+/**
+ * Measure cost of an empty timed op:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: median ns between two back to back clock reads
+ *  @failure: does not
+ */
+static uint32_t
+calibrate(void)
+{
+        struct timespec start;
+        size_t i = 0;
+
+        overhead = 0;
+        for (i = 0; i < BENCH_CALIBRATE; i++) {
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                record(&start, &lat[i]);
+        }
+
+        qsort(lat, BENCH_CALIBRATE, sizeof(*lat), latcmp);
+        return lat[BENCH_CALIBRATE / 2];
+}
+
+/* zipf rank generator (Gray et al., "Quickly generating billion-record
+ * synthetic databases") */
+struct zipf {
+        size_t z_n;     /* number of ranks */
+        double z_theta; /* skew */
+        double z_zetan; /* sum of 1 / i^theta for i in 1..n */
+        double z_zeta2; /* 1 + 0.5^theta */
+        double z_alpha; /* 1 / (1 - theta) */
+        double z_eta;   /* scale of the tail */
+};
+
+/**
+ * Set up a zipf{} over n ranks:
+ *
+ * Arguments:
+ *  @z:     pointer to zipf{}
+ *  @n:     number of ranks
+ *  @theta: skew, below 1
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+zipf_init(struct zipf *z, size_t n, double theta)
+{
+        size_t i = 0;
+
+        z->z_n = n;
+        z->z_theta = theta;
+        z->z_zetan = 0;
+        for (i = 1; i <= n; i++)
+                z->z_zetan += 1 / pow((double)i, theta);
+        z->z_zeta2 = 1 + pow(0.5, theta);
+        z->z_alpha = 1 / (1 - theta);
+        z->z_eta = (1 - pow(2 / (double)n, 1 - theta)) /
+                   (1 - z->z_zeta2 / z->z_zetan);
+}
+
+/**
+ * Get next zipf distributed rank:
+ *
+ * Arguments:
+ *  @z:     pointer to zipf{}
+ *  @state: xorshift state
+ *
+ * Returns:
+ *  @success: rank in [0, n), 0 most frequent
+ *  @failure: does not
+ */
+static size_t
+zipf_next(const struct zipf *z, uint64_t *state)
+{
+        double u = (double)(xorshift64(state) >> 11) / 9007199254740992.0;
+        double uz = u * z->z_zetan;
+        size_t rank = 0;
+
+        if (uz < 1)
+                return 0;
+        if (uz < z->z_zeta2)
+                return 1;
+
+        rank = (size_t)((double)z->z_n *
+                        pow(z->z_eta * u - z->z_eta + 1, z->z_alpha));
+        return rank < z->z_n ? rank : z->z_n - 1;
+}
+
+/**
+ * Fill keys and vals for a distribution:
+ *
+ * Arguments:
+ *  @dist: key distribution
+ *  @n:    number of present keys, as many absent ones follow
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ *
+ * Notes:
+ *  clustered keys take about BENCH_CLUSTER + 1 scrambled indices each,
+ *  which stay below 1 << 30, where scramble() stops being a bijection,
+ *  only for n up to BENCH_CLUST_LEN
+ */
+static void
+gen_keys(enum bench_dist dist, size_t n)
+{
+        uint32_t j = 0;
+        size_t i = 0;
+
+        for (i = 0; i < 2 * n; i++) {
+                switch (dist) {
+                case BENCH_SEQ:
+                        keys[i] = (int)i;
+                        break;
+                case BENCH_UNIFORM:
+                case BENCH_ZIPF:
+                        keys[i] = scramble((uint32_t)i);
+                        break;
+                case BENCH_CLUSTERED:
+                        /* only 1 in BENCH_CLUSTER + 1 home slots is used */
+                        do {
+                                keys[i] = scramble(j++);
+                        } while (inthash(keys[i]) & BENCH_CLUSTER);
+                        break;
+                case BENCH_NDIST:
+                        break;
+                }
+                vals[i] = (int)i;
+        }
+}
+
+/**
+ * Fill qidx for a distribution:
+ *
+ * Arguments:
+ *  @dist: key distribution
+ *  @n:    number of present keys
+ *  @ops:  number of queries
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+gen_queries(enum bench_dist dist, size_t n, size_t ops)
+{
+        struct zipf z = {0};
+        uint64_t state = 0x2545f4914f6cdd1dULL;
+        size_t i = 0;
+
+        if (dist == BENCH_ZIPF)
+                zipf_init(&z, n, 0.99);
+
+        for (i = 0; i < ops; i++) {
+                switch (dist) {
+                case BENCH_SEQ:
+                        qidx[i] = (uint32_t)(i % n);
+                        break;
+                case BENCH_UNIFORM:
+                case BENCH_CLUSTERED:
+                        qidx[i] = (uint32_t)(xorshift64(&state) % n);
+                        break;
+                case BENCH_ZIPF:
+                        /* spread hot ranks over the table */
+                        qidx[i] = (uint32_t)(zipf_next(&z, &state) *
+                                             0x9e3779b1u % n);
+                        break;
+                case BENCH_NDIST:
+                        break;
+                }
+        }
+}
+
+/**
+ * Print one result:
+ *
+ * Arguments:
+ *  @r: pointer to bench_res{}
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+emit(const struct bench_res *r)
+{
+        if (fmt == BENCH_CSV) {
+                if (nres == 0)
+                        fprintf(out, "map,dist,phase,len,ops,ns_per_op,"
+                                "p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+                fprintf(out, "%s,%s,%s,%zu,%zu,%.2f,%u,%u,%u,%u,%u\n",
+                        r->r_map, r->r_dist, r->r_phase, r->r_len,
+                        r->r_ops, r->r_ns, r->r_p50, r->r_p90, r->r_p99,
+                        r->r_p999, r->r_max);
+        } else {
+                fprintf(out, "%s  {\"map\": \"%s\", \"dist\": \"%s\", "
+                        "\"phase\": \"%s\", \"len\": %zu, \"ops\": %zu, "
+                        "\"ns_per_op\": %.2f, \"p50_ns\": %u, "
+                        "\"p90_ns\": %u, \"p99_ns\": %u, "
+                        "\"p999_ns\": %u, \"max_ns\": %u}",
+                        nres == 0 ? "[\n" : ",\n", r->r_map, r->r_dist,
+                        r->r_phase, r->r_len, r->r_ops, r->r_ns, r->r_p50,
+                        r->r_p90, r->r_p99, r->r_p999, r->r_max);
+        }
+
+        nres++;
+        fflush(out);
+}
+
+/**
+ * Finish and print one result from its timings:
+ *
+ * Arguments:
+ *  @r:   pointer to bench_res{} with names and len set
+ *  @ops: number of ops timed, latencies in lat
+ *  @ns:  nanoseconds the untimed pass took
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+finish(struct bench_res *r, size_t ops, uint64_t ns)
+{
+        r->r_ops = ops;
+        r->r_ns = (double)ns / (double)ops;
+
+        qsort(lat, ops, sizeof(*lat), latcmp);
+        r->r_p50 = lat[(ops - 1) * 500 / 1000];
+        r->r_p90 = lat[(ops - 1) * 900 / 1000];
+        r->r_p99 = lat[(ops - 1) * 990 / 1000];
+        r->r_p999 = lat[(ops - 1) * 999 / 1000];
+        r->r_max = lat[ops - 1];
+
+        emit(r);
+}
+
+/**
+ * Define benchmark phases for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ *
+ * Defines:
+ *  @_name_setup: replace table with an empty or a full one
+ *  @_name_phase: run ops of one phase, saving latencies if lp is set
+ *  @_name_run:   run and print every phase for one table size
+ *
+ * Notes:
+ *  every phase runs twice, once untimed per op for the mean and once
+ *  with each op timed for percentiles, since reading the clock around
+ *  each op stops independent lookups from overlapping
+ */
+#define BENCH_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _setup(struct _name **ppp, size_t n, bool full)                \
+{                                                                       \
+        size_t i = 0;                                                   \
+                                                                        \
+        if (*ppp != NULL)                                               \
+                _name ## _free(ppp);                                    \
+                                                                        \
+        *ppp = _name ## _new(0);                                        \
+        if (*ppp == NULL)                                               \
+                fail(#_name "_setup");                                  \
+                                                                        \
+        /* only the interface every engine shares */                    \
+        for (i = 0; full && i < n; i++) {                               \
+                if (_name ## _set(ppp, keys[i], vals[i]) < 0)           \
+                        fail(#_name "_setup");                          \
+        }                                                               \
+}                                                                       \
+                                                                        \
+static void                                                             \
+_name ## _phase(struct _name **ppp, enum bench_phase phase, size_t n,   \
+                size_t ops, uint32_t *lp)                               \
+{                                                                       \
+        struct timespec start;                                          \
+        const void *vp = NULL;                                          \
+        size_t found = 0;                                               \
+        size_t lo = 0;                                                  \
+        size_t j = 0;                                                   \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (i = 0; i < ops; i++) {                                     \
+                if (lp != NULL)                                         \
+                        clock_gettime(CLOCK_MONOTONIC, &start);         \
+                                                                        \
+                switch (phase) {                                        \
+                case BENCH_INSERT:                                      \
+                        if (_name ## _set(ppp, keys[i], vals[i]) < 0)   \
+                                fail(#_name "_set");                    \
+                        break;                                          \
+                case BENCH_HIT:                                         \
+                        vp = _name ## _get(*ppp, keys[qidx[i]]);        \
+                        found += vp != NULL;                            \
+                        break;                                          \
+                case BENCH_MISS:                                        \
+                        vp = _name ## _get(*ppp, keys[n + qidx[i]]);    \
+                        found += vp != NULL;                            \
+                        break;                                          \
+                case BENCH_ERASE:                                       \
+                        if (_name ## _unset(ppp, keys[i]) < 0)          \
+                                fail(#_name "_unset");                  \
+                        break;                                          \
+                case BENCH_CHURN:                                       \
+                        /* keys[lo..lo + n) mod 2n are present */       \
+                        j = lo + (i & 1 ? qidx[i] : n);                 \
+                        if (j >= 2 * n)                                 \
+                                j -= 2 * n;                             \
+                        if (i & 1) {                                    \
+                                vp = _name ## _get(*ppp, keys[j]);      \
+                                found += vp != NULL;                    \
+                                break;                                  \
+                        }                                               \
+                        if (_name ## _unset(ppp, keys[lo]) < 0 ||       \
+                            _name ## _set(ppp, keys[j], vals[j]) < 0)   \
+                                fail(#_name "_churn");                  \
+                        if (++lo == 2 * n)                              \
+                                lo = 0;                                 \
+                        break;                                          \
+                case BENCH_NPHASE:                                      \
+                        break;                                          \
+                }                                                       \
+                                                                        \
+                if (lp != NULL)                                         \
+                        record(&start, &lp[i]);                         \
+        }                                                               \
+                                                                        \
+        sink += found;                                                  \
+}                                                                       \
+                                                                        \
+static void                                                             \
+_name ## _run(enum bench_dist dist, size_t n, size_t ops)               \
+{                                                                       \
+        struct _name *pp = NULL;                                        \
+        struct bench_res r;                                             \
+        struct timespec start;                                          \
+        enum bench_phase phase = BENCH_INSERT;                          \
+        uint64_t ns = 0;                                                \
+        size_t reps = ops / n;                                          \
+        size_t k = 0;                                                   \
+        bool full = false;                                              \
+        int p = 0;                                                      \
+                                                                        \
+        memset(&r, 0, sizeof(r));                                       \
+        r.r_map = #_name;                                               \
+        r.r_dist = bench_dist_name[dist];                               \
+        r.r_len = n;                                                    \
+                                                                        \
+        for (p = 0; p < BENCH_NPHASE; p++) {                            \
+                phase = (enum bench_phase)p;                            \
+                r.r_phase = bench_phase_name[p];                        \
+                full = phase == BENCH_ERASE;                            \
+                ns = 0;                                                 \
+                                                                        \
+                /* refill small tables so each rep sees n keys */       \
+                if (phase == BENCH_INSERT || phase == BENCH_ERASE) {    \
+                        for (k = 0; k < reps; k++) {                    \
+                                _name ## _setup(&pp, n, full);          \
+                                clock_gettime(CLOCK_MONOTONIC, &start); \
+                                _name ## _phase(&pp, phase, n, n,       \
+                                                NULL);                  \
+                                ns += since(&start);                    \
+                        }                                               \
+                        for (k = 0; k < reps; k++) {                    \
+                                _name ## _setup(&pp, n, full);          \
+                                _name ## _phase(&pp, phase, n, n,       \
+                                                &lat[k * n]);           \
+                        }                                               \
+                        finish(&r, reps * n, ns);                       \
+                        continue;                                       \
+                }                                                       \
+                                                                        \
+                /* hit and miss share a table, churn changes it */      \
+                if (phase != BENCH_MISS)                                \
+                        _name ## _setup(&pp, n, true);                  \
+                clock_gettime(CLOCK_MONOTONIC, &start);                 \
+                _name ## _phase(&pp, phase, n, ops, NULL);              \
+                ns = since(&start);                                     \
+                                                                        \
+                if (phase == BENCH_CHURN)                               \
+                        _name ## _setup(&pp, n, true);                  \
+                _name ## _phase(&pp, phase, n, ops, lat);               \
+                finish(&r, ops, ns);                                    \
+        }                                                               \
+                                                                        \
+        _name ## _free(&pp);                                            \
+}
+
+BENCH_DEFINE(int2intmap)
+BENCH_DEFINE(int2intmap_bs)
+BENCH_DEFINE(int2intmap_simd)
+BENCH_DEFINE(int2intmap_aos)
+BENCH_DEFINE(int2intmap_nohash)
+BENCH_DEFINE(int2intmap_chain)
+BENCH_DEFINE(int2intmap_cuckoo)
+BENCH_DEFINE(int2intmap_swiss)
+
+/* map under test */
+struct bench_map {
+        const char *m_name;                               /* map name */
+        void (*m_run)(enum bench_dist, size_t, size_t);   /* _run() */
+};
+
+static const struct bench_map maps[] = {
+        { "int2intmap",        int2intmap_run },
+        { "int2intmap_bs",     int2intmap_bs_run },
+        { "int2intmap_simd",   int2intmap_simd_run },
+        { "int2intmap_aos",    int2intmap_aos_run },
+        { "int2intmap_nohash", int2intmap_nohash_run },
+        { "int2intmap_chain",  int2intmap_chain_run },
+        { "int2intmap_cuckoo", int2intmap_cuckoo_run },
+        { "int2intmap_swiss",  int2intmap_swiss_run },
+};
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-m map] [-d dist] [-n min] [-N max] "
+                "[-f csv|json] [-o file]\n"
+                "  sweeps table sizes min, 4 * min, ... up to max "
+                "(default %d to %d)\n  maps:", prog, BENCH_MIN_LEN,
+                BENCH_MAX_LEN);
+        for (i = 0; i < sizeof(maps) / sizeof(*maps); i++)
+                fprintf(stderr, " %s", maps[i].m_name);
+        fprintf(stderr, "\n  dists:");
+        for (i = 0; i < BENCH_NDIST; i++)
+                fprintf(stderr, " %s", bench_dist_name[i]);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *map = NULL;
+        const char *dist = NULL;
+        const char *path = NULL;
+        size_t min = BENCH_MIN_LEN;
+        size_t max = BENCH_MAX_LEN;
+        size_t ops = 0;
+        size_t n = 0;
+        size_t m = 0;
+        size_t d = 0;
+        int ret = 1;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "m:d:n:N:f:o:h")) != -1) {
+                switch (opt) {
+                case 'm':
+                        map = optarg;
+                        break;
+                case 'd':
+                        dist = optarg;
+                        break;
+                case 'n':
+                        min = strtoul(optarg, NULL, 0);
+                        break;
+                case 'N':
+                        max = strtoul(optarg, NULL, 0);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "csv") == 0)
+                                fmt = BENCH_CSV;
+                        else if (strcmp(optarg, "json") == 0)
+                                fmt = BENCH_JSON;
+                        else
+                                goto usage;
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || min == 0 || min > max ||
+            max > BENCH_LIMIT_LEN)
+                goto usage;
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        ops = max > BENCH_MIN_OPS ? max : BENCH_MIN_OPS;
+        keys = malloc(sizeof(*keys) * 2 * max);
+        vals = malloc(sizeof(*vals) * 2 * max);
+        qidx = malloc(sizeof(*qidx) * ops);
+        lat = malloc(sizeof(*lat) * ops);
+        if (keys == NULL || vals == NULL || qidx == NULL || lat == NULL) {
+                perror("malloc");
+                goto free;
+        }
+
+        overhead = calibrate();
+
+        for (d = 0; d < BENCH_NDIST; d++) {
+                if (dist != NULL && strcmp(dist, bench_dist_name[d]) != 0)
+                        continue;
+
+                for (n = min; n <= max; n <<= 2) {
+                        if (d == BENCH_CLUSTERED && n > BENCH_CLUST_LEN) {
+                                fprintf(stderr, "%s: skipping tables past "
+                                        "%d keys\n", bench_dist_name[d],
+                                        BENCH_CLUST_LEN);
+                                break;
+                        }
+                        ops = n > BENCH_MIN_OPS ? n : BENCH_MIN_OPS;
+                        gen_keys((enum bench_dist)d, n);
+                        gen_queries((enum bench_dist)d, n, ops);
+
+                        for (m = 0; m < sizeof(maps) / sizeof(*maps); m++) {
+                                if (map != NULL &&
+                                    strcmp(map, maps[m].m_name) != 0)
+                                        continue;
+                                maps[m].m_run((enum bench_dist)d, n, ops);
+                        }
+                }
+        }
+
+        if (fmt == BENCH_JSON)
+                fprintf(out, nres == 0 ? "[]\n" : "\n]\n");
+        ret = 0;
+
+free:
+        free(lat);
+        free(qidx);
+        free(vals);
+        free(keys);
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
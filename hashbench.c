@@ -0,0 +1,377 @@
+#include "include/bench.h"
+#include "include/hash_func.h"
+#include "include/pld_hash_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+PLD_HASH_MAP_DEFINE(int, int, xorshift_map, inthash, intcmp)
+PLD_HASH_MAP_DEFINE(int, int, fib_map, hash_int_fib, intcmp)
+PLD_HASH_MAP_DEFINE(int, int, mix_map, hash_int_mix, intcmp)
+PLD_HASH_MAP_DEFINE(int, int, crc_map, hash_int_crc, intcmp)
+PLD_HASH_MAP_DEFINE(int, int, bytes_map, hash_int_bytes, intcmp)
+
+/* benchmark settings */
+enum {
+        HASHBENCH_LEN     = 1 << 20, /* default keys */
+        HASHBENCH_MAX_LEN = 1 << 22, /* strided keys stay distinct up to here */
+        HASHBENCH_OPS     = 1 << 24, /* hashes and lookups timed */
+        HASHBENCH_STRIDE  = 10,      /* strided keys are i << this */
+        HASHBENCH_TAIL_KEYS = 1 << 16, /* keys per length in check_tail() */
+};
+
+/* key distributions */
+enum hashbench_dist {
+        HASHBENCH_SEQ,     /* keys 0..n-1 */
+        HASHBENCH_UNIFORM, /* scrambled keys */
+        HASHBENCH_STRIDED, /* keys with low bits 0, like aligned offsets */
+        HASHBENCH_NDIST,
+};
+
+static const char *const hashbench_dist_name[HASHBENCH_NDIST] = {
+        "seq", "uniform", "strided",
+};
+
+/* hash under test */
+struct hashbench_hash {
+        const char *h_name;                          /* hash name */
+        void (*h_run)(FILE *, const char *, size_t); /* run on keys */
+};
+
+/* benchmark state shared by all hashes */
+static int *keys = NULL;
+static volatile uint64_t sink = 0;
+
+/**
+ * Make distinct keys of a distribution:
+ *
+ * Arguments:
+ *  @dist: key distribution
+ *  @n:    number of keys
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+make_keys(enum hashbench_dist dist, size_t n)
+{
+        size_t i = 0;
+
+        for (i = 0; i < n; i++) {
+                switch (dist) {
+                case HASHBENCH_SEQ:
+                        keys[i] = (int)i;
+                        break;
+                case HASHBENCH_UNIFORM:
+                        keys[i] = scramble((uint32_t)i);
+                        break;
+                case HASHBENCH_STRIDED:
+                        keys[i] = (int)((uint32_t)i << HASHBENCH_STRIDE);
+                        break;
+                case HASHBENCH_NDIST:
+                        break;
+                }
+        }
+}
+
+/**
+ * Define hash rate and probe length benchmark for a hash:
+ *
+ * Arguments:
+ *  @_name: name of hash, _name_map is a plain pld_hash_map over it
+ *  @_hash: hash function of int keys
+ *
+ * Notes:
+ *  displacement is read straight off p_meta of the filled map
+ */
+#define HASHBENCH_DEFINE(_name, _hash)                                  \
+static void                                                             \
+_name ## _run(FILE *out, const char *dist, size_t n)                    \
+{                                                                       \
+        struct _name ## _map *pp = NULL;                                \
+        struct timespec start;                                          \
+        size_t reps = HASHBENCH_OPS / n;                                \
+        size_t found = 0;                                               \
+        size_t r = 0;                                                   \
+        size_t i = 0;                                                   \
+        uint64_t hash_ns = 0;                                           \
+        uint64_t hit_ns = 0;                                            \
+        uint64_t total = 0;                                             \
+        uint64_t sum = 0;                                               \
+        uint8_t disp = 0;                                               \
+        uint8_t max = 0;                                                \
+                                                                        \
+        if (reps == 0)                                                  \
+                reps = 1;                                               \
+                                                                        \
+        clock_gettime(CLOCK_MONOTONIC, &start);                         \
+        for (r = 0; r < reps; r++) {                                    \
+                for (i = 0; i < n; i++)                                 \
+                        sum += _hash(keys[i]);                          \
+        }                                                               \
+        hash_ns = since(&start);                                        \
+        sink += sum;                                                    \
+                                                                        \
+        pp = _name ## _map_new(0);                                      \
+        if (pp == NULL)                                                 \
+                fail(#_name "_map_new");                                \
+        for (i = 0; i < n; i++) {                                       \
+                if (_name ## _map_set(&pp, keys[i], (int)i) < 0)        \
+                        fail(#_name "_map_set");                        \
+        }                                                               \
+                                                                        \
+        for (i = 0; i < pp->p_cap; i++) {                               \
+                if (_name ## _map_get_meta(pp, i) >= PLD_HASH_MAP_WAS)  \
+                        continue;                                       \
+                disp = _name ## _map_disp(                              \
+                        _name ## _map_get_meta(pp, i));                 \
+                total += disp;                                          \
+                if (disp > max)                                         \
+                        max = disp;                                     \
+        }                                                               \
+                                                                        \
+        clock_gettime(CLOCK_MONOTONIC, &start);                         \
+        for (r = 0; r < reps; r++) {                                    \
+                for (i = 0; i < n; i++) {                               \
+                        if (_name ## _map_get(pp, keys[i]) != NULL)     \
+                                found++;                                \
+                }                                                       \
+        }                                                               \
+        hit_ns = since(&start);                                         \
+        sink += found;                                                  \
+                                                                        \
+        fprintf(out, "%s,%s,%zu,%.1f,%.3f,%u,%.2f\n", #_name, dist,     \
+                n, (double)(reps * n) * 1000 / (double)hash_ns,         \
+                (double)total / (double)n, max,                         \
+                (double)(reps * n) * 1000 / (double)hit_ns);            \
+        fflush(out);                                                    \
+                                                                        \
+        _name ## _map_free(&pp);                                        \
+}
+
+HASHBENCH_DEFINE(xorshift, inthash)
+HASHBENCH_DEFINE(fib, hash_int_fib)
+HASHBENCH_DEFINE(mix, hash_int_mix)
+HASHBENCH_DEFINE(crc, hash_int_crc)
+HASHBENCH_DEFINE(bytes, hash_int_bytes)
+
+static const struct hashbench_hash hashes[] = {
+        { "xorshift", xorshift_run },
+        { "fib",      fib_run },
+        { "mix",      mix_run },
+        { "crc",      crc_run },
+        { "bytes",    bytes_run },
+};
+
+/**
+ * Compare two hashes for qsort():
+ *
+ * Arguments:
+ *  @a: pointer to hash
+ *  @b: pointer to hash
+ *
+ * Returns:
+ *  @success: <0, 0 or >0
+ *  @failure: does not
+ */
+static int
+hashcmp(const void *a, const void *b)
+{
+        hash_map_size_t x = *(const hash_map_size_t *)a;
+        hash_map_size_t y = *(const hash_map_size_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+/**
+ * Check that hash_bytes() keys sharing their last word get distinct
+ * hashes:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and a message on stderr
+ *
+ * Notes:
+ *  the shared word is seed ^ HASH_P1 for seed 0 once premixed, which
+ *  used to zero the last multiply and send every such key to hash 0;
+ *  keys up to 16 bytes are read as 4 byte lanes, so there it is split
+ *  over bytes 4..7 and 12..15, the lanes that make up that word
+ */
+static int
+check_tail(const char *prog)
+{
+        static const size_t lens[] = { 16, 24, 32, 64 };
+        hash_map_size_t *hv = NULL;
+        uint8_t key[64];
+        uint64_t tail = hash_mum(HASH_P0, HASH_P1) ^ HASH_P1;
+        uint32_t half = 0;
+        uint64_t word = 0;
+        size_t len = 0;
+        size_t l = 0;
+        size_t i = 0;
+        size_t j = 0;
+        int ret = -1;
+
+        hv = malloc(sizeof(*hv) * HASHBENCH_TAIL_KEYS);
+        if (hv == NULL) {
+                perror("malloc");
+                return -1;
+        }
+
+        for (l = 0; l < sizeof(lens) / sizeof(*lens); l++) {
+                len = lens[l];
+                for (i = 0; i < HASHBENCH_TAIL_KEYS; i++) {
+                        for (j = 0; j < len; j += 8) {
+                                word = hash_mix(i * 8 + j / 8 + 1);
+                                if (j + 8 == len && len > 16)
+                                        word = tail;
+                                memcpy(key + j, &word, sizeof(word));
+                        }
+                        if (len == 16) {
+                                half = (uint32_t)tail;
+                                memcpy(key + 4, &half, sizeof(half));
+                                half = (uint32_t)(tail >> 32);
+                                memcpy(key + 12, &half, sizeof(half));
+                        }
+                        hv[i] = hash_bytes(key, len, 0);
+                }
+
+                qsort(hv, HASHBENCH_TAIL_KEYS, sizeof(*hv), hashcmp);
+                for (i = 1; i < HASHBENCH_TAIL_KEYS; i++) {
+                        if (hv[i] == hv[i - 1]) {
+                                fprintf(stderr, "%s: hash_bytes: %zu byte "
+                                        "keys sharing their last word "
+                                        "collide on %#llx\n", prog, len,
+                                        (unsigned long long)hv[i]);
+                                goto out;
+                        }
+                }
+        }
+        ret = 0;
+
+out:
+        free(hv);
+        return ret;
+}
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-f hash] [-d dist] [-n len] [-o file]\n"
+                "  hashes:", prog);
+        for (i = 0; i < sizeof(hashes) / sizeof(*hashes); i++)
+                fprintf(stderr, " %s", hashes[i].h_name);
+        fprintf(stderr, "\n  dists:");
+        for (i = 0; i < HASHBENCH_NDIST; i++)
+                fprintf(stderr, " %s", hashbench_dist_name[i]);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        FILE *out = NULL;
+        const char *path = NULL;
+        const char *hash = NULL;
+        const char *dist = NULL;
+        size_t len = HASHBENCH_LEN;
+        size_t h = 0;
+        int ret = 1;
+        int opt = 0;
+        int d = 0;
+
+        while ((opt = getopt(argc, argv, "f:d:n:o:h")) != -1) {
+                switch (opt) {
+                case 'f':
+                        hash = optarg;
+                        break;
+                case 'd':
+                        dist = optarg;
+                        break;
+                case 'n':
+                        len = strtoul(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || len == 0 || len > HASHBENCH_MAX_LEN)
+                goto usage;
+
+#if HASH_CRC_HW
+        /* make hashbench builds with -msse4.2 for the crc row */
+        if (!__builtin_cpu_supports("sse4.2")) {
+                fprintf(stderr, "%s: built for SSE4.2, cpu lacks it\n",
+                        argv[0]);
+                return 1;
+        }
+#endif /* #if HASH_CRC_HW */
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        keys = malloc(sizeof(*keys) * len);
+        if (keys == NULL) {
+                perror("malloc");
+                goto close;
+        }
+
+        if (check_tail(argv[0]) < 0)
+                goto free;
+
+        if (!HASH_CRC_HW)
+                fprintf(stderr, "%s: no SSE4.2, crc falls back to mix\n",
+                        argv[0]);
+
+        fprintf(out, "hash,dist,len,mhash_per_s,mean_disp,max_disp,"
+                "hit_mops_per_s\n");
+        for (d = 0; d < HASHBENCH_NDIST; d++) {
+                if (dist != NULL &&
+                    strcmp(dist, hashbench_dist_name[d]) != 0)
+                        continue;
+                make_keys((enum hashbench_dist)d, len);
+
+                for (h = 0; h < sizeof(hashes) / sizeof(*hashes); h++) {
+                        if (hash != NULL &&
+                            strcmp(hash, hashes[h].h_name) != 0)
+                                continue;
+                        hashes[h].h_run(out, hashbench_dist_name[d], len);
+                }
+        }
+        ret = 0;
+
+free:
+        free(keys);
+        keys = NULL;
+
+close:
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
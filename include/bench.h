@@ -0,0 +1,162 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "util.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Hash an int key with xorshifts:
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+inthash(int i)
+{
+        hash_map_size_t hash = (hash_map_size_t)i;
+
+        hash ^= hash >> 15;
+        hash ^= hash >> 7;
+        hash ^= hash >> 3;
+        hash ^= hash << 5;
+        hash ^= hash >> 16;
+
+        return hash;
+}
+
+#define intcmp(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+
+/**
+ * Get next pseudo random number:
+ *
+ * Arguments:
+ *  @state: xorshift state
+ *
+ * Returns:
+ *  @success: next number
+ *  @failure: does not
+ */
+static inline uint64_t
+xorshift64(uint64_t *state)
+{
+        uint64_t x = *state;
+
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        *state = x;
+
+        return x;
+}
+
+/**
+ * Scramble an index into a distinct key:
+ *
+ * Arguments:
+ *  @i: index below 1 << 30
+ *
+ * Returns:
+ *  @success: key below 1 << 30, distinct for each i
+ *  @failure: does not
+ */
+static inline int
+scramble(uint32_t i)
+{
+        uint32_t mask = (1u << 30) - 1;
+
+        /* odd multiplies and xorshifts are bijections mod 2^30 */
+        i = (i * 0x9e3779b1u) & mask;
+        i ^= i >> 15;
+        i = (i * 0x85ebca6bu) & mask;
+        i ^= i >> 13;
+
+        return (int)i;
+}
+
+/**
+ * Get nanoseconds since a monotonic clock reading:
+ *
+ * Arguments:
+ *  @start: clock reading
+ *
+ * Returns:
+ *  @success: nanoseconds
+ *  @failure: does not
+ */
+static inline uint64_t
+since(const struct timespec *start)
+{
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        return (uint64_t)((int64_t)(end.tv_sec - start->tv_sec) *
+                          1000000000 + (end.tv_nsec - start->tv_nsec));
+}
+
+/**
+ * Exit on a failed map operation:
+ *
+ * Arguments:
+ *  @what: what failed
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+fail(const char *what)
+{
+        perror(what);
+        exit(1);
+}
+
+/**
+ * Open the output of a benchmark (-o file):
+ *
+ * Arguments:
+ *  @path: file to write, or NULL for stdout
+ *
+ * Returns:
+ *  @success: stream to write results to
+ *  @failure: NULL, with the error printed
+ */
+static inline FILE *
+bench_open(const char *path)
+{
+        FILE *out = NULL;
+
+        if (path == NULL)
+                return stdout;
+
+        out = fopen(path, "w");
+        if (out == NULL)
+                perror(path);
+
+        return out;
+}
+
+/**
+ * Close the output of a benchmark:
+ *
+ * Arguments:
+ *  @out: stream from bench_open()
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+bench_close(FILE *out)
+{
+        if (out != stdout)
+                fclose(out);
+}
+
+#endif /* #ifndef BENCH_H */
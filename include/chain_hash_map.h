@@ -0,0 +1,359 @@
+#ifndef CHAIN_HASH_MAP_H
+#define CHAIN_HASH_MAP_H
+
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* initial bucket count of chain_hash_map */
+#ifndef CHAIN_HASH_MAP_INIT_CAP
+#define CHAIN_HASH_MAP_INIT_CAP 32
+#endif /* #ifndef CHAIN_HASH_MAP_INIT_CAP */
+
+/* misc. constants */
+enum {
+        CHAIN_HASH_MAP_LOAD_FACTOR = 16, /* load factor */
+};
+
+/* end of a chain or of the free list */
+#define CHAIN_HASH_MAP_NIL ((hash_map_size_t)-1)
+
+/**
+ * Define a new hash table with separate chaining:
+ *
+ * Arguments:
+ *  @_k:    key type
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *  @_hash: hash function
+ *  @_cmp:  key comparison function
+ *
+ * Notes:
+ *  nodes live in one pool array and link by index, so growing the pool
+ *  is a single realloc() and unset nodes are reused from a free list;
+ *  the pool never shrinks
+ */
+#define CHAIN_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)               \
+                                                                        \
+/* chain node */                                                        \
+struct _name ## _node {                                                 \
+        hash_map_size_t n_hash; /* saved hash */                        \
+        hash_map_size_t n_next; /* next node in chain or free list */   \
+        _k              n_key;  /* key */                               \
+        _v              n_val;  /* value */                             \
+};                                                                      \
+                                                                        \
+/* hash table with separate chaining */                                 \
+struct _name {                                                          \
+        hash_map_size_t        c_cap;  /* bucket count */               \
+        hash_map_size_t        c_len;  /* entry count */                \
+        hash_map_size_t       *c_head; /* first node of each bucket */  \
+        struct _name ## _node *c_node; /* node pool */                  \
+        hash_map_size_t        c_pool; /* nodes allocated in pool */    \
+        hash_map_size_t        c_used; /* nodes handed out of pool */   \
+        hash_map_size_t        c_free; /* first node of free list */    \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial bucket count (or 0 for default)                       \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = malloc(sizeof(*pp));                         \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        if (cap == 0)                                                   \
+                cap = CHAIN_HASH_MAP_INIT_CAP;                          \
+                                                                        \
+        cap = next_pow2(cap);                                           \
+                                                                        \
+        pp->c_head = malloc(sizeof(*pp->c_head) * cap);                 \
+        if (pp->c_head == NULL)                                         \
+                goto free_pp;                                           \
+        for (i = 0; i < cap; i++)                                       \
+                pp->c_head[i] = CHAIN_HASH_MAP_NIL;                     \
+                                                                        \
+        pp->c_node = malloc(sizeof(*pp->c_node) * cap);                 \
+        if (pp->c_node == NULL)                                         \
+                goto free_head;                                         \
+                                                                        \
+        pp->c_cap = cap;                                                \
+        pp->c_len = 0;                                                  \
+        pp->c_pool = cap;                                               \
+        pp->c_used = 0;                                                 \
+        pp->c_free = CHAIN_HASH_MAP_NIL;                                \
+        goto ret;                                                       \
+                                                                        \
+free_head:                                                              \
+        free(pp->c_head);                                               \
+        pp->c_head = NULL;                                              \
+                                                                        \
+free_pp:                                                                \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        free(pp->c_node);                                               \
+        pp->c_node = NULL;                                              \
+                                                                        \
+        free(pp->c_head);                                               \
+        pp->c_head = NULL;                                              \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        return pp->c_len;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Relink all nodes of _name{} into a new bucket array:                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @cap: new bucket count                                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _resize(struct _name *pp, hash_map_size_t cap)                 \
+{                                                                       \
+        hash_map_size_t *head = malloc(sizeof(*head) * cap);            \
+        hash_map_size_t mask = cap - 1;                                 \
+        hash_map_size_t next = 0;                                       \
+        hash_map_size_t b = 0;                                          \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (head == NULL)                                               \
+                return -1;                                              \
+        for (b = 0; b < cap; b++)                                       \
+                head[b] = CHAIN_HASH_MAP_NIL;                           \
+                                                                        \
+        for (b = 0; b < pp->c_cap; b++) {                               \
+                for (i = pp->c_head[b]; i != CHAIN_HASH_MAP_NIL;        \
+                     i = next) {                                        \
+                        next = pp->c_node[i].n_next;                    \
+                        pp->c_node[i].n_next =                          \
+                                head[pp->c_node[i].n_hash & mask];      \
+                        head[pp->c_node[i].n_hash & mask] = i;          \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        free(pp->c_head);                                               \
+        pp->c_head = head;                                              \
+        pp->c_cap = cap;                                                \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Take a node from the free list or pool of _name{}:                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: index of node                                             \
+ *  @failure: CHAIN_HASH_MAP_NIL and errno set                          \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _alloc(struct _name *pp)                                       \
+{                                                                       \
+        struct _name ## _node *node = NULL;                             \
+        hash_map_size_t i = pp->c_free;                                 \
+                                                                        \
+        if (i != CHAIN_HASH_MAP_NIL) {                                  \
+                pp->c_free = pp->c_node[i].n_next;                      \
+                return i;                                               \
+        }                                                               \
+                                                                        \
+        if (unlikely(pp->c_used == pp->c_pool)) {                       \
+                node = realloc(pp->c_node,                              \
+                               sizeof(*node) * (pp->c_pool << 1));      \
+                if (node == NULL)                                       \
+                        return CHAIN_HASH_MAP_NIL;                      \
+                pp->c_node = node;                                      \
+                pp->c_pool <<= 1;                                       \
+        }                                                               \
+                                                                        \
+        return pp->c_used++;                                            \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{} with precomputed hash:                       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get_hash(const struct _name *pp, hash_map_size_t hash, _k k)  \
+{                                                                       \
+        hash_map_size_t i = pp->c_head[hash & (pp->c_cap - 1)];         \
+                                                                        \
+        for (; i != CHAIN_HASH_MAP_NIL; i = pp->c_node[i].n_next) {     \
+                if (pp->c_node[i].n_hash == hash &&                     \
+                    _cmp(pp->c_node[i].n_key, k) == 0)                  \
+                        return &pp->c_node[i].n_val;                    \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, _k k)                             \
+{                                                                       \
+        return _name ## _get_hash(pp, _hash(k), k);                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] = v in _name{}:                                           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, _k k, _v v)                           \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t hash = _hash(k);                                \
+        hash_map_size_t b = 0;                                          \
+        hash_map_size_t i = 0;                                          \
+        _v *vp = _name ## _get_hash(pp, hash, k);                       \
+                                                                        \
+        if (vp != NULL) {                                               \
+                *vp = v;                                                \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        if (unlikely((pp->c_len << 4) >=                                \
+                     pp->c_cap * CHAIN_HASH_MAP_LOAD_FACTOR) &&         \
+            _name ## _resize(pp, pp->c_cap << 1) < 0)                   \
+                return -1;                                              \
+                                                                        \
+        i = _name ## _alloc(pp);                                        \
+        if (i == CHAIN_HASH_MAP_NIL)                                    \
+                return -1;                                              \
+                                                                        \
+        b = hash & (pp->c_cap - 1);                                     \
+        pp->c_node[i].n_hash = hash;                                    \
+        pp->c_node[i].n_key = k;                                        \
+        pp->c_node[i].n_val = v;                                        \
+        pp->c_node[i].n_next = pp->c_head[b];                           \
+        pp->c_head[b] = i;                                              \
+        pp->c_len++;                                                    \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, _k k)                               \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t hash = _hash(k);                                \
+        hash_map_size_t *link = NULL;                                   \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (unlikely(pp->c_len < (pp->c_cap >> 2)) &&                   \
+            pp->c_cap > CHAIN_HASH_MAP_INIT_CAP &&                      \
+            _name ## _resize(pp, pp->c_cap >> 1) < 0)                   \
+                return -1;                                              \
+                                                                        \
+        link = &pp->c_head[hash & (pp->c_cap - 1)];                     \
+        while (*link != CHAIN_HASH_MAP_NIL) {                           \
+                i = *link;                                              \
+                if (pp->c_node[i].n_hash == hash &&                     \
+                    _cmp(pp->c_node[i].n_key, k) == 0) {                \
+                        *link = pp->c_node[i].n_next;                   \
+                        pp->c_node[i].n_next = pp->c_free;              \
+                        pp->c_free = i;                                 \
+                        pp->c_len--;                                    \
+                        break;                                          \
+                }                                                       \
+                link = &pp->c_node[i].n_next;                           \
+        }                                                               \
+                                                                        \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef CHAIN_HASH_MAP_H */
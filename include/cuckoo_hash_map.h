@@ -0,0 +1,545 @@
+#ifndef CUCKOO_HASH_MAP_H
+#define CUCKOO_HASH_MAP_H
+
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* initial slot count of cuckoo_hash_map */
+#ifndef CUCKOO_HASH_MAP_INIT_CAP
+#define CUCKOO_HASH_MAP_INIT_CAP 32
+#endif /* #ifndef CUCKOO_HASH_MAP_INIT_CAP */
+
+/* number of evictions tried before an insert grows the table */
+#ifndef CUCKOO_HASH_MAP_MAX_KICKS
+#define CUCKOO_HASH_MAP_MAX_KICKS 256
+#endif /* #ifndef CUCKOO_HASH_MAP_MAX_KICKS */
+
+/* misc. constants */
+enum {
+        CUCKOO_HASH_MAP_WAYS        = 4,  /* slots per bucket */
+        CUCKOO_HASH_MAP_LOAD_FACTOR = 15, /* load factor */
+        CUCKOO_HASH_MAP_GROW_TRIES  = 4,  /* doublings tried on overflow */
+};
+
+/* tag of an empty slot */
+enum {
+        CUCKOO_HASH_MAP_EMPTY = 0,
+};
+
+/**
+ * Mix a hash for its tag and second bucket:
+ *
+ * Arguments:
+ *  @hash: hash of key
+ *
+ * Returns:
+ *  @success: mixed hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+cuckoo_hash_map_mix(hash_map_size_t hash)
+{
+        /* fold the high half in so weak hashes still get two buckets */
+        return (hash ^ (hash >> 32)) * 0x9e3779b97f4a7c15ULL;
+}
+
+/**
+ * Get tag of a hash:
+ *
+ * Arguments:
+ *  @hash: hash of key
+ *
+ * Returns:
+ *  @success: 8 bits of the mixed hash, never CUCKOO_HASH_MAP_EMPTY
+ *  @failure: does not
+ */
+static inline uint8_t
+cuckoo_hash_map_tag(hash_map_size_t hash)
+{
+        /* below the bits cuckoo_hash_map_alt() takes the bucket from */
+        uint8_t tag = (uint8_t)(cuckoo_hash_map_mix(hash) >> 24);
+
+        return tag == CUCKOO_HASH_MAP_EMPTY ? 1 : tag;
+}
+
+/**
+ * Get second bucket of a hash:
+ *
+ * Arguments:
+ *  @hash: hash of key
+ *  @mask: bucket count - 1
+ *
+ * Returns:
+ *  @success: bucket, usually not hash & mask
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+cuckoo_hash_map_alt(hash_map_size_t hash, hash_map_size_t mask)
+{
+        return (cuckoo_hash_map_mix(hash) >> 32) & mask;
+}
+
+/**
+ * Define a new bucketized cuckoo hash table:
+ *
+ * Arguments:
+ *  @_k:    key type
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *  @_hash: hash function
+ *  @_cmp:  key comparison function
+ *
+ * Notes:
+ *  every key lives in one of CUCKOO_HASH_MAP_WAYS slots of one of its
+ *  two buckets, so a lookup reads at most two buckets; slots keep an
+ *  8 bit tag instead of the hash, and _hash is called again on keys
+ *  that get evicted to their other bucket
+ */
+#define CUCKOO_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)              \
+                                                                        \
+/* bucket of CUCKOO_HASH_MAP_WAYS slots */                              \
+struct _name ## _bucket {                                               \
+        uint8_t b_tag[CUCKOO_HASH_MAP_WAYS]; /* tags or EMPTY */        \
+        _k      b_key[CUCKOO_HASH_MAP_WAYS]; /* keys */                 \
+        _v      b_val[CUCKOO_HASH_MAP_WAYS]; /* values */               \
+};                                                                      \
+                                                                        \
+/* bucketized cuckoo hash table */                                      \
+struct _name {                                                          \
+        hash_map_size_t          c_cap;    /* bucket count */           \
+        hash_map_size_t          c_len;    /* entry count */            \
+        struct _name ## _bucket *c_bucket; /* buckets */                \
+        uint32_t                 c_kick;   /* rotates victims */        \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial slot count (or 0 for default)                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = malloc(sizeof(*pp));                         \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        if (cap == 0)                                                   \
+                cap = CUCKOO_HASH_MAP_INIT_CAP;                         \
+                                                                        \
+        cap = next_pow2((cap + CUCKOO_HASH_MAP_WAYS - 1) /              \
+                        CUCKOO_HASH_MAP_WAYS);                          \
+        if (cap < 2)                                                    \
+                cap = 2;                                                \
+                                                                        \
+        pp->c_bucket = calloc(cap, sizeof(*pp->c_bucket));              \
+        if (pp->c_bucket == NULL)                                       \
+                goto free_pp;                                           \
+                                                                        \
+        pp->c_cap = cap;                                                \
+        pp->c_len = 0;                                                  \
+        pp->c_kick = 0;                                                 \
+        goto ret;                                                       \
+                                                                        \
+free_pp:                                                                \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        free(pp->c_bucket);                                             \
+        pp->c_bucket = NULL;                                            \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        return pp->c_len;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Put an entry in a free slot of a bucket of _name{}:                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @b:   bucket                                                        \
+ *  @tag: tag of key                                                    \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if bucket had a free slot                                   \
+ *  @false: if not                                                      \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _put(struct _name *pp, hash_map_size_t b, uint8_t tag, _k k,   \
+              _v v)                                                     \
+{                                                                       \
+        struct _name ## _bucket *bp = &pp->c_bucket[b];                 \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < CUCKOO_HASH_MAP_WAYS; i++) {                    \
+                if (bp->b_tag[i] != CUCKOO_HASH_MAP_EMPTY)              \
+                        continue;                                       \
+                bp->b_tag[i] = tag;                                     \
+                bp->b_key[i] = k;                                       \
+                bp->b_val[i] = v;                                       \
+                return true;                                            \
+        }                                                               \
+                                                                        \
+        return false;                                                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Swap an entry with a slot of _name{}:                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @b:   bucket                                                        \
+ *  @i:   slot of bucket                                                \
+ *  @tag: tag, swapped with tag of slot                                 \
+ *  @k:   key, swapped with key of slot                                 \
+ *  @v:   value, swapped with value of slot                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _swap(struct _name *pp, hash_map_size_t b, int i,              \
+               uint8_t *tag, _k *k, _v *v)                              \
+{                                                                       \
+        struct _name ## _bucket *bp = &pp->c_bucket[b];                 \
+        uint8_t tmp_tag = bp->b_tag[i];                                 \
+        _k tmp_k = bp->b_key[i];                                        \
+        _v tmp_v = bp->b_val[i];                                        \
+                                                                        \
+        bp->b_tag[i] = *tag;                                            \
+        bp->b_key[i] = *k;                                              \
+        bp->b_val[i] = *v;                                              \
+        *tag = tmp_tag;                                                 \
+        *k = tmp_k;                                                     \
+        *v = tmp_v;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Place an entry known not to be in _name{}, evicting others:          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *  @v:    value                                                        \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1, _name{} is left as it was                             \
+ */                                                                     \
+static inline int                                                       \
+_name ## _place(struct _name *pp, hash_map_size_t hash, _k k, _v v)     \
+{                                                                       \
+        hash_map_size_t path[CUCKOO_HASH_MAP_MAX_KICKS];                \
+        uint8_t way[CUCKOO_HASH_MAP_MAX_KICKS];                         \
+        hash_map_size_t mask = pp->c_cap - 1;                           \
+        hash_map_size_t b1 = hash & mask;                               \
+        hash_map_size_t b2 = cuckoo_hash_map_alt(hash, mask);           \
+        hash_map_size_t b = b1;                                         \
+        uint8_t tag = cuckoo_hash_map_tag(hash);                        \
+        int kick = 0;                                                   \
+        int i = 0;                                                      \
+                                                                        \
+        if (_name ## _put(pp, b1, tag, k, v) ||                         \
+            _name ## _put(pp, b2, tag, k, v))                           \
+                return 0;                                               \
+                                                                        \
+        /* start in either bucket so evictions do not always chain */   \
+        if (pp->c_kick & 1)                                             \
+                b = b2;                                                 \
+                                                                        \
+        for (kick = 0; kick < CUCKOO_HASH_MAP_MAX_KICKS; kick++) {      \
+                i = (int)(pp->c_kick++ % CUCKOO_HASH_MAP_WAYS);         \
+                path[kick] = b;                                         \
+                way[kick] = (uint8_t)i;                                 \
+                _name ## _swap(pp, b, i, &tag, &k, &v);                 \
+                                                                        \
+                hash = _hash(k);                                        \
+                b1 = hash & mask;                                       \
+                b = b1 == b ? cuckoo_hash_map_alt(hash, mask) : b1;     \
+                if (_name ## _put(pp, b, tag, k, v))                    \
+                        return 0;                                       \
+        }                                                               \
+                                                                        \
+        /* walk the evictions back so no entry is lost */               \
+        while (kick-- > 0) {                                            \
+                _name ## _swap(pp, path[kick], way[kick], &tag, &k,     \
+                               &v);                                     \
+        }                                                               \
+                                                                        \
+        return -1;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Resize _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @cap: new bucket count                                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _resize(struct _name **ppp, hash_map_size_t cap)               \
+{                                                                       \
+        struct _name *newpp = NULL;                                     \
+        struct _name *pp = *ppp;                                        \
+        struct _name ## _bucket *bp = NULL;                             \
+        hash_map_size_t b = 0;                                          \
+        int i = 0;                                                      \
+        _k k;                                                           \
+                                                                        \
+        newpp = _name ## _new(cap * CUCKOO_HASH_MAP_WAYS);              \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+                                                                        \
+        for (b = 0; b < pp->c_cap; b++) {                               \
+                bp = &pp->c_bucket[b];                                  \
+                for (i = 0; i < CUCKOO_HASH_MAP_WAYS; i++) {            \
+                        if (bp->b_tag[i] == CUCKOO_HASH_MAP_EMPTY)      \
+                                continue;                               \
+                        k = bp->b_key[i];                               \
+                        if (_name ## _place(newpp, _hash(k), k,         \
+                                            bp->b_val[i]) < 0)          \
+                                goto overflow;                          \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        newpp->c_len = pp->c_len;                                       \
+        _name ## _free(ppp);                                            \
+        *ppp = newpp;                                                   \
+        return 0;                                                       \
+                                                                        \
+overflow:                                                               \
+        _name ## _free(&newpp);                                         \
+        errno = EOVERFLOW;                                              \
+        return -1;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Double bucket count of _name{}:                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  when entries cannot all be placed in the doubled table, keep        \
+ *  doubling up to CUCKOO_HASH_MAP_GROW_TRIES more times                \
+ */                                                                     \
+static inline int                                                       \
+_name ## _grow(struct _name **ppp)                                      \
+{                                                                       \
+        hash_map_size_t cap = (*ppp)->c_cap;                            \
+        int tries = 0;                                                  \
+                                                                        \
+        for (;;) {                                                      \
+                cap <<= 1;                                              \
+                if (_name ## _resize(ppp, cap) == 0)                    \
+                        return 0;                                       \
+                if (errno != EOVERFLOW ||                               \
+                    tries++ == CUCKOO_HASH_MAP_GROW_TRIES)              \
+                        return -1;                                      \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find slot of key in _name{}:                                         \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *  @bpp:  where to save pointer to bucket holding key                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot of *bpp holding key                                  \
+ *  @failure: -1                                                        \
+ */                                                                     \
+static inline int                                                       \
+_name ## _find(const struct _name *pp, hash_map_size_t hash, _k k,      \
+               struct _name ## _bucket **bpp)                           \
+{                                                                       \
+        struct _name ## _bucket *bp = NULL;                             \
+        hash_map_size_t mask = pp->c_cap - 1;                           \
+        uint8_t tag = cuckoo_hash_map_tag(hash);                        \
+        int i = 0;                                                      \
+                                                                        \
+        bp = &pp->c_bucket[hash & mask];                                \
+        for (i = 0; i < CUCKOO_HASH_MAP_WAYS; i++) {                    \
+                if (bp->b_tag[i] == tag && _cmp(bp->b_key[i], k) == 0)  \
+                        goto found;                                     \
+        }                                                               \
+                                                                        \
+        bp = &pp->c_bucket[cuckoo_hash_map_alt(hash, mask)];            \
+        for (i = 0; i < CUCKOO_HASH_MAP_WAYS; i++) {                    \
+                if (bp->b_tag[i] == tag && _cmp(bp->b_key[i], k) == 0)  \
+                        goto found;                                     \
+        }                                                               \
+                                                                        \
+        return -1;                                                      \
+                                                                        \
+found:                                                                  \
+        *bpp = bp;                                                      \
+        return i;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, _k k)                             \
+{                                                                       \
+        struct _name ## _bucket *bp = NULL;                             \
+        int i = _name ## _find(pp, _hash(k), k, &bp);                   \
+                                                                        \
+        return i < 0 ? NULL : &bp->b_val[i];                            \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] = v in _name{}:                                           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, _k k, _v v)                           \
+{                                                                       \
+        struct _name ## _bucket *bp = NULL;                             \
+        hash_map_size_t hash = _hash(k);                                \
+        hash_map_size_t slots = 0;                                      \
+        int i = _name ## _find(*ppp, hash, k, &bp);                     \
+                                                                        \
+        if (i >= 0) {                                                   \
+                bp->b_val[i] = v;                                       \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        slots = (*ppp)->c_cap * CUCKOO_HASH_MAP_WAYS;                   \
+        if (unlikely(((*ppp)->c_len << 4) >=                            \
+                     slots * CUCKOO_HASH_MAP_LOAD_FACTOR) &&            \
+            _name ## _grow(ppp) < 0)                                    \
+                return -1;                                              \
+                                                                        \
+        /*                                                              \
+         * evictions failing at low load mean too many keys share their \
+         * buckets, and growing would not help                          \
+         */                                                             \
+        while (_name ## _place(*ppp, hash, k, v) < 0) {                 \
+                slots = (*ppp)->c_cap * CUCKOO_HASH_MAP_WAYS;           \
+                if (((*ppp)->c_len << 1) < slots) {                     \
+                        errno = EOVERFLOW;                              \
+                        return -1;                                      \
+                }                                                       \
+                if (_name ## _grow(ppp) < 0)                            \
+                        return -1;                                      \
+        }                                                               \
+                                                                        \
+        (*ppp)->c_len++;                                                \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, _k k)                               \
+{                                                                       \
+        struct _name ## _bucket *bp = NULL;                             \
+        hash_map_size_t slots = (*ppp)->c_cap * CUCKOO_HASH_MAP_WAYS;   \
+        int i = 0;                                                      \
+                                                                        \
+        /* a shrink that cannot place every entry is skipped */         \
+        if (unlikely((*ppp)->c_len < (slots >> 2)) &&                   \
+            slots > CUCKOO_HASH_MAP_INIT_CAP &&                         \
+            _name ## _resize(ppp, (*ppp)->c_cap >> 1) < 0 &&            \
+            errno != EOVERFLOW)                                         \
+                return -1;                                              \
+                                                                        \
+        i = _name ## _find(*ppp, _hash(k), k, &bp);                     \
+        if (i < 0)                                                      \
+                return 0;                                               \
+                                                                        \
+        bp->b_tag[i] = CUCKOO_HASH_MAP_EMPTY;                           \
+        (*ppp)->c_len--;                                                \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef CUCKOO_HASH_MAP_H */
@@ -0,0 +1,313 @@
+#ifndef HASH_FUNC_H
+#define HASH_FUNC_H
+
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif /* #if defined(__SSE4_2__) */
+
+/* 2^64 / golden ratio, odd */
+#define HASH_FIB 0x9e3779b97f4a7c15ULL
+
+/* wyhash secret, odd and with balanced bits */
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+#define HASH_P3 0x589965cc75374cc3ULL
+
+/* whether hash_crc() uses the crc32 instruction */
+#if defined(__SSE4_2__)
+#define HASH_CRC_HW 1
+#else
+#define HASH_CRC_HW 0
+#endif /* #if defined(__SSE4_2__) */
+
+/* full product of two 64 bit numbers */
+__extension__ typedef unsigned __int128 hash_u128;
+
+/**
+ * Hash a 64 bit key with one Fibonacci multiply:
+ *
+ * Arguments:
+ *  @x: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ *
+ * Notes:
+ *  only the high half of the product depends on every key bit, so it
+ *  is rotated down to where hash & mask picks the slot
+ */
+static inline hash_map_size_t
+hash_fib(uint64_t x)
+{
+        x *= HASH_FIB;
+        return x >> 32 | x << 32;
+}
+
+/**
+ * Hash a 64 bit key with the murmur3 finalizer:
+ *
+ * Arguments:
+ *  @x: key
+ *
+ * Returns:
+ *  @success: hash, every bit depending on every key bit
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_mix(uint64_t x)
+{
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+
+        return x;
+}
+
+/**
+ * Hash a 64 bit key with CRC32C:
+ *
+ * Arguments:
+ *  @x: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ *
+ * Notes:
+ *  low half is the CRC of the key, high half the CRC of the key with
+ *  its halves swapped; without SSE4.2 this is hash_mix()
+ */
+static inline hash_map_size_t
+hash_crc(uint64_t x)
+{
+#if defined(__SSE4_2__)
+        uint64_t lo = _mm_crc32_u64(0, x);
+        uint64_t hi = _mm_crc32_u64(0, x >> 32 | x << 32);
+
+        return hi << 32 | lo;
+#else
+        return hash_mix(x);
+#endif /* #if defined(__SSE4_2__) */
+}
+
+/**
+ * Multiply two 64 bit numbers and fold the product:
+ *
+ * Arguments:
+ *  @a: number
+ *  @b: number
+ *
+ * Returns:
+ *  @success: low xor high half of product
+ *  @failure: does not
+ */
+static inline uint64_t
+hash_mum(uint64_t a, uint64_t b)
+{
+        hash_u128 r = (hash_u128)a * b;
+
+        return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+/**
+ * Read 8 bytes, unaligned, host byte order:
+ *
+ * Arguments:
+ *  @p: pointer to bytes
+ *
+ * Returns:
+ *  @success: bytes
+ *  @failure: does not
+ */
+static inline uint64_t
+hash_read64(const uint8_t *p)
+{
+        uint64_t v = 0;
+
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+/**
+ * Read 4 bytes, unaligned, host byte order:
+ *
+ * Arguments:
+ *  @p: pointer to bytes
+ *
+ * Returns:
+ *  @success: bytes
+ *  @failure: does not
+ */
+static inline uint64_t
+hash_read32(const uint8_t *p)
+{
+        uint32_t v = 0;
+
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+/**
+ * Hash bytes, wyhash style:
+ *
+ * Arguments:
+ *  @key:  pointer to bytes
+ *  @len:  number of bytes
+ *  @seed: seed
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ *
+ * Notes:
+ *  follows the structure of wyhash final4 (three lanes of 16 bytes per
+ *  round, overlapping reads for the tail) but is not bit compatible
+ */
+static inline hash_map_size_t
+hash_bytes(const void *key, size_t len, uint64_t seed)
+{
+        const uint8_t *p = key;
+        hash_u128 r = 0;
+        uint64_t see1 = 0;
+        uint64_t see2 = 0;
+        uint64_t a = 0;
+        uint64_t b = 0;
+        size_t i = len;
+
+        seed ^= hash_mum(seed ^ HASH_P0, HASH_P1);
+
+        if (len <= 16) {
+                if (len >= 4) {
+                        a = hash_read32(p) << 32 |
+                            hash_read32(p + ((len >> 3) << 2));
+                        b = hash_read32(p + len - 4) << 32 |
+                            hash_read32(p + len - 4 - ((len >> 3) << 2));
+                } else if (len > 0) {
+                        a = (uint64_t)p[0] << 16 |
+                            (uint64_t)p[len >> 1] << 8 | p[len - 1];
+                }
+                goto fold;
+        }
+
+        if (i > 48) {
+                see1 = seed;
+                see2 = seed;
+                do {
+                        seed = hash_mum(hash_read64(p) ^ HASH_P1,
+                                        hash_read64(p + 8) ^ seed);
+                        see1 = hash_mum(hash_read64(p + 16) ^ HASH_P2,
+                                        hash_read64(p + 24) ^ see1);
+                        see2 = hash_mum(hash_read64(p + 32) ^ HASH_P3,
+                                        hash_read64(p + 40) ^ see2);
+                        p += 48;
+                        i -= 48;
+                } while (i > 48);
+                seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+                seed = hash_mum(hash_read64(p) ^ HASH_P1,
+                                hash_read64(p + 8) ^ seed);
+                p += 16;
+                i -= 16;
+        }
+
+        a = hash_read64(p + i - 16);
+        b = hash_read64(p + i - 8);
+
+fold:
+        /* both halves of the product go on, never a raw input word */
+        r = (hash_u128)(a ^ HASH_P1) * (b ^ seed);
+        return hash_mum((uint64_t)r ^ HASH_P0 ^ len,
+                        (uint64_t)(r >> 64) ^ HASH_P1);
+}
+
+/**
+ * Hash a NUL terminated string:
+ *
+ * Arguments:
+ *  @s: string
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_str(const char *s)
+{
+        return hash_bytes(s, strlen(s), 0);
+}
+
+/**
+ * Hash an int key with hash_fib():
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_int_fib(int i)
+{
+        return hash_fib((uint32_t)i);
+}
+
+/**
+ * Hash an int key with hash_mix():
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_int_mix(int i)
+{
+        return hash_mix((uint32_t)i);
+}
+
+/**
+ * Hash an int key with hash_crc():
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_int_crc(int i)
+{
+        return hash_crc((uint32_t)i);
+}
+
+/**
+ * Hash an int key with hash_bytes():
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: hash
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+hash_int_bytes(int i)
+{
+        return hash_bytes(&i, sizeof(i), 0);
+}
+
+#endif /* #ifndef HASH_FUNC_H */
@@ -1,29 +1,753 @@
 #ifndef PLD_HASH_MAP_H
 #define PLD_HASH_MAP_H
 
+#include "hash_func.h"
 #include "util.h"
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* #if defined(__SSE2__) */
 
 /* initial capacity of pld_hash_map */
 #ifndef PLD_HASH_MAP_INIT_CAP
 #define PLD_HASH_MAP_INIT_CAP 32
 #endif /* #ifndef PLD_HASH_MAP_INIT_CAP */
 
+/* number of hash bits kept in tagged slot metadata */
+#ifndef PLD_HASH_MAP_TAG_BITS
+#define PLD_HASH_MAP_TAG_BITS 3
+#endif /* #ifndef PLD_HASH_MAP_TAG_BITS */
+
+/* number of p_old slots an incremental map migrates per operation */
+#ifndef PLD_HASH_MAP_MIGRATE
+#define PLD_HASH_MAP_MIGRATE 16
+#endif /* #ifndef PLD_HASH_MAP_MIGRATE */
+
+/* longest displacement an insert may leave in a seeded map */
+#ifndef PLD_HASH_MAP_PROBE_MAX
+#define PLD_HASH_MAP_PROBE_MAX 64
+#endif /* #ifndef PLD_HASH_MAP_PROBE_MAX */
+
+/* number of keys a batch operation hashes and prefetches at once */
+#ifndef PLD_HASH_MAP_BATCH
+#define PLD_HASH_MAP_BATCH 16
+#endif /* #ifndef PLD_HASH_MAP_BATCH */
+
+/* tables at least this many bytes are mmap()ed on huge pages */
+#ifndef PLD_HASH_MAP_HUGE_MIN
+#define PLD_HASH_MAP_HUGE_MIN (1 << 21)
+#endif /* #ifndef PLD_HASH_MAP_HUGE_MIN */
+
+/* number of slots matched at once by group probing */
+#if defined(__AVX2__)
+#define PLD_HASH_MAP_GROUP 32
+#else
+#define PLD_HASH_MAP_GROUP 16
+#endif /* #if defined(__AVX2__) */
+
 /* misc. constants */
 enum {
         PLD_HASH_MAP_LOAD_FACTOR = 12, /* load factor */
+        PLD_HASH_MAP_SHRINK_FACTOR = 3, /* sixteenths full to shrink at */
+        PLD_HASH_MAP_GROW_TRIES  = 4,  /* reseeds tried */
+        PLD_HASH_MAP_RADIX_BITS  = 11, /* home slot bits sorted per pass */
+        PLD_HASH_MAP_ALIGN       = 64, /* alignment of table regions */
+        PLD_HASH_MAP_HUGE_PAGE   = 1 << 21, /* huge page size */
+        PLD_HASH_MAP_FILE_HEAD   = 1 << 12, /* snapshot header bytes */
+        PLD_HASH_MAP_PAGE        = 1 << 12, /* small page size */
+        PLD_HASH_MAP_DISCARD     = 1 << 15, /* p_old slots discarded at once */
+        PLD_HASH_MAP_POPULATE    = 1 << 18, /* new table bytes faulted at once */
 };
 
+/* snapshot format (see _save()) */
+#define PLD_HASH_MAP_MAGIC   0x50414d4853444c50ULL /* "PLDHSMAP" */
+#define PLD_HASH_MAP_VERSION 2
+
 /* slot metadata */
 enum {
         PLD_HASH_MAP_NEVER = 0xff, /* slot never occupied */
         PLD_HASH_MAP_WAS   = 0xfe, /* slot was occupied */
 };
 
+/*
+ * p_meta holds slot metadata inverted, so NEVER is stored as 0 and a
+ * table on fresh zero pages needs no clearing; the same macro turns a
+ * stored byte into metadata and back
+ */
+#define PLD_HASH_MAP_META(_m) ((uint8_t)~(_m))
+
+/* map flags (see PLD_HASH_MAP_DEFINE_FLAGS()) */
+enum {
+        PLD_HASH_MAP_BACKSHIFT = 1 << 0,                    /* no WAS */
+        PLD_HASH_MAP_TAGGED    = 1 << 1,                    /* hash tag */
+        PLD_HASH_MAP_SIMD      = 1 << 2 | PLD_HASH_MAP_TAGGED, /* groups */
+        PLD_HASH_MAP_INCREMENTAL = 1 << 3,                  /* rehash */
+        PLD_HASH_MAP_AOS       = 1 << 4,                    /* p_slot */
+        PLD_HASH_MAP_NOHASH    = 1 << 5 | PLD_HASH_MAP_TAGGED, /* rehash */
+        PLD_HASH_MAP_STATS     = 1 << 6,                    /* counters */
+        PLD_HASH_MAP_SEEDED    = 1 << 7,                    /* hash seed */
+        PLD_HASH_MAP_NOSHRINK  = 1 << 8,                    /* no shrink */
+        PLD_HASH_MAP_NOGROW    = 1 << 9,                    /* no resize */
+};
+
+/* grow and shrink thresholds of a map, sixteenths full, as map flags */
+#define PLD_HASH_MAP_LOAD(_grow, _shrink) ((_grow) << 12 | (_shrink) << 16)
+
+/* slot returned by lookups that did not find the key */
+#define PLD_HASH_MAP_NOT_FOUND ((hash_map_size_t)-1)
+
+/* largest displacement slot metadata of a map can hold */
+#define PLD_HASH_MAP_MAX_DISP(_flags)                                   \
+        (((_flags) & PLD_HASH_MAP_TAGGED) ?                             \
+         (0xfe >> PLD_HASH_MAP_TAG_BITS) - 1 : PLD_HASH_MAP_WAS - 1)
+
+/* largest displacement an entry of a map is placed at */
+#define PLD_HASH_MAP_PROBE_LIMIT(_flags)                                \
+        (((_flags) & PLD_HASH_MAP_SEEDED) &&                            \
+         PLD_HASH_MAP_PROBE_MAX < PLD_HASH_MAP_MAX_DISP(_flags) ?       \
+         PLD_HASH_MAP_PROBE_MAX : PLD_HASH_MAP_MAX_DISP(_flags))
+
+/* sixteenths full a table of a map grows above */
+#define PLD_HASH_MAP_GROW_AT(_flags)                                    \
+        ((hash_map_size_t)(((_flags) >> 12 & 0xf) ?                    \
+                           ((_flags) >> 12 & 0xf) :                     \
+                           PLD_HASH_MAP_LOAD_FACTOR))
+
+/* sixteenths full a table of a map shrinks below, 0 if it never does */
+#define PLD_HASH_MAP_SHRINK_AT(_flags)                                  \
+        ((hash_map_size_t)(((_flags) & PLD_HASH_MAP_NOSHRINK) ? 0 :     \
+                           ((_flags) >> 16 & 0xf) ?                     \
+                           ((_flags) >> 16 & 0xf) :                     \
+                           PLD_HASH_MAP_SHRINK_FACTOR))
+
+/* displacement of each slot in a group, shifted past the tag bits */
+#define PLD_HASH_MAP_LANE(_i) \
+        (uint8_t)(((_i) << PLD_HASH_MAP_TAG_BITS) & 0xff)
+static const uint8_t pld_hash_map_lane[32] = {
+        PLD_HASH_MAP_LANE(0),  PLD_HASH_MAP_LANE(1),
+        PLD_HASH_MAP_LANE(2),  PLD_HASH_MAP_LANE(3),
+        PLD_HASH_MAP_LANE(4),  PLD_HASH_MAP_LANE(5),
+        PLD_HASH_MAP_LANE(6),  PLD_HASH_MAP_LANE(7),
+        PLD_HASH_MAP_LANE(8),  PLD_HASH_MAP_LANE(9),
+        PLD_HASH_MAP_LANE(10), PLD_HASH_MAP_LANE(11),
+        PLD_HASH_MAP_LANE(12), PLD_HASH_MAP_LANE(13),
+        PLD_HASH_MAP_LANE(14), PLD_HASH_MAP_LANE(15),
+        PLD_HASH_MAP_LANE(16), PLD_HASH_MAP_LANE(17),
+        PLD_HASH_MAP_LANE(18), PLD_HASH_MAP_LANE(19),
+        PLD_HASH_MAP_LANE(20), PLD_HASH_MAP_LANE(21),
+        PLD_HASH_MAP_LANE(22), PLD_HASH_MAP_LANE(23),
+        PLD_HASH_MAP_LANE(24), PLD_HASH_MAP_LANE(25),
+        PLD_HASH_MAP_LANE(26), PLD_HASH_MAP_LANE(27),
+        PLD_HASH_MAP_LANE(28), PLD_HASH_MAP_LANE(29),
+        PLD_HASH_MAP_LANE(30), PLD_HASH_MAP_LANE(31),
+};
+
+/**
+ * Match a group of tagged slot metadata:
+ *
+ * Arguments:
+ *  @meta: first slot of group
+ *  @want: tagged metadata an entry in the first slot would have
+ *  @stop: where to save bitmask of slots that end the probe
+ *
+ * Returns:
+ *  @success: bitmask of slots whose metadata is want with the
+ *            displacement bumped by the slot's offset in the group
+ *  @failure: does not
+ *
+ * Notes:
+ *  a slot ends the probe when it is NEVER or its entry is less
+ *  displaced than ours would be there
+ */
+static inline uint32_t
+pld_hash_map_group_match(const uint8_t *meta, uint8_t want, uint32_t *stop)
+{
+        uint8_t base = (uint8_t)(want >> PLD_HASH_MAP_TAG_BITS
+                                      << PLD_HASH_MAP_TAG_BITS);
+#if defined(__AVX2__)
+        __m256i m = _mm256_xor_si256(_mm256_loadu_si256(
+                        (const __m256i *)meta), _mm256_set1_epi8(-1));
+        __m256i lane = _mm256_loadu_si256(
+                        (const __m256i *)pld_hash_map_lane);
+        __m256i eq = _mm256_cmpeq_epi8(m, _mm256_add_epi8(lane,
+                        _mm256_set1_epi8((char)want)));
+        __m256i lt = _mm256_subs_epu8(_mm256_add_epi8(lane,
+                        _mm256_set1_epi8((char)base)), m);
+        __m256i never = _mm256_cmpeq_epi8(m,
+                        _mm256_set1_epi8((char)PLD_HASH_MAP_NEVER));
+
+        lt = _mm256_cmpeq_epi8(lt, _mm256_setzero_si256());
+        *stop = ~(uint32_t)_mm256_movemask_epi8(lt) |
+                (uint32_t)_mm256_movemask_epi8(never);
+        return (uint32_t)_mm256_movemask_epi8(eq);
+#elif defined(__SSE2__)
+        __m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i *)meta),
+                                  _mm_set1_epi8(-1));
+        __m128i lane = _mm_loadu_si128((const __m128i *)pld_hash_map_lane);
+        __m128i eq = _mm_cmpeq_epi8(m, _mm_add_epi8(lane,
+                        _mm_set1_epi8((char)want)));
+        __m128i lt = _mm_subs_epu8(_mm_add_epi8(lane,
+                        _mm_set1_epi8((char)base)), m);
+        __m128i never = _mm_cmpeq_epi8(m,
+                        _mm_set1_epi8((char)PLD_HASH_MAP_NEVER));
+
+        lt = _mm_cmpeq_epi8(lt, _mm_setzero_si128());
+        *stop = (~(uint32_t)_mm_movemask_epi8(lt) & 0xffff) |
+                (uint32_t)_mm_movemask_epi8(never);
+        return (uint32_t)_mm_movemask_epi8(eq);
+#else
+        uint32_t match = 0;
+        uint8_t lane = 0;
+        uint8_t m = 0;
+        int i = 0;
+
+        *stop = 0;
+        for (i = 0; i < PLD_HASH_MAP_GROUP; i++) {
+                lane = pld_hash_map_lane[i];
+                m = PLD_HASH_MAP_META(meta[i]);
+                if (m == (uint8_t)(lane + want))
+                        match |= (uint32_t)1 << i;
+                if (m == PLD_HASH_MAP_NEVER || m < (uint8_t)(lane + base))
+                        *stop |= (uint32_t)1 << i;
+        }
+
+        return match;
+#endif /* #if defined(__AVX2__) */
+}
+
+/**
+ * Find slots of a group whose metadata is below a limit:
+ *
+ * Arguments:
+ *  @meta:  first slot of group
+ *  @limit: PLD_HASH_MAP_WAS for occupied slots, PLD_HASH_MAP_NEVER for
+ *          occupied and WAS slots
+ *
+ * Returns:
+ *  @success: bitmask of slots whose metadata is below limit
+ *  @failure: does not
+ *
+ * Notes:
+ *  reads PLD_HASH_MAP_GROUP bytes, so sparse tables are walked a group
+ *  of empty slots per instruction
+ */
+static inline uint32_t
+pld_hash_map_group_below(const uint8_t *meta, uint8_t limit)
+{
+#if defined(__AVX2__)
+        __m256i m = _mm256_xor_si256(_mm256_loadu_si256(
+                        (const __m256i *)meta), _mm256_set1_epi8(-1));
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(m,
+                        _mm256_set1_epi8((char)limit)), m);
+
+        return ~(uint32_t)_mm256_movemask_epi8(ge);
+#elif defined(__SSE2__)
+        __m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i *)meta),
+                                  _mm_set1_epi8(-1));
+        __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(m,
+                        _mm_set1_epi8((char)limit)), m);
+
+        return ~(uint32_t)_mm_movemask_epi8(ge) & 0xffff;
+#else
+        uint32_t below = 0;
+        int i = 0;
+
+        for (i = 0; i < PLD_HASH_MAP_GROUP; i++) {
+                if (PLD_HASH_MAP_META(meta[i]) < limit)
+                        below |= (uint32_t)1 << i;
+        }
+
+        return below;
+#endif /* #if defined(__AVX2__) */
+}
+
+/* allocator of table storage (see _new_alloc()) */
+struct pld_hash_map_alloc {
+        void *(*a_alloc)(void *ctx, size_t size);           /* allocate */
+        void  (*a_free)(void *ctx, void *ptr, size_t size); /* free */
+        void   *a_ctx;                                      /* context */
+};
+
+/**
+ * Round a size up to a power of 2 multiple:
+ *
+ * Arguments:
+ *  @size:  size
+ *  @align: power of 2
+ *
+ * Returns:
+ *  @success: smallest multiple of align not below size
+ *  @failure: does not
+ */
+static inline size_t
+pld_hash_map_round(size_t size, size_t align)
+{
+        return (size + align - 1) & ~(align - 1);
+}
+
+/**
+ * Map memory aligned to and backed by huge pages where possible:
+ *
+ * Arguments:
+ *  @size: number of bytes
+ *  @huge: false to leave the memory on small pages
+ *
+ * Returns:
+ *  @success: pointer to zeroed memory
+ *  @failure: NULL and errno set
+ */
+static inline void *
+pld_hash_map_map(size_t size, bool huge)
+{
+        size_t len = pld_hash_map_round(size, PLD_HASH_MAP_HUGE_PAGE);
+        uint8_t *raw = NULL;
+        size_t head = 0;
+
+        /* map a huge page too many and trim it to an aligned range */
+        raw = mmap(NULL, len + PLD_HASH_MAP_HUGE_PAGE,
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+        if (raw == MAP_FAILED)
+                return NULL;
+
+        head = (size_t)-(uintptr_t)raw & (PLD_HASH_MAP_HUGE_PAGE - 1);
+        if (head != 0)
+                munmap(raw, head);
+        munmap(raw + head + len, PLD_HASH_MAP_HUGE_PAGE - head);
+
+#if defined(MADV_HUGEPAGE)
+        if (huge)
+                (void)madvise(raw + head, len, MADV_HUGEPAGE);
+#endif /* #if defined(MADV_HUGEPAGE) */
+
+        return raw + head;
+}
+
+/**
+ * Allocate storage of a table:
+ *
+ * Arguments:
+ *  @ap:   pointer to pld_hash_map_alloc{} (or NULL for default)
+ *  @size: number of bytes
+ *  @huge: false to keep a mapped table off huge pages
+ *
+ * Returns:
+ *  @success: pointer to memory
+ *  @failure: NULL and errno set
+ */
+static inline void *
+pld_hash_map_alloc(const struct pld_hash_map_alloc *ap, size_t size,
+                   bool huge)
+{
+        if (ap != NULL)
+                return ap->a_alloc(ap->a_ctx, size);
+
+        if (size >= PLD_HASH_MAP_HUGE_MIN)
+                return pld_hash_map_map(size, huge);
+
+        return aligned_alloc(PLD_HASH_MAP_ALIGN,
+                             pld_hash_map_round(size, PLD_HASH_MAP_ALIGN));
+}
+
+/**
+ * Test if storage of a table comes zeroed:
+ *
+ * Arguments:
+ *  @ap:   pointer to pld_hash_map_alloc{} (or NULL for default)
+ *  @size: number of bytes
+ *
+ * Returns:
+ *  @true:  if pld_hash_map_alloc() maps fresh pages for it
+ *  @false: if not
+ */
+static inline bool
+pld_hash_map_zeroed(const struct pld_hash_map_alloc *ap, size_t size)
+{
+        return ap == NULL && size >= PLD_HASH_MAP_HUGE_MIN;
+}
+
+/**
+ * Give back the pages of a slot range of a table region:
+ *
+ * Arguments:
+ *  @base: table block mapped by pld_hash_map_map()
+ *  @off:  offset of region in block
+ *  @elem: bytes per slot in region
+ *  @from: first slot
+ *  @to:   slot after last
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not, pages kept
+ *
+ * Notes:
+ *  only pages wholly inside the range go, and read back as zeroes
+ */
+static inline void
+pld_hash_map_discard(uint8_t *base, size_t off, size_t elem,
+                     hash_map_size_t from, hash_map_size_t to)
+{
+        uintptr_t page = PLD_HASH_MAP_PAGE - 1;
+        uintptr_t lo = (uintptr_t)(base + off + from * elem);
+        uintptr_t hi = (uintptr_t)(base + off + to * elem);
+
+        lo = (lo + page) & ~page;
+        hi &= ~page;
+        if (hi > lo)
+                (void)madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+/**
+ * Fault in a byte range of a table block:
+ *
+ * Arguments:
+ *  @base: table block mapped by pld_hash_map_map()
+ *  @from: offset of first byte, page aligned
+ *  @to:   offset after last byte
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not, pages are faulted in on use
+ *
+ * Notes:
+ *  one madvise() where the kernel has MADV_POPULATE_WRITE, else a
+ *  write of each page that leaves its bytes as they are
+ */
+static inline void
+pld_hash_map_populate(uint8_t *base, size_t from, size_t to)
+{
+#if defined(MADV_POPULATE_WRITE)
+        if (madvise(base + from, to - from, MADV_POPULATE_WRITE) == 0)
+                return;
+#endif /* #if defined(MADV_POPULATE_WRITE) */
+
+        for (; from < to; from += PLD_HASH_MAP_PAGE)
+                (void)__atomic_fetch_or(base + from, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Free storage of a table:
+ *
+ * Arguments:
+ *  @ap:   pointer to pld_hash_map_alloc{} it came from (or NULL)
+ *  @ptr:  pointer to memory
+ *  @size: number of bytes it was allocated with
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+pld_hash_map_release(const struct pld_hash_map_alloc *ap, void *ptr,
+                     size_t size)
+{
+        if (ap != NULL) {
+                ap->a_free(ap->a_ctx, ptr, size);
+                return;
+        }
+
+        if (size >= PLD_HASH_MAP_HUGE_MIN) {
+                munmap(ptr, pld_hash_map_round(size,
+                                               PLD_HASH_MAP_HUGE_PAGE));
+                return;
+        }
+
+        free(ptr);
+}
+
+/* header of a snapshot, first of PLD_HASH_MAP_FILE_HEAD bytes */
+struct pld_hash_map_file {
+        uint64_t f_magic;    /* PLD_HASH_MAP_MAGIC, in host byte order */
+        uint32_t f_version;  /* PLD_HASH_MAP_VERSION */
+        uint32_t f_flags;    /* map flags */
+        uint32_t f_key_size; /* sizeof(_k) */
+        uint32_t f_val_size; /* sizeof(_v) */
+        uint64_t f_cap;      /* p_cap */
+        uint64_t f_len;      /* p_len */
+        uint64_t f_was;      /* p_was */
+        uint64_t f_seed;     /* p_seed */
+        uint64_t f_size;     /* bytes of table block past the header */
+        uint64_t f_sum;      /* checksum of p_meta and slot arrays */
+        uint64_t f_head_sum; /* checksum of the fields above */
+};
+
+/**
+ * Checksum bytes of a snapshot:
+ *
+ * Arguments:
+ *  @p: pointer to bytes
+ *  @n: number of bytes
+ *
+ * Returns:
+ *  @success: checksum
+ *  @failure: does not
+ */
+static inline uint64_t
+pld_hash_map_sum(const void *p, size_t n)
+{
+        return hash_bytes(p, n, PLD_HASH_MAP_MAGIC);
+}
+
+/**
+ * Checksum header of a snapshot:
+ *
+ * Arguments:
+ *  @fp: pointer to pld_hash_map_file{}
+ *
+ * Returns:
+ *  @success: checksum of every field before f_head_sum
+ *  @failure: does not
+ */
+static inline uint64_t
+pld_hash_map_head_sum(const struct pld_hash_map_file *fp)
+{
+        return pld_hash_map_sum(fp, offsetof(struct pld_hash_map_file,
+                                             f_head_sum));
+}
+
+/**
+ * Write all bytes to a file descriptor:
+ *
+ * Arguments:
+ *  @fd: file descriptor
+ *  @p:  pointer to bytes
+ *  @n:  number of bytes
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set
+ */
+static inline int
+pld_hash_map_write(int fd, const void *p, size_t n)
+{
+        const uint8_t *cur = p;
+        ssize_t ret = 0;
+
+        while (n > 0) {
+                ret = write(fd, cur, n);
+                if (ret < 0 && errno == EINTR)
+                        continue;
+                if (ret < 0)
+                        return -1;
+                cur += ret;
+                n -= (size_t)ret;
+        }
+
+        return 0;
+}
+
+/**
+ * Map a snapshot file:
+ *
+ * Arguments:
+ *  @path: path of file written by _save()
+ *  @size: where to save bytes mapped
+ *
+ * Returns:
+ *  @success: pointer to private writable mapping of whole file
+ *  @failure: NULL and errno set
+ *
+ * Notes:
+ *  pages stay shared with the page cache until written, so processes
+ *  that only look keys up share one copy of the table
+ */
+static inline uint8_t *
+pld_hash_map_map_file(const char *path, size_t *size)
+{
+        struct stat st;
+        void *base = MAP_FAILED;
+        int err = 0;
+        int fd = -1;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return NULL;
+
+        if (fstat(fd, &st) < 0)
+                goto close;
+
+        if ((size_t)st.st_size < PLD_HASH_MAP_FILE_HEAD) {
+                errno = EINVAL;
+                goto close;
+        }
+
+        *size = (size_t)st.st_size;
+        base = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    0);
+
+#if defined(MADV_RANDOM)
+        /* lookups fault pages in at random, readahead would be wasted */
+        if (base != MAP_FAILED)
+                (void)madvise(base, *size, MADV_RANDOM);
+#endif /* #if defined(MADV_RANDOM) */
+
+close:
+        err = errno;
+        close(fd);
+        errno = err;
+        return base == MAP_FAILED ? NULL : base;
+}
+
+/* operations counted by PLD_HASH_MAP_STATS */
+enum pld_hash_map_op {
+        PLD_HASH_MAP_OP_GET,   /* _get() and friends */
+        PLD_HASH_MAP_OP_SET,   /* _set() and friends */
+        PLD_HASH_MAP_OP_UNSET, /* _unset() */
+        PLD_HASH_MAP_NOP,      /* not counted */
+};
+
+/* probe length buckets, bucket b counts lengths in [2^b, 2^(b + 1)) */
+enum {
+        PLD_HASH_MAP_HIST = 9,
+};
+
+/* counters of one operation (PLD_HASH_MAP_STATS) */
+struct pld_hash_map_op_stats {
+        uint64_t o_calls;                   /* calls */
+        uint64_t o_probes;                  /* slots probed */
+        uint64_t o_hist[PLD_HASH_MAP_HIST]; /* calls by probe length */
+};
+
+/* counters of a map (PLD_HASH_MAP_STATS) */
+struct pld_hash_map_stats {
+        struct pld_hash_map_op_stats s_op[PLD_HASH_MAP_NOP]; /* per op */
+        uint64_t s_swap;      /* robin hood swaps */
+        uint64_t s_resize;    /* resizes, or incremental resizes started */
+        uint64_t s_resize_ns; /* time spent in them */
+        uint64_t s_reseed;    /* rehashes with a new seed */
+};
+
+static const char *const pld_hash_map_op_name[PLD_HASH_MAP_NOP] = {
+        "get", "set", "unset",
+};
+
+/**
+ * Get monotonic time:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: nanoseconds since an arbitrary point
+ *  @failure: does not
+ */
+static inline uint64_t
+pld_hash_map_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Draw a hash seed:
+ *
+ * Arguments:
+ *  @p: address of the table seeded, mixed in if getrandom() fails
+ *
+ * Returns:
+ *  @success: random seed
+ *  @failure: does not
+ */
+static inline uint64_t
+pld_hash_map_seed(const void *p)
+{
+        uint64_t seed = 0;
+
+        if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) !=
+            (ssize_t)sizeof(seed))
+                seed = hash_mix(pld_hash_map_ns() ^ (uintptr_t)p);
+
+        return seed;
+}
+
+/**
+ * Count one probe of an operation:
+ *
+ * Arguments:
+ *  @sp:  pointer to pld_hash_map_stats{}
+ *  @op:  operation (PLD_HASH_MAP_NOP to count nothing)
+ *  @len: number of slots probed
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+pld_hash_map_count(struct pld_hash_map_stats *sp, enum pld_hash_map_op op,
+                   hash_map_size_t len)
+{
+        struct pld_hash_map_op_stats *osp = NULL;
+        int b = 0;
+
+        if (op == PLD_HASH_MAP_NOP)
+                return;
+
+        osp = &sp->s_op[op];
+        osp->o_calls++;
+        osp->o_probes += len;
+
+        b = len == 0 ? 0 : 63 - __builtin_clzll(len);
+        if (b >= PLD_HASH_MAP_HIST)
+                b = PLD_HASH_MAP_HIST - 1;
+        osp->o_hist[b]++;
+}
+
+/**
+ * Count one resize:
+ *
+ * Arguments:
+ *  @sp:    pointer to pld_hash_map_stats{}
+ *  @start: pld_hash_map_ns() when resize started
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+pld_hash_map_count_resize(struct pld_hash_map_stats *sp, uint64_t start)
+{
+        sp->s_resize++;
+        sp->s_resize_ns += pld_hash_map_ns() - start;
+}
+
+/**
+ * Write an array of counters as JSON:
+ *
+ * Arguments:
+ *  @fp: stream
+ *  @a:  counters
+ *  @n:  number of counters
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not, check ferror(fp)
+ */
+static inline void
+pld_hash_map_dump_array(FILE *fp, const uint64_t *a, size_t n)
+{
+        size_t i = 0;
+
+        fputc('[', fp);
+        for (i = 0; i < n; i++)
+                fprintf(fp, "%s%llu", i ? "," : "",
+                        (unsigned long long)a[i]);
+        fputc(']', fp);
+}
+
 /**
  * Define a new hash table with linear displacement probing:
  *
@@ -35,6 +759,111 @@ enum {
  *  @_cmp:  key comparison function
  */
 #define PLD_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)                 \
+        PLD_HASH_MAP_DEFINE_FLAGS(_k, _v, _name, _hash, _cmp, 0)
+
+/**
+ * Define a new hash table with linear displacement probing and
+ * compile-time options:
+ *
+ * Arguments:
+ *  @_k:     key type
+ *  @_v:     value type
+ *  @_name:  name of generated struct and prefix of all function names
+ *  @_hash:  hash function
+ *  @_cmp:   key comparison function
+ *  @_flags: bitwise or of PLD_HASH_MAP_* map flags:
+ *
+ *    @PLD_HASH_MAP_BACKSHIFT: on unset, shift the following displaced
+ *                             entries back one slot instead of leaving a
+ *                             WAS tombstone behind
+ *    @PLD_HASH_MAP_TAGGED:    keep the top PLD_HASH_MAP_TAG_BITS of the
+ *                             hash next to the displacement in p_meta so
+ *                             most key compares are skipped; limits
+ *                             displacement to PLD_HASH_MAP_MAX_DISP()
+ *    @PLD_HASH_MAP_SIMD:      tagged, and match PLD_HASH_MAP_GROUP slots of
+ *                             p_meta per instruction on lookup
+ *    @PLD_HASH_MAP_INCREMENTAL: resize by keeping the old table in p_old
+ *                             and moving PLD_HASH_MAP_MIGRATE of its
+ *                             slots per _set/_unset instead of rehashing
+ *                             everything at once
+ *    @PLD_HASH_MAP_AOS:       keep hash, key and value of a slot together
+ *                             in p_slot instead of the parallel p_hash,
+ *                             p_key and p_val arrays, so a hit touches
+ *                             the p_meta line and one slot line
+ *    @PLD_HASH_MAP_NOHASH:    tagged, and save no hashes; _hash is called
+ *                             again on the key whenever a slot's hash is
+ *                             needed (resize, robin hood swaps), so only
+ *                             use it for cheap hashes
+ *    @PLD_HASH_MAP_STATS:     count calls and probe lengths of each
+ *                             operation, robin hood swaps and resizes in
+ *                             p_stats for _stats_dump(); maps without it
+ *                             compile every counter out
+ *    @PLD_HASH_MAP_SEEDED:    mix a random per-table p_seed into every
+ *                             hash, so keys crafted to collide in the low
+ *                             bits of _hash no longer share home slots,
+ *                             and reseed a sparse table whose keys still
+ *                             cluster instead of failing the insert
+ *    @PLD_HASH_MAP_NOSHRINK:  never shrink on _unset() or _erase_if(),
+ *                             only on _shrink_to_fit()
+ *    @PLD_HASH_MAP_NOGROW:    never swap tables inside an insert; one
+ *                             that would grow, rehash or reseed fails
+ *                             with EOVERFLOW instead, leaving the resize
+ *                             to the caller (see sharded_hash_map.h)
+ *    @PLD_HASH_MAP_LOAD(g, s): grow a table above g/16 full and shrink
+ *                             it below s/16 full rather than at
+ *                             PLD_HASH_MAP_LOAD_FACTOR and
+ *                             PLD_HASH_MAP_SHRINK_FACTOR; s must be
+ *                             below g/2, so that a table lands between
+ *                             the two after either resize
+ *
+ *  an insert that would leave an entry displaced past
+ *  PLD_HASH_MAP_PROBE_LIMIT() grows a table at least 1/8 full once; a
+ *  sparser one is reseeded if PLD_HASH_MAP_SEEDED. If the entry still
+ *  does not fit, the table is put back at its old capacity (an
+ *  incremental map keeps it) and the insert fails with EOVERFLOW. The
+ *  limit is PLD_HASH_MAP_PROBE_MAX in a seeded map, which can always
+ *  reseed keys apart; others keep the most their metadata holds,
+ *  PLD_HASH_MAP_MAX_DISP(), 253 slots or 30 if tagged, so up to that
+ *  many keys sharing a home slot still fit
+ */
+#define PLD_HASH_MAP_DEFINE_FLAGS(_k, _v, _name, _hash, _cmp, _flags)   \
+                                                                        \
+/* fails to compile unless a resize lands between the thresholds */     \
+typedef char _name ## _load_check[                                      \
+        2 * PLD_HASH_MAP_SHRINK_AT(_flags) <                            \
+        PLD_HASH_MAP_GROW_AT(_flags) ? 1 : -1];                         \
+                                                                        \
+/* hash, key and value of one slot (PLD_HASH_MAP_AOS) */                \
+struct _name ## _slot {                                                 \
+        hash_map_size_t s_hash; /* saved hash */                        \
+        _k              s_key;  /* key */                               \
+        _v              s_val;  /* value */                             \
+};                                                                      \
+                                                                        \
+/* key and value of one slot (PLD_HASH_MAP_AOS and _NOHASH) */          \
+struct _name ## _kv {                                                   \
+        _k kv_key; /* key */                                            \
+        _v kv_val; /* value */                                          \
+};                                                                      \
+                                                                        \
+/* hash, key and value of one input entry (_build_from_arrays()) */     \
+struct _name ## _ent {                                                  \
+        hash_map_size_t e_hash; /* seeded hash of key */                \
+        _k              e_key;  /* key */                               \
+        _v              e_val;  /* value */                             \
+};                                                                      \
+                                                                        \
+/* offsets of the regions of a table block of _name{} */                \
+struct _name ## _layout {                                               \
+        size_t l_stats; /* p_stats, 0 if none */                        \
+        size_t l_meta;  /* p_meta */                                    \
+        size_t l_msize; /* bytes of p_meta */                           \
+        size_t l_hash;  /* p_hash, 0 if none */                         \
+        size_t l_key;   /* p_key, 0 if none */                          \
+        size_t l_val;   /* p_val, 0 if none */                          \
+        size_t l_slot;  /* p_slot or p_kv, 0 if none */                 \
+        size_t l_size;  /* bytes of block */                            \
+};                                                                      \
                                                                         \
 /* hash table with linear displacement probing */                       \
 struct _name {                                                          \
@@ -45,400 +874,2723 @@ struct _name {                                                          \
         uint8_t         *p_meta; /* slot metadata */                    \
         _k              *p_key;  /* keys */                             \
         _v              *p_val;  /* values */                           \
+        struct _name ## _slot *p_slot; /* packed slots */               \
+        struct _name ## _kv *p_kv; /* packed slots without hash */      \
+        struct _name    *p_old;  /* table being migrated from */        \
+        hash_map_size_t  p_mig;  /* next slot of p_old to migrate */    \
+        hash_map_size_t  p_gone; /* slots discarded (see _discard()) */ \
+        size_t           p_ready; /* bytes faulted in (_populate()) */  \
+        const struct pld_hash_map_alloc *p_alloc; /* allocator */       \
+        size_t           p_size; /* bytes allocated for table */        \
+        struct pld_hash_map_stats *p_stats; /* counters */              \
+        uint64_t         p_seed; /* hash seed (PLD_HASH_MAP_SEEDED) */  \
+        size_t           p_mapped; /* bytes of _open_mapped() file */   \
 };                                                                      \
                                                                         \
 /**                                                                     \
- * Create a new _name{}:                                                \
+ * Lay out a table block of _name{}:                                    \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: capacity, a power of 2                                        \
+ *  @lp:  pointer to _name_layout{} to fill                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  the struct, p_meta and the slot arrays share one block, each        \
+ *  starting on a PLD_HASH_MAP_ALIGN boundary                           \
+ */                                                                     \
+static inline void                                                      \
+_name ## _layout_for(hash_map_size_t cap, struct _name ## _layout *lp)  \
+{                                                                       \
+        size_t off = 0;                                                 \
+                                                                        \
+        memset(lp, 0, sizeof(*lp));                                     \
+                                                                        \
+        lp->l_msize = sizeof(uint8_t) * cap;                            \
+        if (((_flags) & PLD_HASH_MAP_SIMD) == PLD_HASH_MAP_SIMD)        \
+                lp->l_msize += PLD_HASH_MAP_GROUP;                      \
+                                                                        \
+        off = pld_hash_map_round(sizeof(struct _name),                  \
+                                 PLD_HASH_MAP_ALIGN);                   \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                lp->l_stats = off;                                      \
+                off += pld_hash_map_round(                              \
+                        sizeof(struct pld_hash_map_stats),              \
+                        PLD_HASH_MAP_ALIGN);                            \
+        }                                                               \
+        lp->l_meta = off;                                               \
+        off += pld_hash_map_round(lp->l_msize, PLD_HASH_MAP_ALIGN);     \
+        if (((_flags) & PLD_HASH_MAP_AOS) &&                            \
+            ((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH) {  \
+                lp->l_slot = off;                                       \
+                off += sizeof(struct _name ## _kv) * cap;               \
+        } else if ((_flags) & PLD_HASH_MAP_AOS) {                       \
+                lp->l_slot = off;                                       \
+                off += sizeof(struct _name ## _slot) * cap;             \
+        } else {                                                        \
+                if (((_flags) & PLD_HASH_MAP_NOHASH) !=                 \
+                    PLD_HASH_MAP_NOHASH) {                              \
+                        lp->l_hash = off;                               \
+                        off += pld_hash_map_round(                      \
+                                sizeof(hash_map_size_t) * cap,          \
+                                PLD_HASH_MAP_ALIGN);                    \
+                }                                                       \
+                lp->l_key = off;                                        \
+                off += pld_hash_map_round(sizeof(_k) * cap,             \
+                                          PLD_HASH_MAP_ALIGN);          \
+                lp->l_val = off;                                        \
+                off += sizeof(_v) * cap;                                \
+        }                                                               \
+                                                                        \
+        lp->l_size = off;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Point a _name{} at the regions of its table block:                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @base: table block laid out by _layout_for()                        \
+ *  @cap:  capacity                                                     \
+ *  @lp:   pointer to _name_layout{} of block                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{} at base, regions left as they are      \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _carve(uint8_t *base, hash_map_size_t cap,                     \
+                const struct _name ## _layout *lp)                      \
+{                                                                       \
+        struct _name *pp = (struct _name *)(void *)base;                \
+                                                                        \
+        pp->p_meta = base + lp->l_meta;                                 \
+        pp->p_stats = NULL;                                             \
+        if (lp->l_stats != 0)                                           \
+                pp->p_stats = (void *)(base + lp->l_stats);             \
+                                                                        \
+        pp->p_slot = NULL;                                              \
+        pp->p_kv = NULL;                                                \
+        pp->p_hash = NULL;                                              \
+        pp->p_key = NULL;                                               \
+        pp->p_val = NULL;                                               \
+        if (((_flags) & PLD_HASH_MAP_AOS) &&                            \
+            ((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH) {  \
+                pp->p_kv = (void *)(base + lp->l_slot);                 \
+        } else if ((_flags) & PLD_HASH_MAP_AOS) {                       \
+                pp->p_slot = (void *)(base + lp->l_slot);               \
+        } else {                                                        \
+                if (lp->l_hash != 0)                                    \
+                        pp->p_hash = (void *)(base + lp->l_hash);       \
+                pp->p_key = (void *)(base + lp->l_key);                 \
+                pp->p_val = (void *)(base + lp->l_val);                 \
+        }                                                               \
+                                                                        \
+        pp->p_cap = cap;                                                \
+        pp->p_old = NULL;                                               \
+        pp->p_mig = 0;                                                  \
+        pp->p_gone = 0;                                                 \
+        pp->p_ready = 0;                                                \
+        pp->p_size = lp->l_size;                                        \
+        pp->p_mapped = 0;                                               \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{} with an allocator:                              \
  *                                                                      \
  * Arguments:                                                           \
  *  @cap: initial capacity (or 0 for default)                           \
+ *  @ap:  pointer to pld_hash_map_alloc{} (or NULL for default), must   \
+ *        outlive _name{} and hand out memory aligned like malloc()     \
  *                                                                      \
  * Returns:                                                             \
  *  @success: pointer to _name{}                                        \
  *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  the whole table is one block (see _layout_for()); resizes keep      \
+ *  allocator                                                           \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new_alloc(hash_map_size_t cap,                                \
+                    const struct pld_hash_map_alloc *ap)                \
+{                                                                       \
+        struct _name ## _layout l;                                      \
+        struct _name *pp = NULL;                                        \
+        uint8_t *base = NULL;                                           \
+        bool huge = false;                                              \
+                                                                        \
+        if (cap == 0)                                                   \
+                cap = PLD_HASH_MAP_INIT_CAP;                            \
+                                                                        \
+        /* group loads read PLD_HASH_MAP_GROUP slots past any slot */   \
+        if (((_flags) & PLD_HASH_MAP_SIMD) == PLD_HASH_MAP_SIMD &&      \
+            cap < PLD_HASH_MAP_GROUP)                                   \
+                cap = PLD_HASH_MAP_GROUP;                               \
+                                                                        \
+        cap = next_pow2(cap);                                           \
+        _name ## _layout_for(cap, &l);                                  \
+                                                                        \
+        /*                                                              \
+         * an incremental table is faulted in a few pages a step as     \
+         * entries migrate (see _populate()), and a huge page fault may \
+         * stall on compaction for milliseconds, so it stays on small   \
+         * pages                                                        \
+         */                                                             \
+        huge = !((_flags) & PLD_HASH_MAP_INCREMENTAL);                  \
+        base = pld_hash_map_alloc(ap, l.l_size, huge);                  \
+        if (base == NULL)                                               \
+                return NULL;                                            \
+                                                                        \
+        pp = _name ## _carve(base, cap, &l);                            \
+                                                                        \
+        /* 0 is NEVER stored, zero pages are only faulted in on use */  \
+        if (!pld_hash_map_zeroed(ap, l.l_size))                         \
+                memset(pp->p_meta, 0, l.l_msize);                       \
+        if (pp->p_stats != NULL)                                        \
+                memset(pp->p_stats, 0, sizeof(*pp->p_stats));           \
+                                                                        \
+        pp->p_len = 0;                                                  \
+        pp->p_was = 0;                                                  \
+        pp->p_alloc = ap;                                               \
+        pp->p_seed = 0;                                                 \
+        if ((_flags) & PLD_HASH_MAP_SEEDED)                             \
+                pp->p_seed = pld_hash_map_seed(pp);                     \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial capacity (or 0 for default)                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        return _name ## _new_alloc(cap, NULL);                          \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        if (pp->p_old != NULL)                                          \
+                _name ## _free(&pp->p_old);                             \
+                                                                        \
+        if (pp->p_mapped != 0)                                          \
+                munmap((uint8_t *)pp - PLD_HASH_MAP_FILE_HEAD,          \
+                       pp->p_mapped);                                   \
+        else                                                            \
+                pld_hash_map_release(pp->p_alloc, pp, pp->p_size);      \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries, including any not yet migrated         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        hash_map_size_t len = pp->p_len;                                \
+                                                                        \
+        if (!((_flags) & PLD_HASH_MAP_INCREMENTAL))                     \
+                return len;                                             \
+                                                                        \
+        for (pp = pp->p_old; pp != NULL; pp = pp->p_old)                \
+                len += pp->p_len;                                       \
+                                                                        \
+        return len;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get pointer to key of slot in _name{}:                               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  slot                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to key                                            \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline _k *                                                      \
+_name ## _key_at(const struct _name *pp, hash_map_size_t i)             \
+{                                                                       \
+        if (((_flags) & PLD_HASH_MAP_AOS) &&                            \
+            ((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH)    \
+                return &pp->p_kv[i].kv_key;                             \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_AOS)                                \
+                return &pp->p_slot[i].s_key;                            \
+                                                                        \
+        return &pp->p_key[i];                                           \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get pointer to value of slot in _name{}:                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  slot                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to value                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _val_at(const struct _name *pp, hash_map_size_t i)             \
+{                                                                       \
+        if (((_flags) & PLD_HASH_MAP_AOS) &&                            \
+            ((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH)    \
+                return &pp->p_kv[i].kv_val;                             \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_AOS)                                \
+                return &pp->p_slot[i].s_val;                            \
+                                                                        \
+        return &pp->p_val[i];                                           \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Mix seed of _name{} into a hash:                                     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key returned by _hash                                \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: hash slots and tags of pp are taken from                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _seed_hash(const struct _name *pp, hash_map_size_t hash)       \
+{                                                                       \
+        if (!((_flags) & PLD_HASH_MAP_SEEDED))                          \
+                return hash;                                            \
+                                                                        \
+        return hash_mix(hash ^ pp->p_seed);                             \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get hash of key in slot of _name{}:                                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  occupied or WAS slot                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: saved seeded hash, or a fresh one for PLD_HASH_MAP_NOHASH \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _hash_of(const struct _name *pp, hash_map_size_t i)            \
+{                                                                       \
+        hash_map_size_t hash = 0;                                       \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH) {  \
+                hash = _hash(*_name ## _key_at(pp, i));                 \
+                return _name ## _seed_hash(pp, hash);                   \
+        }                                                               \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_AOS)                                \
+                return pp->p_slot[i].s_hash;                            \
+                                                                        \
+        return pp->p_hash[i];                                           \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Save hash of key in slot of _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot                                                         \
+ *  @hash: seeded hash of key                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _put_hash(struct _name *pp, hash_map_size_t i,                 \
+                   hash_map_size_t hash)                                \
+{                                                                       \
+        if (((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH)    \
+                return;                                                 \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_AOS)                                \
+                pp->p_slot[i].s_hash = hash;                            \
+        else                                                            \
+                pp->p_hash[i] = hash;                                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Copy hash, key and value of one slot of _name{} to another:          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @dst: slot to copy to                                               \
+ *  @src: slot to copy from                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _copy(struct _name *pp, hash_map_size_t dst,                   \
+               hash_map_size_t src)                                     \
+{                                                                       \
+        if (((_flags) & PLD_HASH_MAP_AOS) &&                            \
+            ((_flags) & PLD_HASH_MAP_NOHASH) == PLD_HASH_MAP_NOHASH) {  \
+                pp->p_kv[dst] = pp->p_kv[src];                          \
+                return;                                                 \
+        }                                                               \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_AOS) {                              \
+                pp->p_slot[dst] = pp->p_slot[src];                      \
+                return;                                                 \
+        }                                                               \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_NOHASH) != PLD_HASH_MAP_NOHASH)    \
+                pp->p_hash[dst] = pp->p_hash[src];                      \
+        pp->p_key[dst] = pp->p_key[src];                                \
+        pp->p_val[dst] = pp->p_val[src];                                \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Make slot metadata for _name{}:                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @disp: displacement                                                 \
+ *  @hash: hash of key                                                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot metadata                                             \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline uint8_t                                                   \
+_name ## _meta(uint8_t disp, hash_map_size_t hash)                      \
+{                                                                       \
+        if (!((_flags) & PLD_HASH_MAP_TAGGED))                          \
+                return disp;                                            \
+                                                                        \
+        /* fold all hash bits into the tag, weak hashes leave top 0 */  \
+        hash *= 0x9e3779b97f4a7c15ULL;                                  \
+        hash >>= 64 - PLD_HASH_MAP_TAG_BITS;                            \
+        hash |= (hash_map_size_t)disp << PLD_HASH_MAP_TAG_BITS;         \
+        return (uint8_t)hash;                                           \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get displacement from slot metadata of _name{}:                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @meta: metadata of occupied slot                                    \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: displacement                                              \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline uint8_t                                                   \
+_name ## _disp(uint8_t meta)                                            \
+{                                                                       \
+        if (!((_flags) & PLD_HASH_MAP_TAGGED))                          \
+                return meta;                                            \
+                                                                        \
+        return (uint8_t)(meta >> PLD_HASH_MAP_TAG_BITS);                \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set slot metadata of _name{}:                                        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot                                                         \
+ *  @meta: slot metadata                                                \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _put_meta(struct _name *pp, hash_map_size_t i, uint8_t meta)   \
+{                                                                       \
+        pp->p_meta[i] = PLD_HASH_MAP_META(meta);                        \
+                                                                        \
+        /* mirror the first group past the end for wrapping loads */    \
+        if (((_flags) & PLD_HASH_MAP_SIMD) == PLD_HASH_MAP_SIMD &&      \
+            i < PLD_HASH_MAP_GROUP)                                     \
+                pp->p_meta[pp->p_cap + i] = PLD_HASH_MAP_META(meta);    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get slot metadata of _name{}:                                        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  slot                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot metadata                                             \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline uint8_t                                                   \
+_name ## _get_meta(const struct _name *pp, hash_map_size_t i)           \
+{                                                                       \
+        return PLD_HASH_MAP_META(pp->p_meta[i]);                        \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get displacement of WAS slot in _name{}:                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  slot marked as WAS                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: displacement the removed entry had                        \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a WAS slot may only be reused by an entry at least as displaced     \
+ *  as the one it held, otherwise entries behind it that were swapped   \
+ *  past it become unreachable                                          \
+ */                                                                     \
+static inline uint8_t                                                   \
+_name ## _was_disp(const struct _name *pp, hash_map_size_t i)           \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t hash = _name ## _hash_of(pp, i);                \
+                                                                        \
+        return (uint8_t)((i - (hash & mask)) & mask);                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Test if an entry fits in _name{} without overflowing displacement:   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot to start probing at                                     \
+ *  @disp: displacement of entry at slot i                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if _place() would succeed                                   \
+ *  @false: if not                                                      \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _fits(const struct _name *pp, hash_map_size_t i, uint8_t disp) \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        uint8_t cur = 0;                                                \
+                                                                        \
+        for (;;) {                                                      \
+                cur = _name ## _get_meta(pp, i);                        \
+                                                                        \
+                if (cur == PLD_HASH_MAP_NEVER)                          \
+                        return true;                                    \
+                                                                        \
+                if (cur == PLD_HASH_MAP_WAS) {                          \
+                        if (_name ## _was_disp(pp, i) <= disp)          \
+                                return true;                            \
+                } else if (_name ## _disp(cur) < disp) {                \
+                        disp = _name ## _disp(cur);                     \
+                }                                                       \
+                                                                        \
+                i = (i + 1) & mask;                                     \
+                disp++;                                                 \
+                if (unlikely(disp > PLD_HASH_MAP_PROBE_LIMIT(_flags)))  \
+                        return false;                                   \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Place an entry known not to be in _name{} with robin hood swaps:     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot to start probing at                                     \
+ *  @disp: displacement of entry at slot i                              \
+ *  @hash: seeded hash of key                                           \
+ *  @k:    key                                                          \
+ *  @v:    value                                                        \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1                                                        \
+ */                                                                     \
+static inline int                                                       \
+_name ## _place(struct _name *pp, hash_map_size_t i, uint8_t disp,      \
+                hash_map_size_t hash, _k k, _v v)                       \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t tmp_hash = 0;                                   \
+        uint8_t tmp_meta = 0;                                           \
+        _k tmp_k;                                                       \
+        _v tmp_v;                                                       \
+                                                                        \
+        for (;;) {                                                      \
+                tmp_meta = _name ## _get_meta(pp, i);                   \
+                                                                        \
+                if (tmp_meta == PLD_HASH_MAP_NEVER ||                   \
+                    (tmp_meta == PLD_HASH_MAP_WAS &&                    \
+                     _name ## _was_disp(pp, i) <= disp)) {              \
+                        *_name ## _key_at(pp, i) = k;                   \
+                        *_name ## _val_at(pp, i) = v;                   \
+                        _name ## _put_hash(pp, i, hash);                \
+                        _name ## _put_meta(pp, i,                       \
+                                           _name ## _meta(disp, hash)); \
+                                                                        \
+                        if (tmp_meta == PLD_HASH_MAP_WAS)               \
+                                pp->p_was--;                            \
+                                                                        \
+                        return 0;                                       \
+                }                                                       \
+                                                                        \
+                if (tmp_meta != PLD_HASH_MAP_WAS &&                     \
+                    _name ## _disp(tmp_meta) < disp) {                  \
+                        tmp_k = *_name ## _key_at(pp, i);               \
+                        tmp_v = *_name ## _val_at(pp, i);               \
+                        tmp_hash = _name ## _hash_of(pp, i);            \
+                                                                        \
+                        *_name ## _key_at(pp, i) = k;                   \
+                        *_name ## _val_at(pp, i) = v;                   \
+                        _name ## _put_hash(pp, i, hash);                \
+                        _name ## _put_meta(pp, i,                       \
+                                           _name ## _meta(disp, hash)); \
+                                                                        \
+                        k = tmp_k;                                      \
+                        v = tmp_v;                                      \
+                        hash = tmp_hash;                                \
+                        disp = _name ## _disp(tmp_meta);                \
+                                                                        \
+                        if ((_flags) & PLD_HASH_MAP_STATS)              \
+                                pp->p_stats->s_swap++;                  \
+                }                                                       \
+                                                                        \
+                i = (i + 1) & mask;                                     \
+                disp++;                                                 \
+                if (unlikely(disp > PLD_HASH_MAP_PROBE_LIMIT(_flags)))  \
+                        return -1;                                      \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Move live entries of one _name{} into another:                       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @dst: pointer to _name{} to move to                                 \
+ *  @src: pointer to _name{} to move from                               \
+ *  @i:   slot of src to start at                                       \
+ *  @n:   number of live entries at or after slot i                     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1                                                        \
+ */                                                                     \
+static inline int                                                       \
+_name ## _move(struct _name *dst, const struct _name *src,              \
+               hash_map_size_t i, hash_map_size_t n)                    \
+{                                                                       \
+        hash_map_size_t mask = dst->p_cap - 1;                          \
+        hash_map_size_t moved = 0;                                      \
+        hash_map_size_t hash = 0;                                       \
+                                                                        \
+        for (; moved < n; i++) {                                        \
+                if (_name ## _get_meta(src, i) >= PLD_HASH_MAP_WAS)     \
+                        continue;                                       \
+                                                                        \
+                /* a reseeded table takes slots from the key again */   \
+                if (((_flags) & PLD_HASH_MAP_SEEDED) &&                 \
+                    dst->p_seed != src->p_seed) {                       \
+                        hash = _hash(*_name ## _key_at(src, i));        \
+                        hash = _name ## _seed_hash(dst, hash);          \
+                } else {                                                \
+                        hash = _name ## _hash_of(src, i);               \
+                }                                                       \
+                if (unlikely(_name ## _place(dst, hash & mask, 0, hash, \
+                                *_name ## _key_at(src, i),              \
+                                *_name ## _val_at(src, i)) < 0))        \
+                        return -1;                                      \
+                moved++;                                                \
+        }                                                               \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Rehash _name{} into a new table:                                     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:    pointer to pointer to _name{}                              \
+ *  @cap:    new capacity                                               \
+ *  @reseed: true to draw a new seed, false to keep the old one         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, EOVERFLOW when an entry would be        \
+ *            displaced past PLD_HASH_MAP_PROBE_LIMIT()                 \
+ */                                                                     \
+static inline int                                                       \
+_name ## _rehash(struct _name **ppp, hash_map_size_t cap, bool reseed)  \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        struct _name *newpp = NULL;                                     \
+        struct _name *tp = NULL;                                        \
+        hash_map_size_t from = 0;                                       \
+        uint64_t start = 0;                                             \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_STATS)                              \
+                start = pld_hash_map_ns();                              \
+                                                                        \
+        newpp = _name ## _new_alloc(cap, pp->p_alloc);                  \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+                                                                        \
+        if (!reseed)                                                    \
+                newpp->p_seed = pp->p_seed;                             \
+                                                                        \
+        /* finish any incremental resize along the way */               \
+        for (tp = pp; tp != NULL; tp = tp->p_old) {                     \
+                if (_name ## _move(newpp, tp, from, tp->p_len) < 0)     \
+                        goto overflow;                                  \
+                newpp->p_len += tp->p_len;                              \
+                from = tp->p_mig;                                       \
+        }                                                               \
+                                                                        \
+        /* counters carry over, failed resizes are counted too */       \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                *newpp->p_stats = *pp->p_stats;                         \
+                pld_hash_map_count_resize(newpp->p_stats, start);       \
+                newpp->p_stats->s_reseed += reseed;                     \
+        }                                                               \
+                                                                        \
+        _name ## _free(ppp);                                            \
+        *ppp = newpp;                                                   \
+        return 0;                                                       \
+                                                                        \
+overflow:                                                               \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                pld_hash_map_count_resize(pp->p_stats, start);          \
+        }                                                               \
+                                                                        \
+        _name ## _free(&newpp);                                         \
+        errno = EOVERFLOW;                                              \
+        return -1;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Resize _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @cap: new capacity                                                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _resize(struct _name **ppp, hash_map_size_t cap)               \
+{                                                                       \
+        return _name ## _rehash(ppp, cap, false);                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Double capacity of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  an entry that would overflow displacement in the doubled table      \
+ *  sits in a run doubling did not shorten, so the table is not doubled \
+ *  again: with PLD_HASH_MAP_SEEDED the doubled table is reseeded up to \
+ *  PLD_HASH_MAP_GROW_TRIES times, without it the call fails with       \
+ *  EOVERFLOW and the table is left as it was                           \
+ */                                                                     \
+static inline int                                                       \
+_name ## _grow(struct _name **ppp)                                      \
+{                                                                       \
+        hash_map_size_t cap = (*ppp)->p_cap << 1;                       \
+        int tries = 0;                                                  \
+        int ret = _name ## _resize(ppp, cap);                           \
+                                                                        \
+        while (ret < 0 && errno == EOVERFLOW &&                         \
+               ((_flags) & PLD_HASH_MAP_SEEDED) &&                      \
+               tries++ < PLD_HASH_MAP_GROW_TRIES)                       \
+                ret = _name ## _rehash(ppp, cap, true);                 \
+                                                                        \
+        return ret;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Start incremental resize of _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:    pointer to pointer to _name{}                              \
+ *  @grow:   1 to double capacity, -1 to halve it, 0 to keep it and     \
+ *           only leave WAS slots behind                                \
+ *  @reseed: true to draw a new seed, false to keep the old one         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  only allocates the new table; a table still migrating stays behind  \
+ *  it as its p_old and keeps draining a step at a time. A resize for   \
+ *  load waits until none is migrating (see _insert_hash()), so only an \
+ *  entry that does not fit leaves more than one behind (see _migrate() \
+ *  and _relieve())                                                     \
+ */                                                                     \
+static inline int                                                       \
+_name ## _start_resize(struct _name **ppp, int grow, bool reseed)       \
+{                                                                       \
+        struct _name *newpp = NULL;                                     \
+        hash_map_size_t cap = (*ppp)->p_cap;                            \
+        uint64_t start = 0;                                             \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_STATS)                              \
+                start = pld_hash_map_ns();                              \
+                                                                        \
+        if (grow > 0)                                                   \
+                cap <<= 1;                                              \
+        else if (grow < 0)                                              \
+                cap >>= 1;                                              \
+        newpp = _name ## _new_alloc(cap, (*ppp)->p_alloc);              \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+        if (!reseed)                                                    \
+                newpp->p_seed = (*ppp)->p_seed;                         \
+                                                                        \
+        /* later migration steps are counted as plain operations */     \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                *newpp->p_stats = *(*ppp)->p_stats;                     \
+                pld_hash_map_count_resize(newpp->p_stats, start);       \
+                newpp->p_stats->s_reseed += reseed;                     \
+        }                                                               \
+                                                                        \
+        newpp->p_old = *ppp;                                            \
+        *ppp = newpp;                                                   \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Make room in _name{} for an entry that would probe too far:          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a table at least 1/8 full is grown (see _grow()). A sparser one     \
+ *  holds keys that cluster rather than too many keys: with             \
+ *  PLD_HASH_MAP_SEEDED it is reseeded at its capacity up to            \
+ *  PLD_HASH_MAP_GROW_TRIES times, without it the call fails with       \
+ *  EOVERFLOW and the table is left as it was. An incremental map only  \
+ *  starts the grow or reseed (see _start_resize()), its entries move   \
+ *  over a step at a time                                               \
+ */                                                                     \
+static inline int                                                       \
+_name ## _relieve(struct _name **ppp)                                   \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        int tries = 0;                                                  \
+        int ret = 0;                                                    \
+                                                                        \
+        if (_name ## _len(pp) >= (pp->p_cap >> 3)) {                    \
+                if ((_flags) & PLD_HASH_MAP_INCREMENTAL)                \
+                        return _name ## _start_resize(ppp, 1, false);   \
+                return _name ## _grow(ppp);                             \
+        }                                                               \
+                                                                        \
+        if (!((_flags) & PLD_HASH_MAP_SEEDED)) {                        \
+                errno = EOVERFLOW;                                      \
+                return -1;                                              \
+        }                                                               \
+        if ((_flags) & PLD_HASH_MAP_INCREMENTAL)                        \
+                return _name ## _start_resize(ppp, 0, true);            \
+                                                                        \
+        for (;;) {                                                      \
+                ret = _name ## _rehash(ppp, (*ppp)->p_cap, true);       \
+                if (ret == 0 || errno != EOVERFLOW ||                   \
+                    tries++ == PLD_HASH_MAP_GROW_TRIES)                 \
+                        return ret;                                     \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Discard slots of a table _name{} is migrating from:                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @old: pointer to _name{} migrated from                              \
+ *  @end: slot of old no entry before which is still waiting            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if old gives back pages, whether or not any went this time  \
+ *  @false: if old is not mapped by pld_hash_map_map()                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  pages behind the migration go PLD_HASH_MAP_DISCARD slots at a time, \
+ *  so freeing old at the end unmaps next to nothing; discarded p_meta  \
+ *  reads back as NEVER and ends any probe that reaches it              \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _discard(struct _name *old, hash_map_size_t end)               \
+{                                                                       \
+        struct _name ## _layout l;                                      \
+        uint8_t *base = (uint8_t *)old;                                 \
+        hash_map_size_t from = old->p_gone;                             \
+                                                                        \
+        if (old->p_mapped != 0 ||                                       \
+            !pld_hash_map_zeroed(old->p_alloc, old->p_size))            \
+                return false;                                           \
+                                                                        \
+        if (end < from + PLD_HASH_MAP_DISCARD)                          \
+                return true;                                            \
+                                                                        \
+        _name ## _layout_for(old->p_cap, &l);                           \
+        pld_hash_map_discard(base, l.l_meta, 1, from, end);             \
+        if (l.l_slot != 0 && ((_flags) & PLD_HASH_MAP_NOHASH) ==        \
+                             PLD_HASH_MAP_NOHASH)                       \
+                pld_hash_map_discard(base, l.l_slot,                    \
+                                     sizeof(struct _name ## _kv),       \
+                                     from, end);                        \
+        else if (l.l_slot != 0)                                         \
+                pld_hash_map_discard(base, l.l_slot,                    \
+                                     sizeof(struct _name ## _slot),     \
+                                     from, end);                        \
+        if (l.l_hash != 0)                                              \
+                pld_hash_map_discard(base, l.l_hash,                    \
+                                     sizeof(hash_map_size_t),           \
+                                     from, end);                        \
+        if (l.l_key != 0)                                               \
+                pld_hash_map_discard(base, l.l_key, sizeof(_k),         \
+                                     from, end);                        \
+        if (l.l_val != 0)                                               \
+                pld_hash_map_discard(base, l.l_val, sizeof(_v),         \
+                                     from, end);                        \
+        old->p_gone = end;                                              \
+        return true;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Fault in the next pages of a table _name{} migrates into:            \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  left alone, a new table is faulted in a page at a time by whichever \
+ *  step or insert first writes there, a fault on one op in a few while \
+ *  it migrates; PLD_HASH_MAP_POPULATE bytes a step fault it all in     \
+ *  within the first steps, on far fewer ops                            \
+ */                                                                     \
+static inline void                                                      \
+_name ## _populate(struct _name *pp)                                    \
+{                                                                       \
+        size_t to = pp->p_ready + PLD_HASH_MAP_POPULATE;                \
+                                                                        \
+        if (pp->p_ready >= pp->p_size)                                  \
+                return;                                                 \
+                                                                        \
+        if (!pld_hash_map_zeroed(pp->p_alloc, pp->p_size)) {            \
+                pp->p_ready = pp->p_size;                               \
+                return;                                                 \
+        }                                                               \
+                                                                        \
+        if (to > pp->p_size)                                            \
+                to = pp->p_size;                                        \
+        pld_hash_map_populate((uint8_t *)pp, pp->p_ready, to);          \
+        pp->p_ready = to;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Migrate slots of an incrementally resized _name{}:                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @n:   maximum number of p_old slots to migrate                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  an entry that does not fit in *ppp starts another incremental grow  \
+ *  with the older table still behind (see _start_resize()); the        \
+ *  deepest drains first, straight into *ppp, and *ppp is faulted in a  \
+ *  step at a time (see _populate()). No entry sits more than           \
+ *  PLD_HASH_MAP_PROBE_LIMIT() past its home, so slots that far behind  \
+ *  p_mig are on no probe of an entry still waiting and are discarded;  \
+ *  an emptied table is discarded a step at a time before it is freed   \
+ */                                                                     \
+static inline int                                                       \
+_name ## _migrate(struct _name **ppp, hash_map_size_t n)                \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        struct _name *up = NULL;                                        \
+        struct _name *old = NULL;                                       \
+        hash_map_size_t limit = PLD_HASH_MAP_PROBE_LIMIT(_flags) + 1;   \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t hash = 0;                                       \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        _name ## _populate(pp);                                         \
+                                                                        \
+        while (n > 0 && pp->p_old != NULL) {                            \
+                up = pp;                                                \
+                while (up->p_old->p_old != NULL)                        \
+                        up = up->p_old;                                 \
+                old = up->p_old;                                        \
+                                                                        \
+                if (old->p_len == 0) {                                  \
+                        i = old->p_gone + PLD_HASH_MAP_DISCARD;         \
+                        if (i >= old->p_cap ||                          \
+                            !_name ## _discard(old, i)) {               \
+                                _name ## _free(&up->p_old);             \
+                                up->p_mig = 0;                          \
+                                continue;                               \
+                        }                                               \
+                        n = n > PLD_HASH_MAP_MIGRATE ?                  \
+                            n - PLD_HASH_MAP_MIGRATE : 0;               \
+                        continue;                                       \
+                }                                                       \
+                                                                        \
+                i = up->p_mig++;                                        \
+                n--;                                                    \
+                if (_name ## _get_meta(old, i) >= PLD_HASH_MAP_WAS)     \
+                        continue;                                       \
+                                                                        \
+                /* a reseeded table takes slots from the key again */   \
+                hash = _name ## _hash_of(old, i);                       \
+                if (((_flags) & PLD_HASH_MAP_SEEDED) &&                 \
+                    pp->p_seed != old->p_seed)                          \
+                        hash = _name ## _seed_hash(pp,                  \
+                                        _hash(*_name ## _key_at(old, i))); \
+                if (unlikely(!_name ## _fits(pp, hash & mask, 0))) {    \
+                        up->p_mig--;                                    \
+                        return _name ## _start_resize(ppp, 1, false);   \
+                }                                                       \
+                                                                        \
+                (void)_name ## _place(pp, hash & mask, 0, hash,         \
+                                      *_name ## _key_at(old, i),        \
+                                      *_name ## _val_at(old, i));       \
+                pp->p_len++;                                            \
+                old->p_len--;                                           \
+        }                                                               \
+                                                                        \
+        for (up = pp; up->p_old != NULL; up = up->p_old) {              \
+                if (up->p_mig > limit)                                  \
+                        (void)_name ## _discard(up->p_old,              \
+                                                up->p_mig - limit);     \
+        }                                                               \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Test if rehash need to grow:                                         \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if needed                                                   \
+ *  @false: if not                                                      \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _need_to_grow(const struct _name *pp)                          \
+{                                                                       \
+        hash_map_size_t len = _name ## _len(pp);                        \
+        hash_map_size_t cap = pp->p_cap;                                \
+        hash_map_size_t was = pp->p_was;                                \
+                                                                        \
+        return ((len + was) << 4) > cap * PLD_HASH_MAP_GROW_AT(_flags); \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Test if WAS slots make up most of the load of _name{}:               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if entries fill at most half of what _need_to_grow() allows \
+ *  @false: if not                                                      \
+ *                                                                      \
+ * Notes:                                                               \
+ *  such a table is rehashed at the same capacity rather than doubled,  \
+ *  which would leave it ready to shrink again                          \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _mostly_was(const struct _name *pp)                            \
+{                                                                       \
+        hash_map_size_t len = _name ## _len(pp);                        \
+        hash_map_size_t cap = pp->p_cap;                                \
+                                                                        \
+        return (len << 5) <= cap * PLD_HASH_MAP_GROW_AT(_flags);        \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get capacity _name{} needs to hold entries without growing:          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @n: number of entries                                               \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: smallest power of 2 capacity _need_to_grow() accepts      \
+ *  @failure: 0                                                         \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _cap_for(hash_map_size_t n)                                    \
+{                                                                       \
+        hash_map_size_t grow = PLD_HASH_MAP_GROW_AT(_flags);            \
+                                                                        \
+        if (n > (PLD_HASH_MAP_NOT_FOUND >> 5))                          \
+                return 0;                                               \
+                                                                        \
+        return next_pow2(((n << 4) + grow - 1) / grow);                 \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Reserve room for entries in _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @n:   number of entries to hold without growing                     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  never shrinks, but a later _unset() may shrink the table again      \
+ *  unless PLD_HASH_MAP_NOSHRINK                                        \
+ */                                                                     \
+static inline int                                                       \
+_name ## _reserve(struct _name **ppp, hash_map_size_t n)                \
+{                                                                       \
+        hash_map_size_t cap = _name ## _cap_for(n);                     \
+                                                                        \
+        if (cap == 0) {                                                 \
+                errno = ENOMEM;                                         \
+                return -1;                                              \
+        }                                                               \
+                                                                        \
+        if (cap <= (*ppp)->p_cap)                                       \
+                return 0;                                               \
+                                                                        \
+        return _name ## _resize(ppp, cap);                              \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Shrink _name{} to the capacity its entries need:                     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, map untouched                           \
+ *                                                                      \
+ * Notes:                                                               \
+ *  the way down for PLD_HASH_MAP_NOSHRINK maps, once a bulk removal is \
+ *  done; also clears WAS slots and finishes an incremental resize. The \
+ *  table is left up to PLD_HASH_MAP_GROW_AT() full, so the next insert \
+ *  may grow it again                                                   \
+ */                                                                     \
+static inline int                                                       \
+_name ## _shrink_to_fit(struct _name **ppp)                             \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t cap = _name ## _cap_for(_name ## _len(pp));     \
+                                                                        \
+        if (cap < PLD_HASH_MAP_INIT_CAP)                                \
+                cap = PLD_HASH_MAP_INIT_CAP;                            \
+        if (cap > pp->p_cap)                                            \
+                cap = pp->p_cap;                                        \
+                                                                        \
+        if (cap == pp->p_cap && pp->p_was == 0 && pp->p_old == NULL)    \
+                return 0;                                               \
+                                                                        \
+        return _name ## _resize(ppp, cap);                              \
+}                                                                       \
+                                                                        \
+/* where a probe of _name{} for a missing key stopped (see _probe()) */ \
+struct _name ## _stop {                                                 \
+        hash_map_size_t st_slot;     /* slot to place key from */       \
+        hash_map_size_t st_was;      /* first WAS slot key may take */  \
+        hash_map_size_t st_len;      /* slots probed */                 \
+        uint8_t         st_disp;     /* displacement at st_slot */      \
+        uint8_t         st_was_disp; /* at st_was, NEVER if none */     \
+        uint8_t         st_cur;      /* metadata of st_slot */          \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Probe _name{} for a key:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:     pointer to _name{}                                         \
+ *  @seeded: seeded hash of key                                         \
+ *  @k:      key                                                        \
+ *  @op:     operation to count the probe as (PLD_HASH_MAP_STATS)       \
+ *  @stp:    where to save where the probe stopped                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot holding key                                          \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND                                    \
+ *                                                                      \
+ * Notes:                                                               \
+ *  on a miss *stp is where _insert_hash() goes on placing the key      \
+ *  from, so an insert probes once. Only PLD_HASH_MAP_OP_SET probes     \
+ *  look for a WAS slot to reuse; SIMD maps do so a group at a time,    \
+ *  and only while the table holds any                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _probe(const struct _name *pp, hash_map_size_t seeded, _k k,   \
+                enum pld_hash_map_op op, struct _name ## _stop *stp)    \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t i = seeded & mask;                              \
+        hash_map_size_t found = PLD_HASH_MAP_NOT_FOUND;                 \
+        hash_map_size_t j = 0;                                          \
+        uint32_t match = 0;                                             \
+        uint32_t stop = 0;                                              \
+        uint32_t was = 0;                                               \
+        uint8_t want = 0;                                               \
+        uint8_t cur = 0;                                                \
+        int limit = PLD_HASH_MAP_PROBE_LIMIT(_flags);                   \
+        int left = 0;                                                   \
+        int disp = 0;                                                   \
+                                                                        \
+        stp->st_was = 0;                                                \
+        stp->st_was_disp = PLD_HASH_MAP_NEVER;                          \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_SIMD) != PLD_HASH_MAP_SIMD)        \
+                goto scalar;                                            \
+                                                                        \
+        /* most keys sit in their home slot, test it before a group */  \
+        cur = _name ## _get_meta(pp, i);                                \
+        if (cur == PLD_HASH_MAP_NEVER)                                  \
+                goto stop;                                              \
+        if (cur == _name ## _meta(0, seeded) &&                         \
+            _cmp(*_name ## _key_at(pp, i), k) == 0) {                   \
+                found = i;                                              \
+                goto stop;                                              \
+        }                                                               \
+                                                                        \
+        for (; disp <= limit; disp += PLD_HASH_MAP_GROUP) {             \
+                want = _name ## _meta((uint8_t)disp, seeded);           \
+                match = pld_hash_map_group_match(&pp->p_meta[i], want,  \
+                                                 &stop);                \
+                if (disp == 0)                                          \
+                        match &= ~(uint32_t)1;                          \
+                                                                        \
+                /* lanes past first stop or the limit are not ours */   \
+                left = limit - disp + 1;                                \
+                if (left < PLD_HASH_MAP_GROUP) {                        \
+                        match &= ((uint32_t)1 << left) - 1;             \
+                        stop &= ((uint32_t)1 << left) - 1;              \
+                }                                                       \
+                if (stop != 0)                                          \
+                        match &= (stop & (~stop + 1)) - 1;              \
+                                                                        \
+                while (match != 0) {                                    \
+                        j = (hash_map_size_t)__builtin_ctz(match);      \
+                        if (_cmp(*_name ## _key_at(pp, (i + j) & mask), \
+                                 k) == 0) {                             \
+                                disp += (int)j;                         \
+                                i = (i + j) & mask;                     \
+                                found = i;                              \
+                                goto stop;                              \
+                        }                                               \
+                        match &= match - 1;                             \
+                }                                                       \
+                                                                        \
+                /* WAS lanes are below NEVER but not below WAS */       \
+                if (op == PLD_HASH_MAP_OP_SET &&                        \
+                    !((_flags) & PLD_HASH_MAP_BACKSHIFT) &&             \
+                    pp->p_was != 0 &&                                   \
+                    stp->st_was_disp == PLD_HASH_MAP_NEVER) {           \
+                        was = pld_hash_map_group_below(&pp->p_meta[i],  \
+                                        PLD_HASH_MAP_NEVER) &           \
+                              ~pld_hash_map_group_below(&pp->p_meta[i], \
+                                        PLD_HASH_MAP_WAS);              \
+                        if (left < PLD_HASH_MAP_GROUP)                  \
+                                was &= ((uint32_t)1 << left) - 1;       \
+                        if (stop != 0)                                  \
+                                was &= (stop & (~stop + 1)) - 1;        \
+                        for (; was != 0; was &= was - 1) {              \
+                                j = (hash_map_size_t)                   \
+                                    __builtin_ctz(was);                 \
+                                if (_name ## _was_disp(pp,              \
+                                                (i + j) & mask) >       \
+                                    (hash_map_size_t)disp + j)          \
+                                        continue;                       \
+                                stp->st_was = (i + j) & mask;           \
+                                stp->st_was_disp = (uint8_t)            \
+                                        ((hash_map_size_t)disp + j);    \
+                                break;                                  \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                if (stop != 0) {                                        \
+                        j = (hash_map_size_t)__builtin_ctz(stop);       \
+                        disp += (int)j;                                 \
+                        i = (i + j) & mask;                             \
+                        cur = _name ## _get_meta(pp, i);                \
+                        goto stop;                                      \
+                }                                                       \
+                                                                        \
+                i = (i + PLD_HASH_MAP_GROUP) & mask;                    \
+        }                                                               \
+                                                                        \
+        disp = limit + 1;                                               \
+        goto stop;                                                      \
+                                                                        \
+scalar:                                                                 \
+        for (;;) {                                                      \
+                cur = _name ## _get_meta(pp, i);                        \
+                                                                        \
+                if (cur == PLD_HASH_MAP_NEVER)                          \
+                        break;                                          \
+                                                                        \
+                if (cur == PLD_HASH_MAP_WAS) {                          \
+                        if (op == PLD_HASH_MAP_OP_SET &&                \
+                            stp->st_was_disp == PLD_HASH_MAP_NEVER &&   \
+                            _name ## _was_disp(pp, i) <= disp) {        \
+                                stp->st_was = i;                        \
+                                stp->st_was_disp = (uint8_t)disp;       \
+                        }                                               \
+                } else if (_name ## _disp(cur) < disp) {                \
+                        break;                                          \
+                } else if (cur == _name ## _meta((uint8_t)disp,         \
+                                                 seeded) &&             \
+                           _cmp(*_name ## _key_at(pp, i), k) == 0) {    \
+                        found = i;                                      \
+                        break;                                          \
+                }                                                       \
+                                                                        \
+                i = (i + 1) & mask;                                     \
+                disp++;                                                 \
+                if (unlikely(disp > limit))                             \
+                        break;                                          \
+        }                                                               \
+                                                                        \
+stop:                                                                   \
+        stp->st_slot = i;                                               \
+        stp->st_disp = (uint8_t)disp;                                   \
+        stp->st_cur = cur;                                              \
+        stp->st_len = (hash_map_size_t)(disp > limit ? disp :           \
+                                        disp + 1);                      \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_STATS)                              \
+                pld_hash_map_count(pp->p_stats, op, stp->st_len);       \
+                                                                        \
+        return found;                                                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find slot of key in _name{}:                                         \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *  @op:   operation to count the probe as (PLD_HASH_MAP_STATS)         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot holding key                                          \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND                                    \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find(const struct _name *pp, hash_map_size_t hash, _k k,      \
+               enum pld_hash_map_op op)                                 \
+{                                                                       \
+        struct _name ## _stop st;                                       \
+                                                                        \
+        hash = _name ## _seed_hash(pp, hash);                           \
+        return _name ## _probe(pp, hash, k, op, &st);                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find slot of key in the tables _name{} is migrating from:            \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *  @tpp:  where to save pointer to the table holding key               \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot of *tpp holding key                                  \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND                                    \
+ *                                                                      \
+ * Notes:                                                               \
+ *  slots of a p_old before the p_mig of the table above it were        \
+ *  already moved, a key found there is stale                           \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find_old(const struct _name *pp, hash_map_size_t hash, _k k,  \
+                   struct _name **tpp)                                  \
+{                                                                       \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (!((_flags) & PLD_HASH_MAP_INCREMENTAL))                     \
+                return PLD_HASH_MAP_NOT_FOUND;                          \
+                                                                        \
+        for (; pp->p_old != NULL; pp = pp->p_old) {                     \
+                if (pp->p_old->p_len == 0)                              \
+                        continue;                                       \
+                i = _name ## _find(pp->p_old, hash, k,                  \
+                                   PLD_HASH_MAP_NOP);                   \
+                if (i != PLD_HASH_MAP_NOT_FOUND && i >= pp->p_mig) {    \
+                        *tpp = pp->p_old;                               \
+                        return i;                                       \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        return PLD_HASH_MAP_NOT_FOUND;                                  \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Drop a not yet migrated entry of _name{}:                            \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @tp: pointer to _name{} returned by _find_old()                     \
+ *  @i:  slot of tp returned by _find_old()                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _drop_old(struct _name *tp, hash_map_size_t i)                 \
+{                                                                       \
+        _name ## _put_meta(tp, i, PLD_HASH_MAP_WAS);                    \
+        tp->p_len--;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Count entries of _name{} with the same hash as a key:                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:     pointer to _name{}                                         \
+ *  @seeded: seeded hash of key                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of them a probe from the key's home slot can reach \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  such entries share the key's home slot at any capacity and under    \
+ *  any seed, so once more than PLD_HASH_MAP_PROBE_LIMIT() of them fill \
+ *  the probe, no grow or reseed makes room for the key                 \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _twins(const struct _name *pp, hash_map_size_t seeded)         \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t i = seeded & mask;                              \
+        hash_map_size_t n = 0;                                          \
+        unsigned int limit = PLD_HASH_MAP_PROBE_LIMIT(_flags);          \
+        unsigned int disp = 0;                                          \
+                                                                        \
+        for (disp = 0; disp <= limit; disp++) {                         \
+                if (_name ## _get_meta(pp, i) == PLD_HASH_MAP_NEVER)    \
+                        break;                                          \
+                if (_name ## _get_meta(pp, i) != PLD_HASH_MAP_WAS &&    \
+                    _name ## _hash_of(pp, i) == seeded)                 \
+                        n++;                                            \
+                i = (i + 1) & mask;                                     \
+        }                                                               \
+                                                                        \
+        return n;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find map[k] in _name{}, inserting k with v if missing, in one probe: \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @hash:     hash of key                                              \
+ *  @k:        key                                                      \
+ *  @v:        value to insert with k if k is not in map                \
+ *  @inserted: where to save true if k was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of k, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  an insert that overflows is relieved once (see _relieve()); if it   \
+ *  still overflows, a table grown for it is shrunk back before the     \
+ *  insert fails with EOVERFLOW. An incremental map leaves the grown    \
+ *  table be, and one still migrating takes another step for load       \
+ *  rather than start a table; the load check runs once per insert, so  \
+ *  an insert never walks more than two steps and one new table         \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _insert_hash(struct _name **ppp, hash_map_size_t hash, _k k,   \
+                      _v v, bool *inserted)                             \
+{                                                                       \
+        struct _name ## _stop st;                                       \
+        struct _name *pp = *ppp;                                        \
+        struct _name *tp = NULL;                                        \
+        hash_map_size_t cap = 0;                                        \
+        hash_map_size_t i = 0;                                          \
+        hash_map_size_t old = 0;                                        \
+        hash_map_size_t seeded = 0;                                     \
+        uint8_t disp = 0;                                               \
+        bool relieved = false;                                          \
+        bool grew = false;                                              \
+        int ret = 0;                                                    \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_INCREMENTAL) && pp->p_old) {       \
+                if (_name ## _migrate(ppp, PLD_HASH_MAP_MIGRATE) < 0)   \
+                        return NULL;                                    \
+                pp = *ppp;                                              \
+        }                                                               \
+        cap = pp->p_cap;                                                \
+                                                                        \
+retry:                                                                  \
+        /* probes retried after a grow are counted again */             \
+        seeded = _name ## _seed_hash(pp, hash);                         \
+        i = _name ## _probe(pp, seeded, k, PLD_HASH_MAP_OP_SET, &st);   \
+        if (i != PLD_HASH_MAP_NOT_FOUND) {                              \
+                *inserted = false;                                      \
+                return _name ## _val_at(pp, i);                         \
+        }                                                               \
+                                                                        \
+        /* grow only once a hit is ruled out, then probe again */       \
+        if (unlikely(!grew && _name ## _need_to_grow(pp))) {            \
+                if ((_flags) & PLD_HASH_MAP_NOGROW) {                   \
+                        errno = EOVERFLOW;                              \
+                        return NULL;                                    \
+                }                                                       \
+                grew = true;                                            \
+                if (((_flags) & PLD_HASH_MAP_INCREMENTAL) && pp->p_old) \
+                        ret = _name ## _migrate(ppp, PLD_HASH_MAP_MIGRATE); \
+                else if ((_flags) & PLD_HASH_MAP_INCREMENTAL)           \
+                        ret = _name ## _start_resize(ppp,               \
+                                        !_name ## _mostly_was(pp), false); \
+                else if (_name ## _mostly_was(pp) &&                    \
+                         _name ## _resize(ppp, pp->p_cap) == 0)         \
+                        ret = 0;                                        \
+                else                                                    \
+                        ret = _name ## _grow(ppp);                      \
+                if (ret < 0)                                            \
+                        return NULL;                                    \
+                pp = *ppp;                                              \
+                cap = pp->p_cap;                                        \
+                goto retry;                                             \
+        }                                                               \
+                                                                        \
+        /* key may still be waiting in the table we migrate from */     \
+        old = _name ## _find_old(pp, hash, k, &tp);                     \
+                                                                        \
+        /* key is not in map, reuse first WAS slot we could take */     \
+        i = st.st_slot;                                                 \
+        disp = st.st_disp;                                              \
+        if (st.st_was_disp != PLD_HASH_MAP_NEVER) {                     \
+                i = st.st_was;                                          \
+                disp = st.st_was_disp;                                  \
+        } else if (unlikely(disp > PLD_HASH_MAP_PROBE_LIMIT(_flags) ||  \
+                            (st.st_cur != PLD_HASH_MAP_NEVER &&         \
+                             !_name ## _fits(pp, i, disp)))) {          \
+                /* keys that collide in full overflow any table */      \
+                if (!relieved && !((_flags) & PLD_HASH_MAP_NOGROW) &&   \
+                    _name ## _twins(pp, seeded) <=                      \
+                    PLD_HASH_MAP_PROBE_LIMIT(_flags)) {                 \
+                        relieved = true;                                \
+                        if (_name ## _relieve(ppp) < 0)                 \
+                                return NULL;                            \
+                        pp = *ppp;                                      \
+                        goto retry;                                     \
+                }                                                       \
+                if (!((_flags) & PLD_HASH_MAP_INCREMENTAL) &&           \
+                    pp->p_cap != cap)                                   \
+                        (void)_name ## _resize(ppp, cap);               \
+                errno = EOVERFLOW;                                      \
+                return NULL;                                            \
+        }                                                               \
+                                                                        \
+        /* a key still in the old table moves over with its value */    \
+        *inserted = old == PLD_HASH_MAP_NOT_FOUND;                      \
+        if (!*inserted) {                                               \
+                v = *_name ## _val_at(tp, old);                         \
+                _name ## _drop_old(tp, old);                            \
+        }                                                               \
+                                                                        \
+        /* entry lands in slot i, place() swaps later ones along */     \
+        (void)_name ## _place(pp, i, disp, seeded, k, v);               \
+        pp->p_len++;                                                    \
+        return _name ## _val_at(pp, i);                                 \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] to v _name{} with hash already computed:                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:  pointer to pointer to _name{}                                \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *  @v:    value                                                        \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set_hash(struct _name **ppp, hash_map_size_t hash, _k k,      \
+                   _v v)                                                \
+{                                                                       \
+        bool inserted = false;                                          \
+        _v *vp = _name ## _insert_hash(ppp, hash, k, v, &inserted);     \
+                                                                        \
+        if (vp == NULL)                                                 \
+                return -1;                                              \
+                                                                        \
+        if (!inserted)                                                  \
+                *vp = v;                                                \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] to v _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, EOVERFLOW when k would sit more than    \
+ *            PLD_HASH_MAP_PROBE_LIMIT() slots past its home even after \
+ *            a grow or reseed, as when more than PLD_HASH_MAP_PROBE_MAX \
+ *            keys of a seeded map share their full hash, or more than  \
+ *            PLD_HASH_MAP_MAX_DISP() keys of another share a home slot \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, _k k, _v v)                           \
+{                                                                       \
+        return _name ## _set_hash(ppp, _hash(k), k, v);                 \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}, inserting a zeroed value if missing:        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @k:        key                                                      \
+ *  @inserted: where to save true if k was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of k, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  hashes and probes once where _get() then _set() does so twice: a    \
+ *  hit takes the probe of _get(), on SIMD maps the group compare, and  \
+ *  a miss places k from the slot that probe stopped at                 \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get_or_insert(struct _name **ppp, _k k, bool *inserted)       \
+{                                                                       \
+        _v v;                                                           \
+                                                                        \
+        memset(&v, 0, sizeof(v));                                       \
+        return _name ## _insert_hash(ppp, _hash(k), k, v, inserted);    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Merge into map[k] of _name{} with a callback:                        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @fn:  called with pointer to _v{} of k (zeroed if k was inserted),  \
+ *        whether k was inserted, and ctx                               \
+ *  @ctx: passed through to fn                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _update(struct _name **ppp, _k k,                              \
+                 void (*fn)(_v *, bool, void *), void *ctx)             \
+{                                                                       \
+        bool inserted = false;                                          \
+        _v *vp = _name ## _get_or_insert(ppp, k, &inserted);            \
+                                                                        \
+        if (vp == NULL)                                                 \
+                return -1;                                              \
+                                                                        \
+        fn(vp, inserted, ctx);                                          \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{} with hash already computed:                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get_hash(const struct _name *pp, hash_map_size_t hash, _k k)  \
+{                                                                       \
+        hash_map_size_t i = _name ## _find(pp, hash, k,                 \
+                                           PLD_HASH_MAP_OP_GET);        \
+        struct _name *tp = NULL;                                        \
+                                                                        \
+        if (i != PLD_HASH_MAP_NOT_FOUND)                                \
+                return _name ## _val_at(pp, i);                         \
+                                                                        \
+        i = _name ## _find_old(pp, hash, k, &tp);                       \
+        if (i != PLD_HASH_MAP_NOT_FOUND)                                \
+                return _name ## _val_at(tp, i);                         \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to pointer to _name{}                                  \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, _k k)                             \
+{                                                                       \
+        return _name ## _get_hash(pp, _hash(k), k);                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Test if need to shrink:                                              \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if needed                                                   \
+ *  @false: if not                                                      \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _need_to_shrink(const struct _name *pp)                        \
+{                                                                       \
+        hash_map_size_t len = _name ## _len(pp);                        \
+        hash_map_size_t cap = pp->p_cap;                                \
+                                                                        \
+        /* halving lands below PLD_HASH_MAP_GROW_AT(), see _LOAD() */   \
+        return (len << 4) < cap * PLD_HASH_MAP_SHRINK_AT(_flags) &&     \
+               cap > PLD_HASH_MAP_INIT_CAP;                             \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Remove entry in slot i from _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @i:  occupied slot                                                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _remove(struct _name *pp, hash_map_size_t i)                   \
+{                                                                       \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t j = (i + 1) & mask;                             \
+        uint8_t meta = 0;                                               \
+                                                                        \
+        pp->p_len--;                                                    \
+                                                                        \
+        if (!((_flags) & PLD_HASH_MAP_BACKSHIFT)) {                     \
+                _name ## _put_meta(pp, i, PLD_HASH_MAP_WAS);            \
+                pp->p_was++;                                            \
+                return;                                                 \
+        }                                                               \
+                                                                        \
+        /* pull each displaced successor one slot closer to home */     \
+        for (;;) {                                                      \
+                meta = _name ## _get_meta(pp, j);                       \
+                if (meta == PLD_HASH_MAP_NEVER ||                       \
+                    _name ## _disp(meta) == 0)                          \
+                        break;                                          \
+                                                                        \
+                _name ## _copy(pp, i, j);                               \
+                meta = (uint8_t)(meta - _name ## _meta(1, 0));          \
+                _name ## _put_meta(pp, i, meta);                        \
+                                                                        \
+                i = j;                                                  \
+                j = (j + 1) & mask;                                     \
+        }                                                               \
+                                                                        \
+        _name ## _put_meta(pp, i, PLD_HASH_MAP_NEVER);                  \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, _k k)                               \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        struct _name *tp = NULL;                                        \
+        hash_map_size_t hash = _hash(k);                                \
+        hash_map_size_t i = 0;                                          \
+        int ret = 0;                                                    \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_INCREMENTAL) && pp->p_old) {       \
+                if (_name ## _migrate(ppp, PLD_HASH_MAP_MIGRATE) < 0)   \
+                        return -1;                                      \
+                pp = *ppp;                                              \
+        }                                                               \
+                                                                        \
+        /*                                                              \
+         * a shrink that would overflow displacement is skipped, and an \
+         * incremental one waits for the last resize to drain           \
+         */                                                             \
+        if (unlikely(_name ## _need_to_shrink(pp)) &&                   \
+            !(((_flags) & PLD_HASH_MAP_INCREMENTAL) && pp->p_old)) {    \
+                if ((_flags) & PLD_HASH_MAP_INCREMENTAL)                \
+                        ret = _name ## _start_resize(ppp, -1, false);   \
+                else                                                    \
+                        ret = _name ## _resize(ppp, pp->p_cap >> 1);    \
+                if (ret < 0 && errno != EOVERFLOW)                      \
+                        return -1;                                      \
+                pp = *ppp;                                              \
+        }                                                               \
+                                                                        \
+        i = _name ## _find(pp, hash, k, PLD_HASH_MAP_OP_UNSET);         \
+        if (i != PLD_HASH_MAP_NOT_FOUND) {                              \
+                _name ## _remove(pp, i);                                \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        i = _name ## _find_old(pp, hash, k, &tp);                       \
+        if (i != PLD_HASH_MAP_NOT_FOUND)                                \
+                _name ## _drop_old(tp, i);                              \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/* position of a walk over the entries of _name{} (see _iter_next()) */ \
+struct _name ## _iter {                                                 \
+        struct _name   *it_map;  /* table walked */                     \
+        struct _name   *it_tbl;  /* it_map or one it migrates from */   \
+        hash_map_size_t it_slot; /* next slot of it_tbl to look at */   \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Find next slot of _name{} whose metadata is below a limit:           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:    pointer to _name{}                                          \
+ *  @i:     first slot to look at                                       \
+ *  @limit: PLD_HASH_MAP_WAS for occupied slots, PLD_HASH_MAP_NEVER for \
+ *          occupied and WAS slots                                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot at or after i, or p_cap if there is none             \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _scan(const struct _name *pp, hash_map_size_t i,               \
+               uint8_t limit)                                           \
+{                                                                       \
+        hash_map_size_t group = 0;                                      \
+        uint32_t below = 0;                                             \
+                                                                        \
+        /* whole groups only, p_meta may have no room past the end */   \
+        if (pp->p_cap < PLD_HASH_MAP_GROUP) {                           \
+                while (i < pp->p_cap &&                                 \
+                       _name ## _get_meta(pp, i) >= limit)              \
+                        i++;                                            \
+                return i;                                               \
+        }                                                               \
+                                                                        \
+        while (i < pp->p_cap) {                                         \
+                group = i & ~(hash_map_size_t)(PLD_HASH_MAP_GROUP - 1); \
+                below = pld_hash_map_group_below(&pp->p_meta[group],    \
+                                                 limit);                \
+                below >>= i - group;                                    \
+                if (below != 0) {                                       \
+                        i += (hash_map_size_t)__builtin_ctz(below);     \
+                        return i;                                       \
+                }                                                       \
+                i = group + PLD_HASH_MAP_GROUP;                         \
+        }                                                               \
+                                                                        \
+        return pp->p_cap;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Start a walk over the entries of _name{}:                            \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @it: pointer to _name_iter{} to set up                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  any change to the map but writing through a value pointer ends the  \
+ *  walk; _erase_if() removes entries while walking                     \
+ */                                                                     \
+static inline void                                                      \
+_name ## _iter_init(struct _name *pp, struct _name ## _iter *it)        \
+{                                                                       \
+        it->it_map = pp;                                                \
+        it->it_tbl = pp;                                                \
+        it->it_slot = 0;                                                \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get next entry of a walk over _name{}:                               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @it: pointer to _name_iter{}                                        \
+ *  @k:  where to save key                                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of the entry                              \
+ *  @failure: NULL once every entry was returned                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  entries come in slot order, then those of each p_old not yet        \
+ *  migrated                                                            \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _iter_next(struct _name ## _iter *it, _k *k)                   \
+{                                                                       \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        for (;;) {                                                      \
+                i = _name ## _scan(it->it_tbl, it->it_slot,             \
+                                   PLD_HASH_MAP_WAS);                   \
+                if (i < it->it_tbl->p_cap)                              \
+                        break;                                          \
+                                                                        \
+                if (it->it_tbl->p_old == NULL)                          \
+                        return NULL;                                    \
+                                                                        \
+                it->it_slot = it->it_tbl->p_mig;                        \
+                it->it_tbl = it->it_tbl->p_old;                         \
+        }                                                               \
+                                                                        \
+        it->it_slot = i + 1;                                            \
+        *k = *_name ## _key_at(it->it_tbl, i);                          \
+        return _name ## _val_at(it->it_tbl, i);                         \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Call back on every entry of _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @fn:  called with key, pointer to value and ctx; may change the     \
+ *        value but not the map                                         \
+ *  @ctx: passed through to fn                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _foreach(struct _name *pp, void (*fn)(_k, _v *, void *),       \
+                  void *ctx)                                            \
+{                                                                       \
+        struct _name ## _iter it;                                       \
+        _v *v = NULL;                                                   \
+        _k k;                                                           \
+                                                                        \
+        _name ## _iter_init(pp, &it);                                   \
+        while ((v = _name ## _iter_next(&it, &k)) != NULL)              \
+                fn(k, v, ctx);                                          \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Remove entries of _name{} a predicate holds for:                     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:  pointer to pointer to _name{}                                \
+ *  @pred: called with key, pointer to value and ctx, true to remove    \
+ *         the entry; may change the value but not the map              \
+ *  @ctx:  passed through to pred                                       \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries removed                                 \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND and errno set, nothing removed     \
+ *                                                                      \
+ * Notes:                                                               \
+ *  one pass over the table, starting after a NEVER slot no probe       \
+ *  crosses: removed entries and WAS slots leave a gap that each kept   \
+ *  entry behind them is pulled back into as far as its displacement    \
+ *  allows, so the table ends up without WAS slots as if every removal  \
+ *  had shifted back; runs of empty slots are skipped a group at a      \
+ *  time. Shrinks at most once, straight to a capacity the entries left \
+ *  fill half of PLD_HASH_MAP_GROW_AT() at most, and a shrink that      \
+ *  fails leaves the map larger but whole.                              \
+ *  An incremental resize is finished first                             \
  */                                                                     \
-static inline struct _name *                                            \
-_name ## _new(hash_map_size_t cap)                                      \
+static inline hash_map_size_t                                           \
+_name ## _erase_if(struct _name **ppp, bool (*pred)(_k, _v *, void *),  \
+                   void *ctx)                                           \
 {                                                                       \
-        struct _name *pp = malloc(sizeof(*pp));                         \
-        size_t msize = 0;                                               \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t removed = 0;                                    \
+        hash_map_size_t mask = 0;                                       \
+        hash_map_size_t cap = 0;                                        \
+        hash_map_size_t gap = 0;                                        \
+        hash_map_size_t n = 0;                                          \
+        hash_map_size_t s = 0;                                          \
+        hash_map_size_t i = 0;                                          \
+        hash_map_size_t j = 0;                                          \
+        uint8_t shift = 0;                                              \
+        uint8_t meta = 0;                                               \
                                                                         \
-        if (pp == NULL)                                                 \
-                goto ret;                                               \
+        if (pp->p_old != NULL &&                                        \
+            _name ## _migrate(ppp, PLD_HASH_MAP_NOT_FOUND) < 0)         \
+                return PLD_HASH_MAP_NOT_FOUND;                          \
+        pp = *ppp;                                                      \
+        mask = pp->p_cap - 1;                                           \
                                                                         \
-        if (cap == 0)                                                   \
-                cap = PLD_HASH_MAP_INIT_CAP;                            \
+        /* the load factor leaves NEVER slots */                        \
+        while (_name ## _get_meta(pp, s) != PLD_HASH_MAP_NEVER)         \
+                s++;                                                    \
                                                                         \
-        cap = next_pow2(cap);                                           \
+        for (n = 0; n < pp->p_cap;) {                                   \
+                i = (s + 1 + n) & mask;                                 \
                                                                         \
-        msize = sizeof(*pp->p_meta) * cap;                              \
-        pp->p_meta = malloc(msize);                                     \
-        if (pp->p_meta == NULL)                                         \
-                goto free_pp;                                           \
-        memset(pp->p_meta, PLD_HASH_MAP_NEVER, msize);                  \
+                /* nothing to pull back, skip to the next used slot */  \
+                if (gap == 0) {                                         \
+                        j = _name ## _scan(pp, i, PLD_HASH_MAP_NEVER);  \
+                        n += j - i;                                     \
+                        if (j == pp->p_cap || n >= pp->p_cap)           \
+                                continue;                               \
+                        i = j;                                          \
+                }                                                       \
+                n++;                                                    \
                                                                         \
-        pp->p_hash = malloc(sizeof(*pp->p_hash) * cap);                 \
-        if (pp->p_hash == NULL)                                         \
-                goto free_meta;                                         \
+                meta = _name ## _get_meta(pp, i);                       \
+                if (meta == PLD_HASH_MAP_NEVER) {                       \
+                        gap = 0;                                        \
+                        continue;                                       \
+                }                                                       \
                                                                         \
-        pp->p_key = malloc(sizeof(_k) * cap);                           \
-        if (pp->p_key == NULL)                                          \
-                goto free_hash;                                         \
+                if (meta == PLD_HASH_MAP_WAS ||                         \
+                    pred(*_name ## _key_at(pp, i),                      \
+                         _name ## _val_at(pp, i), ctx)) {               \
+                        if (meta != PLD_HASH_MAP_WAS) {                 \
+                                pp->p_len--;                            \
+                                removed++;                              \
+                        }                                               \
+                        _name ## _put_meta(pp, i, PLD_HASH_MAP_NEVER);  \
+                        gap++;                                          \
+                        continue;                                       \
+                }                                                       \
                                                                         \
-        pp->p_val = malloc(sizeof(_v) * cap);                           \
-        if (pp->p_val == NULL)                                          \
-                goto free_key;                                          \
+                shift = _name ## _disp(meta);                           \
+                if (gap < shift)                                        \
+                        shift = (uint8_t)gap;                           \
+                if (shift > 0) {                                        \
+                        j = (i - shift) & mask;                         \
+                        _name ## _copy(pp, j, i);                       \
+                        meta = (uint8_t)(meta -                         \
+                                         _name ## _meta(shift, 0));     \
+                        _name ## _put_meta(pp, j, meta);                \
+                        _name ## _put_meta(pp, i, PLD_HASH_MAP_NEVER);  \
+                }                                                       \
                                                                         \
-        pp->p_cap = cap;                                                \
-        pp->p_len = 0;                                                  \
+                /* holes before j stay empty, entries keep order */     \
+                gap = shift;                                            \
+        }                                                               \
         pp->p_was = 0;                                                  \
-        goto ret;                                                       \
-                                                                        \
-free_key:                                                               \
-        free(pp->p_key);                                                \
-        pp->p_key = NULL;                                               \
                                                                         \
-free_hash:                                                              \
-        free(pp->p_hash);                                               \
-        pp->p_hash = NULL;                                              \
-                                                                        \
-free_meta:                                                              \
-        free(pp->p_meta);                                               \
-        pp->p_meta = NULL;                                              \
+        /* half what _need_to_grow() allows, as a grow would leave */   \
+        cap = _name ## _cap_for(_name ## _len(pp) << 1);                \
+        if (cap < PLD_HASH_MAP_INIT_CAP)                                \
+                cap = PLD_HASH_MAP_INIT_CAP;                            \
                                                                         \
-free_pp:                                                                \
-        free(pp);                                                       \
-        pp = NULL;                                                      \
+        /* the entries are gone either way, a failed shrink is kept */  \
+        if (_name ## _need_to_shrink(pp) && cap < pp->p_cap)            \
+                (void)_name ## _resize(ppp, cap);                       \
                                                                         \
-ret:                                                                    \
-        return pp;                                                      \
+        return removed;                                                 \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Free a _name{}:                                                      \
+ * Prefetch home slot of a hash in _name{}:                             \
  *                                                                      \
  * Arguments:                                                           \
- *  @ppp: pointer to pointer to _name{}                                 \
+ *  @pp:    pointer to _name{}                                          \
+ *  @hash:  hash of key                                                 \
+ *  @write: true if slot is about to be written                         \
  *                                                                      \
  * Returns:                                                             \
- *  @success: *ppp set to NULL                                          \
+ *  @success: does not                                                  \
  *  @failure: does not                                                  \
  */                                                                     \
-static inline void                                                      \
-_name ## _free(struct _name **ppp)                                      \
+static force_inline void                                                \
+_name ## _prefetch(const struct _name *pp, hash_map_size_t hash,        \
+                   bool write)                                          \
 {                                                                       \
-        struct _name *pp = *ppp;                                        \
+        hash_map_size_t i = _name ## _seed_hash(pp, hash) &             \
+                            (pp->p_cap - 1);                            \
                                                                         \
-        free(pp->p_val);                                                \
-        pp->p_val = NULL;                                               \
+        /* values are left to the probe, they are only read on a hit */ \
+        if (write) {                                                    \
+                __builtin_prefetch(&pp->p_meta[i], 1);                  \
+                __builtin_prefetch(_name ## _key_at(pp, i), 1);         \
+                if (pp->p_hash != NULL)                                 \
+                        __builtin_prefetch(&pp->p_hash[i], 1);          \
+        } else {                                                        \
+                __builtin_prefetch(&pp->p_meta[i]);                     \
+                __builtin_prefetch(_name ## _key_at(pp, i));            \
+        }                                                               \
+}                                                                       \
                                                                         \
-        free(pp->p_key);                                                \
-        pp->p_key = NULL;                                               \
+/**                                                                     \
+ * Get map[keys[i]] from _name{} for a batch of keys:                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @keys: keys                                                         \
+ *  @vals: where to save pointer to _v{} (or NULL) for each key         \
+ *  @n:    number of keys                                               \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of keys found                                      \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  each key is hashed and its home slot prefetched PLD_HASH_MAP_BATCH  \
+ *  keys before it is probed, so that many cache misses overlap         \
+ */                                                                     \
+static inline size_t                                                    \
+_name ## _get_batch(const struct _name *pp, const _k *keys, _v **vals,  \
+                    size_t n)                                           \
+{                                                                       \
+        hash_map_size_t hash[PLD_HASH_MAP_BATCH];                       \
+        hash_map_size_t cur = 0;                                        \
+        size_t found = 0;                                               \
+        size_t i = 0;                                                   \
                                                                         \
-        free(pp->p_hash);                                               \
-        pp->p_hash = NULL;                                              \
+        for (i = 0; i < n && i < PLD_HASH_MAP_BATCH; i++) {             \
+                hash[i] = _hash(keys[i]);                               \
+                _name ## _prefetch(pp, hash[i], false);                 \
+        }                                                               \
                                                                         \
-        free(pp->p_meta);                                               \
-        pp->p_meta = NULL;                                              \
+        for (i = 0; i < n; i++) {                                       \
+                cur = hash[i % PLD_HASH_MAP_BATCH];                     \
+                if (i + PLD_HASH_MAP_BATCH < n) {                       \
+                        hash[i % PLD_HASH_MAP_BATCH] =                  \
+                                _hash(keys[i + PLD_HASH_MAP_BATCH]);    \
+                        _name ## _prefetch(pp,                          \
+                                hash[i % PLD_HASH_MAP_BATCH], false);   \
+                }                                                       \
                                                                         \
-        free(pp);                                                       \
-        pp = NULL;                                                      \
+                vals[i] = _name ## _get_hash(pp, cur, keys[i]);         \
+                found += vals[i] != NULL;                               \
+        }                                                               \
                                                                         \
-        *ppp = NULL;                                                    \
+        return found;                                                   \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Resize _name{}:                                                      \
+ * Set map[keys[i]] to vals[i] in _name{} for a batch of keys:          \
  *                                                                      \
  * Arguments:                                                           \
- *  @ppp: pointer to pointer to _name{}                                 \
- *  @cap: new capacity                                                  \
+ *  @ppp:  pointer to pointer to _name{}                                \
+ *  @keys: keys                                                         \
+ *  @vals: values                                                       \
+ *  @n:    number of keys                                               \
  *                                                                      \
  * Returns:                                                             \
  *  @success: 0                                                         \
- *  @failure: -1 and errno set                                          \
+ *  @failure: -1 and errno set, keys before the failing one are set     \
+ *                                                                      \
+ * Notes:                                                               \
+ *  prefetches like _get_batch(), a table resized mid-batch only loses  \
+ *  the benefit of the prefetches already issued                        \
  */                                                                     \
 static inline int                                                       \
-_name ## _resize(struct _name **ppp, hash_map_size_t cap)               \
+_name ## _set_batch(struct _name **ppp, const _k *keys, const _v *vals, \
+                    size_t n)                                           \
 {                                                                       \
-        struct _name *newpp = _name ## _new(cap);                       \
-        struct _name *pp = *ppp;                                        \
-        hash_map_size_t moved = 0;                                      \
-        hash_map_size_t mask = 0;                                       \
-        hash_map_size_t j = 0;                                          \
-        hash_map_size_t i = 0;                                          \
-        hash_map_size_t tmp_hash = 0;                                   \
-        hash_map_size_t hash = 0;                                       \
-        uint8_t tmp_disp = 0;                                           \
-        uint8_t disp = 0;                                               \
-        _k tmp_k;                                                       \
-        _k k;                                                           \
-        _v tmp_v;                                                       \
-        _v v;                                                           \
-                                                                        \
-        if (newpp == NULL)                                              \
-                return -1;                                              \
-                                                                        \
-        newpp->p_len = pp->p_len;                                       \
-        newpp->p_was = 0;                                               \
-        mask = newpp->p_cap - 1;                                        \
+        hash_map_size_t hash[PLD_HASH_MAP_BATCH];                       \
+        hash_map_size_t cur = 0;                                        \
+        size_t i = 0;                                                   \
                                                                         \
-        for (i = 0; moved < pp->p_len; i++) {                           \
-                if (pp->p_meta[i] >= PLD_HASH_MAP_WAS)                  \
-                        continue;                                       \
+        for (i = 0; i < n && i < PLD_HASH_MAP_BATCH; i++) {             \
+                hash[i] = _hash(keys[i]);                               \
+                _name ## _prefetch(*ppp, hash[i], true);                \
+        }                                                               \
                                                                         \
-                k = pp->p_key[i];                                       \
-                v = pp->p_val[i];                                       \
-                hash = pp->p_hash[i];                                   \
-                disp = 0;                                               \
-                j = hash & mask;                                        \
-                while (newpp->p_meta[j] != PLD_HASH_MAP_NEVER) {        \
-                        if (newpp->p_meta[j] < disp) {                  \
-                                tmp_k = newpp->p_key[j];                \
-                                tmp_v = newpp->p_val[j];                \
-                                tmp_disp = newpp->p_meta[j];            \
-                                tmp_hash = newpp->p_hash[j];            \
-                                                                        \
-                                newpp->p_key[j] = k;                    \
-                                newpp->p_val[j] = v;                    \
-                                newpp->p_meta[j] = disp;                \
-                                newpp->p_hash[j] = hash;                \
-                                                                        \
-                                k = tmp_k;                              \
-                                v = tmp_v;                              \
-                                hash = tmp_hash;                        \
-                                disp = tmp_disp;                        \
-                        }                                               \
-                        j = (j + 1) & mask;                             \
-                        disp++;                                         \
-                        if (unlikely(disp >= PLD_HASH_MAP_WAS)) {       \
-                                puts("here"); \
-                                _name ## _free(&newpp);                 \
-                                return -1;                              \
-                        }                                               \
+        for (i = 0; i < n; i++) {                                       \
+                cur = hash[i % PLD_HASH_MAP_BATCH];                     \
+                if (i + PLD_HASH_MAP_BATCH < n) {                       \
+                        hash[i % PLD_HASH_MAP_BATCH] =                  \
+                                _hash(keys[i + PLD_HASH_MAP_BATCH]);    \
+                        _name ## _prefetch(*ppp,                        \
+                                hash[i % PLD_HASH_MAP_BATCH], true);    \
                 }                                                       \
                                                                         \
-                newpp->p_hash[j] = hash;                                \
-                newpp->p_key[j] = k;                                    \
-                newpp->p_val[j] = v;                                    \
-                newpp->p_meta[j] = disp;                                \
-                moved++;                                                \
+                if (_name ## _set_hash(ppp, cur, keys[i], vals[i]) < 0) \
+                        return -1;                                      \
         }                                                               \
                                                                         \
-        _name ## _free(ppp);                                            \
-        *ppp = newpp;                                                   \
         return 0;                                                       \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Test if rehash need to grow:                                         \
+ * Sort entries of _name{} by the low bits of their home slot:          \
  *                                                                      \
  * Arguments:                                                           \
- *  @pp: pointer to _name{}                                             \
+ *  @pp:   pointer to _name{} the entries go to                         \
+ *  @ent:  entries                                                      \
+ *  @tmp:  scratch space for n entries                                  \
+ *  @n:    number of entries                                            \
+ *  @bits: low home slot bits to sort by                                \
  *                                                                      \
  * Returns:                                                             \
- *  @true:  if needed                                                   \
- *  @false: if not                                                      \
+ *  @success: ent or tmp, whichever holds the sorted entries            \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  PLD_HASH_MAP_RADIX_BITS bits a pass, lowest first; each pass is     \
+ *  stable, so entries with one home slot keep their order              \
  */                                                                     \
-static inline bool                                                      \
-_name ## _need_to_grow(const struct _name *pp)                          \
+static inline struct _name ## _ent *                                    \
+_name ## _sort_low(const struct _name *pp, struct _name ## _ent *ent,   \
+                   struct _name ## _ent *tmp, size_t n, unsigned int bits) \
 {                                                                       \
-        hash_map_size_t len = pp->p_len;                                \
-        hash_map_size_t cap = pp->p_cap;                                \
-        hash_map_size_t was = pp->p_was;                                \
+        struct _name ## _ent *swap = NULL;                              \
+        size_t count[1 << PLD_HASH_MAP_RADIX_BITS];                     \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        size_t radix = 0;                                               \
+        size_t digit = 0;                                               \
+        size_t sum = 0;                                                 \
+        size_t c = 0;                                                   \
+        size_t i = 0;                                                   \
+        unsigned int shift = 0;                                         \
+        unsigned int step = 0;                                          \
+                                                                        \
+        for (shift = 0; shift < bits; shift += step) {                  \
+                step = bits - shift;                                    \
+                if (step > PLD_HASH_MAP_RADIX_BITS)                     \
+                        step = PLD_HASH_MAP_RADIX_BITS;                 \
+                radix = (size_t)1 << step;                              \
+                                                                        \
+                memset(count, 0, sizeof(*count) * radix);               \
+                for (i = 0; i < n; i++) {                               \
+                        digit = (size_t)(ent[i].e_hash & mask) >> shift;\
+                        count[digit & (radix - 1)]++;                   \
+                }                                                       \
+                                                                        \
+                sum = 0;                                                \
+                for (i = 0; i < radix; i++) {                           \
+                        c = count[i];                                   \
+                        count[i] = sum;                                 \
+                        sum += c;                                       \
+                }                                                       \
+                                                                        \
+                for (i = 0; i < n; i++) {                               \
+                        digit = (size_t)(ent[i].e_hash & mask) >> shift;\
+                        tmp[count[digit & (radix - 1)]++] = ent[i];     \
+                }                                                       \
+                                                                        \
+                swap = ent;                                             \
+                ent = tmp;                                              \
+                tmp = swap;                                             \
+        }                                                               \
                                                                         \
-        return ((len + was) << 4) > (cap * PLD_HASH_MAP_LOAD_FACTOR);   \
+        return ent;                                                     \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Set map[k] to v _name{}:                                             \
+ * Create a new _name{} holding map[keys[i]] = vals[i]:                 \
  *                                                                      \
  * Arguments:                                                           \
- *  @ppp: pointer to pointer to _name{}                                 \
- *  @k:   key                                                           \
- *  @v:   value                                                         \
+ *  @keys: keys                                                         \
+ *  @vals: values                                                       \
+ *  @n:    number of keys                                               \
  *                                                                      \
  * Returns:                                                             \
- *  @success: 0                                                         \
- *  @failure: -1 and errno set                                          \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  sizes the table for n entries once, partitions the keys by the top  \
+ *  PLD_HASH_MAP_RADIX_BITS bits of their home slot, hashing them twice \
+ *  rather than keeping a second n entry buffer, then sorts each        \
+ *  partition by the rest of its home slot while it is in cache (see    \
+ *  _sort_low()). Entries are written front to back at a running slot,  \
+ *  each at its home or right after the entry before, which is the      \
+ *  robin hood order: no probes and no swaps. A repeated key is found   \
+ *  among the entries of its home slot and, all sorts being stable,     \
+ *  the last value wins as with _set(). Entries that would wrap past    \
+ *  the last slot or sit past PLD_HASH_MAP_PROBE_LIMIT() are held back  \
+ *  and _set() afterwards                                               \
  */                                                                     \
-static inline int                                                       \
-_name ## _set(struct _name **ppp, _k k, _v v)                           \
+static inline struct _name *                                            \
+_name ## _build_from_arrays(const _k *keys, const _v *vals, size_t n)   \
 {                                                                       \
-        struct _name *pp = *ppp;                                        \
-        hash_map_size_t hash = _hash(k);                                \
-        hash_map_size_t mask = pp->p_cap - 1;                           \
-        hash_map_size_t i = hash & mask;                                \
-        hash_map_size_t tmp_hash = 0;                                   \
-        uint8_t tmp_disp = 0;                                           \
-        uint8_t disp = 0;                                               \
-        _k tmp_k = (_k){0};                                             \
-        _v tmp_v = (_v){0};                                             \
+        struct _name ## _ent *ent = NULL;                               \
+        struct _name ## _ent *tmp = NULL;                               \
+        struct _name ## _ent *part = NULL;                              \
+        struct _name ## _ent *ep = NULL;                                \
+        struct _name *pp = NULL;                                        \
+        size_t count[1 << PLD_HASH_MAP_RADIX_BITS];                     \
+        hash_map_size_t cap = _name ## _cap_for((hash_map_size_t)n);    \
+        hash_map_size_t mask = 0;                                       \
+        hash_map_size_t home = PLD_HASH_MAP_NOT_FOUND;                  \
+        hash_map_size_t first = 0;                                      \
+        hash_map_size_t slot = 0;                                       \
+        hash_map_size_t hash = 0;                                       \
+        hash_map_size_t j = 0;                                          \
+        size_t radix = 1 << PLD_HASH_MAP_RADIX_BITS;                    \
+        size_t digit = 0;                                               \
+        size_t most = 0;                                                \
+        size_t held = 0;                                                \
+        size_t lo = 0;                                                  \
+        size_t sum = 0;                                                 \
+        size_t c = 0;                                                   \
+        size_t i = 0;                                                   \
+        size_t r = 0;                                                   \
+        unsigned int shift = 0;                                         \
                                                                         \
-        if (unlikely(_name ## _need_to_grow(pp))) {                     \
-                if (_name ## _resize(ppp, pp->p_cap << 1) < 0)          \
-                        return -1;                                      \
-                pp = *ppp;                                              \
-                mask = pp->p_cap - 1;                                   \
-                i = hash & mask;                                        \
+        if (cap == 0) {                                                 \
+                errno = ENOMEM;                                         \
+                goto ret;                                               \
         }                                                               \
                                                                         \
-        for (;;) {                                                      \
-                tmp_disp = pp->p_meta[i];                               \
+        pp = _name ## _new(cap);                                        \
+        if (pp == NULL || n == 0)                                       \
+                goto ret;                                               \
                                                                         \
-                if (tmp_disp >= PLD_HASH_MAP_WAS) {                     \
-                        pp->p_key[i] = k;                               \
-                        pp->p_val[i] = v;                               \
-                        pp->p_meta[i] = disp;                           \
-                        pp->p_hash[i] = hash;                           \
+        ent = malloc(sizeof(*ent) * n);                                 \
+        if (ent == NULL)                                                \
+                goto free_pp;                                           \
                                                                         \
-                        if (tmp_disp == PLD_HASH_MAP_NEVER)             \
-                                pp->p_len++;                            \
-                        else                                            \
-                                pp->p_was--;                            \
+        /* top bits of the home slot, fewer for small tables */         \
+        mask = pp->p_cap - 1;                                           \
+        shift = (unsigned int)__builtin_ctzll(pp->p_cap);               \
+        shift = shift > PLD_HASH_MAP_RADIX_BITS ?                       \
+                shift - PLD_HASH_MAP_RADIX_BITS : 0;                    \
                                                                         \
-                        return 0;                                       \
-                }                                                       \
+        memset(count, 0, sizeof(count));                                \
+        for (i = 0; i < n; i++) {                                       \
+                hash = _name ## _seed_hash(pp, _hash(keys[i])) & mask;  \
+                count[(size_t)(hash >> shift)]++;                       \
+        }                                                               \
                                                                         \
-                if (_cmp(pp->p_key[i], k) == 0) {                       \
-                        pp->p_val[i] = v;                               \
-                        return 0;                                       \
-                }                                                       \
+        for (i = 0; i < radix; i++) {                                   \
+                c = count[i];                                           \
+                count[i] = sum;                                         \
+                sum += c;                                               \
+                if (c > most)                                           \
+                        most = c;                                       \
+        }                                                               \
                                                                         \
-                if (tmp_disp < disp) {                                  \
-                        tmp_k = pp->p_key[i];                           \
-                        tmp_v = pp->p_val[i];                           \
-                        tmp_hash = pp->p_hash[i];                       \
+        tmp = malloc(sizeof(*tmp) * most);                              \
+        if (tmp == NULL)                                                \
+                goto free_pp;                                           \
                                                                         \
-                        pp->p_key[i] = k;                               \
-                        pp->p_val[i] = v;                               \
-                        pp->p_meta[i] = disp;                           \
-                        pp->p_hash[i] = hash;                           \
+        /* stable, so repeated keys keep their input order */           \
+        for (i = 0; i < n; i++) {                                       \
+                hash = _name ## _seed_hash(pp, _hash(keys[i]));         \
+                digit = (size_t)((hash & mask) >> shift);               \
+                ent[count[digit]].e_hash = hash;                        \
+                ent[count[digit]].e_key = keys[i];                      \
+                ent[count[digit]].e_val = vals[i];                      \
+                count[digit]++;                                         \
+        }                                                               \
                                                                         \
-                        k = tmp_k;                                      \
-                        v = tmp_v;                                      \
-                        hash = tmp_hash;                                \
-                        disp = tmp_disp;                                \
+        for (r = 0; r < radix; r++) {                                   \
+                part = _name ## _sort_low(pp, ent + lo, tmp, count[r] - lo, \
+                                          shift);                       \
+                                                                        \
+                for (i = 0; i < count[r] - lo; i++) {                   \
+                        ep = &part[i];                                  \
+                        if ((ep->e_hash & mask) != home) {              \
+                                home = ep->e_hash & mask;               \
+                                if (slot < home)                        \
+                                        slot = home;                    \
+                                first = slot;                           \
+                        } else {                                        \
+                                for (j = first; j < slot; j++) {        \
+                                        if (_cmp(*_name ## _key_at(pp, j), \
+                                                 ep->e_key) == 0)       \
+                                                break;                  \
+                                }                                       \
+                                if (j < slot) {                         \
+                                        *_name ## _val_at(pp, j) =      \
+                                                ep->e_val;              \
+                                        continue;                       \
+                                }                                       \
+                        }                                               \
+                                                                        \
+                        /* held back to ent, behind the partitions read */ \
+                        if (slot > mask ||                              \
+                            slot - home > PLD_HASH_MAP_PROBE_LIMIT(_flags)) { \
+                                ent[held++] = *ep;                      \
+                                continue;                               \
+                        }                                               \
+                                                                        \
+                        *_name ## _key_at(pp, slot) = ep->e_key;        \
+                        *_name ## _val_at(pp, slot) = ep->e_val;        \
+                        _name ## _put_hash(pp, slot, ep->e_hash);       \
+                        _name ## _put_meta(pp, slot, _name ## _meta(    \
+                                           (uint8_t)(slot - home),      \
+                                           ep->e_hash));                \
+                        pp->p_len++;                                    \
+                        slot++;                                         \
                 }                                                       \
+                lo = count[r];                                          \
+        }                                                               \
                                                                         \
-                i = (i + 1) & mask;                                     \
-                disp++;                                                 \
-                if (unlikely(disp >= PLD_HASH_MAP_WAS))                 \
-                        return -1;                                      \
+        for (i = 0; i < held; i++) {                                    \
+                if (_name ## _set(&pp, ent[i].e_key, ent[i].e_val) < 0) \
+                        goto free_pp;                                   \
         }                                                               \
+                                                                        \
+        goto free_ent;                                                  \
+                                                                        \
+free_pp:                                                                \
+        _name ## _free(&pp);                                            \
+                                                                        \
+free_ent:                                                               \
+        free(ent);                                                      \
+        ent = NULL;                                                     \
+        free(tmp);                                                      \
+        tmp = NULL;                                                     \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Get map[k] from _name{}:                                             \
+ * Write statistics of _name{} as one line of JSON:                     \
  *                                                                      \
  * Arguments:                                                           \
- *  @pp: pointer to pointer to _name{}                                  \
- *  @k:  key                                                            \
+ *  @pp: pointer to _name{}                                             \
+ *  @fp: stream                                                         \
  *                                                                      \
  * Returns:                                                             \
- *  @success: pointer to _v{}                                           \
- *  @failure: NULL                                                      \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  capacity, length, WAS ratio and the histogram of displacements held \
+ *  in p_meta (index is displacement) are read off the table; maps with \
+ *  PLD_HASH_MAP_STATS also get their counters, with probe lengths      \
+ *  bucketed by powers of 2                                             \
  */                                                                     \
-static inline _v *                                                      \
-_name ## _get(const struct _name *pp, _k k)                             \
+static inline int                                                       \
+_name ## _stats_dump(const struct _name *pp, FILE *fp)                  \
 {                                                                       \
-        hash_map_size_t hash = _hash(k);                                \
-        hash_map_size_t mask = pp->p_cap - 1;                           \
-        hash_map_size_t i = hash & mask;                                \
-        uint8_t cur_disp = 0;                                           \
-        uint8_t disp = 0;                                               \
+        uint64_t disp[PLD_HASH_MAP_WAS] = {0};                          \
+        const struct pld_hash_map_op_stats *osp = NULL;                 \
+        const struct _name *tp = pp;                                    \
+        hash_map_size_t was = 0;                                        \
+        hash_map_size_t cap = 0;                                        \
+        hash_map_size_t i = 0;                                          \
+        size_t n = 0;                                                   \
+        uint8_t meta = 0;                                               \
+        int op = 0;                                                     \
                                                                         \
-        for (;;) {                                                      \
-                cur_disp = pp->p_meta[i];                               \
+        /* a table being migrated from is counted in as well */         \
+        for (; tp != NULL; tp = tp->p_old) {                            \
+                for (i = 0; i < tp->p_cap; i++) {                       \
+                        meta = _name ## _get_meta(tp, i);               \
+                        if (meta < PLD_HASH_MAP_WAS)                    \
+                                disp[_name ## _disp(meta)]++;           \
+                }                                                       \
+                was += tp->p_was;                                       \
+                cap += tp->p_cap;                                       \
+        }                                                               \
                                                                         \
-                if (cur_disp == PLD_HASH_MAP_NEVER)                     \
-                        return NULL;                                    \
+        for (n = PLD_HASH_MAP_WAS; n > 0 && disp[n - 1] == 0; n--)      \
+                ;                                                       \
                                                                         \
-                if (cur_disp < disp)                                    \
-                        return NULL;                                    \
+        fprintf(fp, "{\"map\":\"%s\",\"cap\":%llu,\"len\":%llu,"        \
+                "\"was\":%llu,\"was_ratio\":%.6f,\"disp\":", #_name,    \
+                (unsigned long long)pp->p_cap,                          \
+                (unsigned long long)_name ## _len(pp),                  \
+                (unsigned long long)was, (double)was / (double)cap);    \
+        pld_hash_map_dump_array(fp, disp, n);                           \
                                                                         \
-                if (cur_disp != PLD_HASH_MAP_WAS) {                     \
-                        if (_cmp(pp->p_key[i], k) == 0)                 \
-                                return &pp->p_val[i];                   \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                for (op = 0; op < PLD_HASH_MAP_NOP; op++) {             \
+                        osp = &pp->p_stats->s_op[op];                   \
+                        fprintf(fp, ",\"%s\":{\"calls\":%llu,"          \
+                                "\"probes\":%llu,\"hist\":",            \
+                                pld_hash_map_op_name[op],               \
+                                (unsigned long long)osp->o_calls,       \
+                                (unsigned long long)osp->o_probes);     \
+                        pld_hash_map_dump_array(fp, osp->o_hist,        \
+                                                PLD_HASH_MAP_HIST);     \
+                        fputc('}', fp);                                 \
                 }                                                       \
-                                                                        \
-                i = (i + 1) & mask;                                     \
-                disp++;                                                 \
-                if (unlikely(disp >= PLD_HASH_MAP_WAS))                 \
-                        return NULL;                                    \
+                fprintf(fp, ",\"swap\":%llu,\"resize\":%llu,"           \
+                        "\"resize_ns\":%llu,\"reseed\":%llu",           \
+                        (unsigned long long)pp->p_stats->s_swap,        \
+                        (unsigned long long)pp->p_stats->s_resize,      \
+                        (unsigned long long)pp->p_stats->s_resize_ns,   \
+                        (unsigned long long)pp->p_stats->s_reseed);     \
         }                                                               \
+                                                                        \
+        fputs("}\n", fp);                                               \
+        return ferror(fp) ? -1 : 0;                                     \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Test if need to shrink:                                              \
+ * Checksum p_meta and slot arrays of _name{}:                          \
  *                                                                      \
  * Arguments:                                                           \
  *  @pp: pointer to _name{}                                             \
  *                                                                      \
  * Returns:                                                             \
- *  @true:  if needed                                                   \
- *  @false: if not                                                      \
+ *  @success: checksum, counters of PLD_HASH_MAP_STATS left out         \
+ *  @failure: does not                                                  \
  */                                                                     \
-static inline bool                                                      \
-_name ## _need_to_shrink(const struct _name *pp)                        \
+static inline uint64_t                                                  \
+_name ## _table_sum(const struct _name *pp)                             \
 {                                                                       \
-        hash_map_size_t len = pp->p_len;                                \
-        hash_map_size_t cap = pp->p_cap;                                \
+        struct _name ## _layout l;                                      \
                                                                         \
-        return (len < (cap >> 2)) && (cap > PLD_HASH_MAP_INIT_CAP);     \
+        _name ## _layout_for(pp->p_cap, &l);                            \
+        return pld_hash_map_sum(pp->p_meta, l.l_size - l.l_meta);       \
 }                                                                       \
                                                                         \
 /**                                                                     \
- * Unset map[k] _name{}:                                                \
+ * Write a snapshot of _name{} that _open_mapped() can map:             \
  *                                                                      \
  * Arguments:                                                           \
- *  @ppp: pointer to pointer to _name{}                                 \
- *  @k:   key                                                           \
+ *  @pp: pointer to _name{} of trivially copyable _k and _v             \
+ *  @fd: file descriptor to write at, from its current offset           \
  *                                                                      \
  * Returns:                                                             \
  *  @success: 0                                                         \
- *  @failure: -1 and errno set                                          \
+ *  @failure: -1 and errno set, EBUSY while an incremental resize is    \
+ *            in progress                                               \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a header page holding version, flags, key and value sizes and       \
+ *  checksums, then the table block as laid out in memory with its      \
+ *  struct zeroed; integers are in host byte order, and keys pointing   \
+ *  outside the table (such as str_hash_map long keys) are not valid    \
+ *  in another process                                                  \
  */                                                                     \
 static inline int                                                       \
-_name ## _unset(struct _name **ppp, _k k)                               \
+_name ## _save(const struct _name *pp, int fd)                          \
 {                                                                       \
-        struct _name *pp = *ppp;                                        \
-        hash_map_size_t hash = _hash(k);                                \
-        hash_map_size_t mask = pp->p_cap - 1;                           \
-        hash_map_size_t i = hash & mask;                                \
-        uint8_t cur_disp = 0;                                           \
-        uint8_t disp = 0;                                               \
+        struct pld_hash_map_file *fp = NULL;                            \
+        const uint8_t *base = (const uint8_t *)pp;                      \
+        uint8_t *buf = NULL;                                            \
+        size_t head = 0;                                                \
+        int ret = -1;                                                   \
                                                                         \
-        if (unlikely(_name ## _need_to_shrink(pp))) {                   \
-                if (_name ## _resize(ppp, pp->p_cap >> 1) < 0)          \
-                        return -1;                                      \
-                pp = *ppp;                                              \
-                mask = pp->p_cap - 1;                                   \
-                i = hash & mask;                                        \
+        if (pp->p_old != NULL) {                                        \
+                errno = EBUSY;                                          \
+                return -1;                                              \
         }                                                               \
                                                                         \
-        for (;;) {                                                      \
-                cur_disp = pp->p_meta[i];                               \
+        head = pld_hash_map_round(sizeof(*pp), PLD_HASH_MAP_ALIGN);     \
                                                                         \
-                if (cur_disp == PLD_HASH_MAP_NEVER)                     \
-                        return 0;                                       \
-                if (cur_disp < disp)                                    \
-                        return 0;                                       \
+        /* header page and zeroed struct go out in one write */         \
+        buf = calloc(1, PLD_HASH_MAP_FILE_HEAD + head);                 \
+        if (buf == NULL)                                                \
+                return -1;                                              \
                                                                         \
-                if (cur_disp != PLD_HASH_MAP_WAS) {                     \
-                        if (_cmp(pp->p_key[i], k) == 0) {               \
-                                pp->p_meta[i] = PLD_HASH_MAP_WAS;       \
-                                pp->p_len--;                            \
-                                pp->p_was++;                            \
-                                return 0;                               \
-                        }                                               \
-                }                                                       \
+        fp = (struct pld_hash_map_file *)(void *)buf;                   \
+        fp->f_magic = PLD_HASH_MAP_MAGIC;                               \
+        fp->f_version = PLD_HASH_MAP_VERSION;                           \
+        fp->f_flags = (uint32_t)(_flags);                               \
+        fp->f_key_size = (uint32_t)sizeof(_k);                          \
+        fp->f_val_size = (uint32_t)sizeof(_v);                          \
+        fp->f_cap = pp->p_cap;                                          \
+        fp->f_len = pp->p_len;                                          \
+        fp->f_was = pp->p_was;                                          \
+        fp->f_seed = pp->p_seed;                                        \
+        fp->f_size = pp->p_size;                                        \
+        fp->f_sum = _name ## _table_sum(pp);                            \
+        fp->f_head_sum = pld_hash_map_head_sum(fp);                     \
                                                                         \
-                i = (i + 1) & mask;                                     \
-                disp++;                                                 \
-                if (unlikely(disp >= PLD_HASH_MAP_WAS))                 \
-                        return -1;                                      \
+        if (pld_hash_map_write(fd, buf,                                 \
+                               PLD_HASH_MAP_FILE_HEAD + head) < 0 ||    \
+            pld_hash_map_write(fd, base + head, pp->p_size - head) < 0) \
+                goto free_buf;                                          \
+        ret = 0;                                                        \
+                                                                        \
+free_buf:                                                               \
+        free(buf);                                                      \
+        buf = NULL;                                                     \
+                                                                        \
+        return ret;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Open a snapshot written by _save() as a _name{}:                     \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @path: path of snapshot                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{} backed by the file, for _free()        \
+ *  @failure: NULL and errno set, EINVAL if the file is not a snapshot  \
+ *            of a map with the same flags, key and value sizes         \
+ *                                                                      \
+ * Notes:                                                               \
+ *  nothing is read or rehashed up front, pages fault in as lookups     \
+ *  touch them and stay shared with other processes mapping the file;   \
+ *  the mapping is private, so _set() and _unset() work and copy only   \
+ *  the pages they write, and a resize moves the map to memory. The     \
+ *  header checksum is checked here, the table checksum by _verify().   \
+ *  _hash must hash as it did in the process that saved the map         \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _open_mapped(const char *path)                                 \
+{                                                                       \
+        struct _name ## _layout l;                                      \
+        const struct pld_hash_map_file *fp = NULL;                      \
+        struct _name *pp = NULL;                                        \
+        uint8_t *base = NULL;                                           \
+        size_t size = 0;                                                \
+                                                                        \
+        base = pld_hash_map_map_file(path, &size);                      \
+        if (base == NULL)                                               \
+                return NULL;                                            \
+                                                                        \
+        fp = (const struct pld_hash_map_file *)(const void *)base;      \
+        if (fp->f_magic != PLD_HASH_MAP_MAGIC ||                        \
+            fp->f_version != PLD_HASH_MAP_VERSION ||                    \
+            fp->f_head_sum != pld_hash_map_head_sum(fp) ||              \
+            fp->f_flags != (uint32_t)(_flags) ||                        \
+            fp->f_key_size != sizeof(_k) ||                             \
+            fp->f_val_size != sizeof(_v) ||                             \
+            fp->f_cap == 0 || (fp->f_cap & (fp->f_cap - 1)) != 0 ||     \
+            fp->f_cap > (PLD_HASH_MAP_NOT_FOUND >> 5) ||                \
+            fp->f_len > fp->f_cap)                                      \
+                goto inval;                                             \
+                                                                        \
+        _name ## _layout_for(fp->f_cap, &l);                            \
+        if (fp->f_size != l.l_size ||                                   \
+            size != PLD_HASH_MAP_FILE_HEAD + l.l_size)                  \
+                goto inval;                                             \
+                                                                        \
+        pp = _name ## _carve(base + PLD_HASH_MAP_FILE_HEAD, fp->f_cap,  \
+                             &l);                                       \
+        pp->p_len = fp->f_len;                                          \
+        pp->p_was = fp->f_was;                                          \
+        pp->p_seed = fp->f_seed;                                        \
+        pp->p_alloc = NULL;                                             \
+        pp->p_mapped = size;                                            \
+        return pp;                                                      \
+                                                                        \
+inval:                                                                  \
+        munmap(base, size);                                             \
+        errno = EINVAL;                                                 \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Verify table checksum of a _name{} opened with _open_mapped():       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{} not changed since it was opened             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set to EIO on a mismatch, EINVAL if pp was   \
+ *            not opened with _open_mapped()                            \
+ *                                                                      \
+ * Notes:                                                               \
+ *  reads every page of the file once                                   \
+ */                                                                     \
+static inline int                                                       \
+_name ## _verify(const struct _name *pp)                                \
+{                                                                       \
+        const struct pld_hash_map_file *fp = NULL;                      \
+        const uint8_t *base = (const uint8_t *)pp;                      \
+                                                                        \
+        if (pp->p_mapped == 0) {                                        \
+                errno = EINVAL;                                         \
+                return -1;                                              \
+        }                                                               \
+                                                                        \
+        fp = (const void *)(base - PLD_HASH_MAP_FILE_HEAD);             \
+        if (fp->f_sum != _name ## _table_sum(pp)) {                     \
+                errno = EIO;                                            \
+                return -1;                                              \
         }                                                               \
+                                                                        \
+        return 0;                                                       \
 }
 
 #endif /* #ifndef PLD_HASH_MAP_H */
@@ -0,0 +1,880 @@
+#ifndef PLD_HASH_MAP_PAR_H
+#define PLD_HASH_MAP_PAR_H
+
+#include "pld_hash_map.h"
+#include "util.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* fewest slots of a range one thread fills */
+#ifndef PLD_HASH_MAP_PAR_MIN
+#define PLD_HASH_MAP_PAR_MIN (1 << 14)
+#endif /* #ifndef PLD_HASH_MAP_PAR_MIN */
+
+/* misc. constants */
+enum {
+        PLD_HASH_MAP_PAR_MAX = 256, /* most threads an operation uses */
+};
+
+/**
+ * Run tasks on threads:
+ *
+ * Arguments:
+ *  @n:    number of tasks, at most PLD_HASH_MAP_PAR_MAX
+ *  @fn:   task
+ *  @args: array of n task arguments
+ *  @size: bytes of one task argument
+ *
+ * Returns:
+ *  @success: once every task returned
+ *  @failure: does not
+ *
+ * Notes:
+ *  task 0 runs on the calling thread, and so does any task whose
+ *  thread could not be created, so every task runs
+ */
+static inline void
+pld_hash_map_par_run(int n, void *(*fn)(void *), void *args, size_t size)
+{
+        pthread_t tid[PLD_HASH_MAP_PAR_MAX];
+        bool started[PLD_HASH_MAP_PAR_MAX];
+        uint8_t *arg = args;
+        int i = 0;
+
+        for (i = 1; i < n; i++)
+                started[i] = pthread_create(&tid[i], NULL, fn,
+                                            arg + (size_t)i * size) == 0;
+
+        (void)fn(arg);
+
+        for (i = 1; i < n; i++) {
+                if (started[i])
+                        (void)pthread_join(tid[i], NULL);
+                else
+                        (void)fn(arg + (size_t)i * size);
+        }
+}
+
+/**
+ * Get number of threads to split a table into ranges for:
+ *
+ * Arguments:
+ *  @nthreads: threads asked for
+ *  @cap:      capacity of table
+ *
+ * Returns:
+ *  @success: power of 2 at most nthreads and PLD_HASH_MAP_PAR_MAX,
+ *            leaving each range PLD_HASH_MAP_PAR_MIN slots or more
+ *  @failure: does not
+ */
+static inline int
+pld_hash_map_par_threads(int nthreads, hash_map_size_t cap)
+{
+        int n = 1;
+
+        while (n * 2 <= nthreads && n * 2 <= PLD_HASH_MAP_PAR_MAX &&
+               cap / (hash_map_size_t)(n * 2) >= PLD_HASH_MAP_PAR_MIN)
+                n *= 2;
+
+        return n;
+}
+
+/**
+ * Map a slot boundary of one table onto another:
+ *
+ * Arguments:
+ *  @i:    slot of a table of capacity from, a multiple of its ranges
+ *  @from: capacity, a power of 2
+ *  @to:   capacity, a power of 2
+ *
+ * Returns:
+ *  @success: matching slot of a table of capacity to
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+pld_hash_map_par_scale(hash_map_size_t i, hash_map_size_t from,
+                       hash_map_size_t to)
+{
+        if (to >= from)
+                return i * (to / from);
+
+        return i / (from / to);
+}
+
+/**
+ * Define a new hash table with parallel bulk operations:
+ *
+ * Arguments:
+ *  @_k:     key type
+ *  @_v:     value type
+ *  @_name:  name of generated struct and prefix of all function names
+ *  @_hash:  hash function, called from several threads at once
+ *  @_cmp:   key comparison function
+ *  @_flags: bitwise or of PLD_HASH_MAP_* map flags
+ *
+ * Notes:
+ *  a pld_hash_map with _resize_parallel(), _build_parallel(),
+ *  _clear_parallel() and _foreach_parallel(). The table is split into
+ *  one range of slots per thread by the high bits of the home slot,
+ *  and each thread fills its range alone. An entry that would be
+ *  pushed past the end of its range is held back instead, leaving
+ *  every range a robin hood table of its own; held back entries are
+ *  placed afterwards on the calling thread with the usual swaps across
+ *  the boundary. None of the calls are safe to run alongside other
+ *  operations on the same map
+ */
+#define PLD_HASH_MAP_PAR_DEFINE(_k, _v, _name, _hash, _cmp, _flags)     \
+                                                                        \
+PLD_HASH_MAP_DEFINE_FLAGS(_k, _v, _name, _hash, _cmp, _flags)           \
+                                                                        \
+/* work of one thread of a parallel operation on _name{} */             \
+struct _name ## _par {                                                  \
+        struct _name       *r_dst;   /* table filled or walked */       \
+        const struct _name *r_src;   /* table rehashed from */          \
+        struct _name ## _ent *r_ent; /* input entries by range */       \
+        const _k           *r_keys;  /* input keys */                   \
+        const _v           *r_vals;  /* input values */                 \
+        size_t             *r_count; /* input entries per range */      \
+        size_t              r_lo;    /* first input entry */            \
+        size_t              r_hi;    /* one past last input entry */    \
+        hash_map_size_t     r_start; /* first slot of range */          \
+        hash_map_size_t     r_end;   /* one past last slot */           \
+        hash_map_size_t     r_len;   /* entries added to range */       \
+        int                 r_shift; /* range of slot i is i >> this */ \
+        int                 r_t;     /* thread index */                 \
+        int                 r_err;   /* errno of failure, or 0 */       \
+        void (*r_fn)(_k, _v *, int, void *); /* _foreach_parallel() */  \
+        void               *r_ctx;   /* passed through to r_fn */       \
+        size_t              r_ndefer; /* entries held back */           \
+        struct _name ## _ent r_defer[PLD_HASH_MAP_WAS]; /* held back */ \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Write an entry to a slot of _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot                                                         \
+ *  @disp: displacement of entry at slot i                              \
+ *  @ep:   pointer to _name_ent{} with seeded hash                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _put_ent(struct _name *pp, hash_map_size_t i, uint8_t disp,    \
+                  const struct _name ## _ent *ep)                       \
+{                                                                       \
+        *_name ## _key_at(pp, i) = ep->e_key;                           \
+        *_name ## _val_at(pp, i) = ep->e_val;                           \
+        _name ## _put_hash(pp, i, ep->e_hash);                          \
+        _name ## _put_meta(pp, i, _name ## _meta(disp, ep->e_hash));    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Place an entry in a range of _name{} with robin hood swaps:          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{} without WAS slots                          \
+ *  @end: one past the last slot of range                               \
+ *  @ep:  pointer to _name_ent{} to place, home slot in range           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0 if placed, 1 if the entry carried along reached end and \
+ *            was saved in *ep instead                                  \
+ *  @failure: -1 if an entry would be displaced too far                 \
+ */                                                                     \
+static inline int                                                       \
+_name ## _place_in(struct _name *pp, hash_map_size_t end,               \
+                   struct _name ## _ent *ep)                            \
+{                                                                       \
+        struct _name ## _ent tmp;                                       \
+        hash_map_size_t i = ep->e_hash & (pp->p_cap - 1);               \
+        uint8_t disp = 0;                                               \
+        uint8_t cur = 0;                                                \
+                                                                        \
+        for (;;) {                                                      \
+                cur = _name ## _get_meta(pp, i);                        \
+                                                                        \
+                if (cur == PLD_HASH_MAP_NEVER) {                        \
+                        _name ## _put_ent(pp, i, disp, ep);             \
+                        return 0;                                       \
+                }                                                       \
+                                                                        \
+                if (_name ## _disp(cur) < disp) {                       \
+                        tmp.e_hash = _name ## _hash_of(pp, i);          \
+                        tmp.e_key = *_name ## _key_at(pp, i);           \
+                        tmp.e_val = *_name ## _val_at(pp, i);           \
+                        _name ## _put_ent(pp, i, disp, ep);             \
+                        *ep = tmp;                                      \
+                        disp = _name ## _disp(cur);                     \
+                }                                                       \
+                                                                        \
+                if (++i == end)                                         \
+                        return 1;                                       \
+                disp++;                                                 \
+                if (unlikely(disp > PLD_HASH_MAP_PROBE_LIMIT(_flags)))  \
+                        return -1;                                      \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find slot of key in a range of _name{}:                              \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{} without WAS slots                          \
+ *  @end: one past the last slot of range                               \
+ *  @ep:  pointer to _name_ent{} of key, home slot in range             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot holding key                                          \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND                                    \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find_in(const struct _name *pp, hash_map_size_t end,          \
+                  const struct _name ## _ent *ep)                       \
+{                                                                       \
+        hash_map_size_t i = ep->e_hash & (pp->p_cap - 1);               \
+        uint8_t disp = 0;                                               \
+        uint8_t cur = 0;                                                \
+                                                                        \
+        for (;;) {                                                      \
+                cur = _name ## _get_meta(pp, i);                        \
+                                                                        \
+                if (cur == PLD_HASH_MAP_NEVER ||                        \
+                    _name ## _disp(cur) < disp)                         \
+                        return PLD_HASH_MAP_NOT_FOUND;                  \
+                                                                        \
+                if (cur == _name ## _meta(disp, ep->e_hash) &&          \
+                    _cmp(*_name ## _key_at(pp, i), ep->e_key) == 0)     \
+                        return i;                                       \
+                                                                        \
+                if (++i == end)                                         \
+                        return PLD_HASH_MAP_NOT_FOUND;                  \
+                disp++;                                                 \
+                if (unlikely(disp > PLD_HASH_MAP_PROBE_LIMIT(_flags)))  \
+                        return PLD_HASH_MAP_NOT_FOUND;                  \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Add an entry to the range of a thread:                               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @rp:     pointer to _name_par{} of thread                           \
+ *  @ep:     pointer to _name_ent{} to add, home slot in range          \
+ *  @dedupe: true if key may already be in range, value overwritten     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1, an entry would be displaced too far                   \
+ *                                                                      \
+ * Notes:                                                               \
+ *  more held back entries than PLD_HASH_MAP_PROBE_LIMIT() could never  \
+ *  fit past the end of the range either                                \
+ */                                                                     \
+static inline int                                                       \
+_name ## _par_add(struct _name ## _par *rp, struct _name ## _ent *ep,   \
+                  bool dedupe)                                          \
+{                                                                       \
+        struct _name ## _ent *dp = NULL;                                \
+        hash_map_size_t i = 0;                                          \
+        size_t d = 0;                                                   \
+        int ret = 0;                                                    \
+                                                                        \
+        if (dedupe) {                                                   \
+                i = _name ## _find_in(rp->r_dst, rp->r_end, ep);        \
+                if (i != PLD_HASH_MAP_NOT_FOUND) {                      \
+                        *_name ## _val_at(rp->r_dst, i) = ep->e_val;    \
+                        return 0;                                       \
+                }                                                       \
+                                                                        \
+                for (d = 0; d < rp->r_ndefer; d++) {                    \
+                        dp = &rp->r_defer[d];                           \
+                        if (dp->e_hash == ep->e_hash &&                 \
+                            _cmp(dp->e_key, ep->e_key) == 0) {          \
+                                dp->e_val = ep->e_val;                  \
+                                return 0;                               \
+                        }                                               \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        rp->r_len++;                                                    \
+        ret = _name ## _place_in(rp->r_dst, rp->r_end, ep);             \
+        if (ret == 0)                                                   \
+                return 0;                                               \
+                                                                        \
+        if (ret < 0 || rp->r_ndefer > PLD_HASH_MAP_PROBE_LIMIT(_flags)) \
+                return -1;                                              \
+                                                                        \
+        rp->r_defer[rp->r_ndefer++] = *ep;                              \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Place held back entries and count entries of a parallel fill:        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{} filled                                     \
+ *  @par: array of _name_par{}, one per range                           \
+ *  @n:   number of ranges                                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _par_finish(struct _name *pp, const struct _name ## _par *par, \
+                     int n)                                             \
+{                                                                       \
+        const struct _name ## _ent *ep = NULL;                          \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        size_t d = 0;                                                   \
+        int t = 0;                                                      \
+                                                                        \
+        for (t = 0; t < n; t++) {                                       \
+                if (par[t].r_err != 0) {                                \
+                        errno = par[t].r_err;                           \
+                        return -1;                                      \
+                }                                                       \
+                pp->p_len += par[t].r_len;                              \
+        }                                                               \
+                                                                        \
+        for (t = 0; t < n; t++) {                                       \
+                for (d = 0; d < par[t].r_ndefer; d++) {                 \
+                        ep = &par[t].r_defer[d];                        \
+                        if (_name ## _place(pp, ep->e_hash & mask, 0,   \
+                                            ep->e_hash, ep->e_key,      \
+                                            ep->e_val) < 0) {           \
+                                errno = EOVERFLOW;                      \
+                                return -1;                              \
+                        }                                               \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Rehash the entries of one range of a parallel resize:                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL, r_err set on failure                                \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  only old slots that can hold an entry with its new home in range    \
+ *  are read: the old homes folding onto the range, and up to           \
+ *  PLD_HASH_MAP_MAX_DISP() slots past them                             \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _rehash_task(void *arg)                                        \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+        const struct _name *src = rp->r_src;                            \
+        struct _name ## _ent e;                                         \
+        hash_map_size_t cap = rp->r_dst->p_cap;                         \
+        hash_map_size_t span = rp->r_end - rp->r_start;                 \
+        hash_map_size_t smask = src->p_cap - 1;                         \
+        hash_map_size_t len = span + PLD_HASH_MAP_MAX_DISP(_flags) + 1; \
+        hash_map_size_t n = cap < src->p_cap ? src->p_cap / cap : 1;    \
+        hash_map_size_t i = 0;                                          \
+        hash_map_size_t j = 0;                                          \
+        hash_map_size_t k = 0;                                          \
+                                                                        \
+        /* runs that would overlap are read as one whole table pass */  \
+        if (len * n >= src->p_cap) {                                    \
+                len = src->p_cap;                                       \
+                n = 1;                                                  \
+        }                                                               \
+                                                                        \
+        for (j = 0; j < n; j++) {                                       \
+                i = (rp->r_start + j * cap) & smask;                    \
+                for (k = 0; k < len; k++, i = (i + 1) & smask) {        \
+                        if (_name ## _get_meta(src, i) >=               \
+                            PLD_HASH_MAP_WAS)                           \
+                                continue;                               \
+                                                                        \
+                        e.e_hash = _name ## _hash_of(src, i);           \
+                        /* unsigned, so below r_start is out too */     \
+                        if ((e.e_hash & (cap - 1)) - rp->r_start >=     \
+                            span)                                       \
+                                continue;                               \
+                                                                        \
+                        e.e_key = *_name ## _key_at(src, i);            \
+                        e.e_val = *_name ## _val_at(src, i);            \
+                        if (_name ## _par_add(rp, &e, false) < 0) {     \
+                                rp->r_err = EOVERFLOW;                  \
+                                return NULL;                            \
+                        }                                               \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Resize _name{} on several threads:                                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @cap:      new capacity                                             \
+ *  @nthreads: most threads to use                                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, map untouched                           \
+ *                                                                      \
+ * Notes:                                                               \
+ *  falls back to _resize() for one thread, tables too small to split   \
+ *  and tables in the middle of an incremental resize                   \
+ */                                                                     \
+static inline int                                                       \
+_name ## _resize_parallel(struct _name **ppp, hash_map_size_t cap,      \
+                          int nthreads)                                 \
+{                                                                       \
+        struct _name ## _par *par = NULL;                               \
+        struct _name *pp = *ppp;                                        \
+        struct _name *newpp = NULL;                                     \
+        hash_map_size_t span = 0;                                       \
+        uint64_t start = 0;                                             \
+        int ret = -1;                                                   \
+        int n = 0;                                                      \
+        int t = 0;                                                      \
+                                                                        \
+        n = pld_hash_map_par_threads(nthreads, next_pow2(cap));         \
+        if (n == 1 || pp->p_old != NULL)                                \
+                return _name ## _resize(ppp, cap);                      \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_STATS)                              \
+                start = pld_hash_map_ns();                              \
+                                                                        \
+        newpp = _name ## _new_alloc(cap, pp->p_alloc);                  \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+        newpp->p_seed = pp->p_seed;                                     \
+                                                                        \
+        par = calloc((size_t)n, sizeof(*par));                          \
+        if (par == NULL)                                                \
+                goto free_newpp;                                        \
+                                                                        \
+        span = newpp->p_cap / (hash_map_size_t)n;                       \
+        for (t = 0; t < n; t++) {                                       \
+                par[t].r_dst = newpp;                                   \
+                par[t].r_src = pp;                                      \
+                par[t].r_start = span * (hash_map_size_t)t;             \
+                par[t].r_end = par[t].r_start + span;                   \
+        }                                                               \
+                                                                        \
+        pld_hash_map_par_run(n, _name ## _rehash_task, par,             \
+                             sizeof(*par));                             \
+        if (_name ## _par_finish(newpp, par, n) < 0) {                  \
+                /* failed resizes are counted too, as by _rehash() */   \
+                if ((_flags) & PLD_HASH_MAP_STATS)                      \
+                        pld_hash_map_count_resize(pp->p_stats, start);  \
+                goto free_par;                                          \
+        }                                                               \
+                                                                        \
+        if ((_flags) & PLD_HASH_MAP_STATS) {                            \
+                *newpp->p_stats = *pp->p_stats;                         \
+                pld_hash_map_count_resize(newpp->p_stats, start);       \
+        }                                                               \
+                                                                        \
+        _name ## _free(ppp);                                            \
+        *ppp = newpp;                                                   \
+        newpp = NULL;                                                   \
+        ret = 0;                                                        \
+                                                                        \
+free_par:                                                               \
+        free(par);                                                      \
+        par = NULL;                                                     \
+                                                                        \
+free_newpp:                                                             \
+        if (newpp != NULL)                                              \
+                _name ## _free(&newpp);                                 \
+                                                                        \
+        return ret;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Count input entries of a parallel build per range:                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL                                                      \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _count_task(void *arg)                                         \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+        const struct _name *pp = rp->r_dst;                             \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t hash = 0;                                       \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (i = rp->r_lo; i < rp->r_hi; i++) {                         \
+                hash = _name ## _seed_hash(pp, _hash(rp->r_keys[i]));   \
+                rp->r_count[(hash & mask) >> rp->r_shift]++;            \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Partition input entries of a parallel build by range:                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread, r_count turned into offsets \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL                                                      \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  keys are hashed again rather than kept from _count_task()           \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _scatter_task(void *arg)                                       \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+        struct _name ## _ent *ep = NULL;                                \
+        const struct _name *pp = rp->r_dst;                             \
+        hash_map_size_t mask = pp->p_cap - 1;                           \
+        hash_map_size_t hash = 0;                                       \
+        size_t i = 0;                                                   \
+        size_t r = 0;                                                   \
+                                                                        \
+        for (i = rp->r_lo; i < rp->r_hi; i++) {                         \
+                hash = _name ## _seed_hash(pp, _hash(rp->r_keys[i]));   \
+                r = (hash & mask) >> rp->r_shift;                       \
+                ep = &rp->r_ent[rp->r_count[r]++];                      \
+                ep->e_hash = hash;                                      \
+                ep->e_key = rp->r_keys[i];                              \
+                ep->e_val = rp->r_vals[i];                              \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Fill one range of a parallel build:                                  \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread, r_lo and r_hi bounding its  \
+ *        entries in r_ent                                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL, r_err set on failure                                \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _fill_task(void *arg)                                          \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+        size_t i = 0;                                                   \
+                                                                        \
+        for (i = rp->r_lo; i < rp->r_hi; i++) {                         \
+                if (_name ## _par_add(rp, &rp->r_ent[i], true) < 0) {   \
+                        rp->r_err = EOVERFLOW;                          \
+                        return NULL;                                    \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{} from arrays on several threads:                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @keys:     keys                                                     \
+ *  @vals:     values                                                   \
+ *  @n:        number of keys                                           \
+ *  @nthreads: most threads to use                                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  threads count their slice of the input per range, copy it out       \
+ *  partitioned by range keeping input order, then fill one range       \
+ *  each; as with _build_from_arrays(), which one thread falls back     \
+ *  to, the last value of a repeated key wins                           \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _build_parallel(const _k *keys, const _v *vals, size_t n,      \
+                         int nthreads)                                  \
+{                                                                       \
+        struct _name ## _par *par = NULL;                               \
+        struct _name ## _ent *ent = NULL;                               \
+        struct _name *pp = NULL;                                        \
+        hash_map_size_t cap = _name ## _cap_for((hash_map_size_t)n);    \
+        hash_map_size_t span = 0;                                       \
+        size_t *count = NULL;                                           \
+        size_t sum = 0;                                                 \
+        size_t c = 0;                                                   \
+        int nt = 0;                                                     \
+        int r = 0;                                                      \
+        int t = 0;                                                      \
+                                                                        \
+        nt = pld_hash_map_par_threads(nthreads, cap);                   \
+        if (nt == 1 || n == 0)                                          \
+                return _name ## _build_from_arrays(keys, vals, n);      \
+                                                                        \
+        pp = _name ## _new(cap);                                        \
+        if (pp == NULL)                                                 \
+                return NULL;                                            \
+                                                                        \
+        par = calloc((size_t)nt, sizeof(*par));                         \
+        count = calloc((size_t)nt * (size_t)nt, sizeof(*count));        \
+        ent = malloc(sizeof(*ent) * n);                                 \
+        if (par == NULL || count == NULL || ent == NULL)                \
+                goto free_pp;                                           \
+                                                                        \
+        span = pp->p_cap / (hash_map_size_t)nt;                         \
+        for (t = 0; t < nt; t++) {                                      \
+                par[t].r_dst = pp;                                      \
+                par[t].r_ent = ent;                                     \
+                par[t].r_keys = keys;                                   \
+                par[t].r_vals = vals;                                   \
+                par[t].r_count = &count[(size_t)t * (size_t)nt];        \
+                par[t].r_lo = n / (size_t)nt * (size_t)t;               \
+                par[t].r_hi = par[t].r_lo + n / (size_t)nt;             \
+                par[t].r_start = span * (hash_map_size_t)t;             \
+                par[t].r_end = par[t].r_start + span;                   \
+                par[t].r_shift = __builtin_ctzll(span);                 \
+        }                                                               \
+        par[nt - 1].r_hi = n;                                           \
+                                                                        \
+        pld_hash_map_par_run(nt, _name ## _count_task, par,             \
+                             sizeof(*par));                             \
+                                                                        \
+        /* range major, so each range's entries are in input order */   \
+        for (r = 0; r < nt; r++) {                                      \
+                for (t = 0; t < nt; t++) {                              \
+                        c = par[t].r_count[r];                          \
+                        par[t].r_count[r] = sum;                        \
+                        sum += c;                                       \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        pld_hash_map_par_run(nt, _name ## _scatter_task, par,           \
+                             sizeof(*par));                             \
+                                                                        \
+        /* scatter left each count at the start of the next run */      \
+        for (r = 0; r < nt; r++) {                                      \
+                par[r].r_lo = r == 0 ? 0 : par[nt - 1].r_count[r - 1];  \
+                par[r].r_hi = par[nt - 1].r_count[r];                   \
+        }                                                               \
+                                                                        \
+        pld_hash_map_par_run(nt, _name ## _fill_task, par,              \
+                             sizeof(*par));                             \
+        if (_name ## _par_finish(pp, par, nt) < 0)                      \
+                goto free_pp;                                           \
+                                                                        \
+        goto free_ent;                                                  \
+                                                                        \
+free_pp:                                                                \
+        _name ## _free(&pp);                                            \
+                                                                        \
+free_ent:                                                               \
+        free(ent);                                                      \
+        ent = NULL;                                                     \
+        free(count);                                                    \
+        count = NULL;                                                   \
+        free(par);                                                      \
+        par = NULL;                                                     \
+                                                                        \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Mark one range of slots never occupied:                              \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL                                                      \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _clear_task(void *arg)                                         \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+                                                                        \
+        memset(&rp->r_dst->p_meta[rp->r_start],                         \
+               PLD_HASH_MAP_META(PLD_HASH_MAP_NEVER),                   \
+               rp->r_end - rp->r_start);                                \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Remove all entries of _name{} on several threads:                    \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:       pointer to _name{}                                       \
+ *  @nthreads: most threads to use                                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  keeps capacity; only p_meta is written, a page at a time per thread \
+ */                                                                     \
+static inline int                                                       \
+_name ## _clear_parallel(struct _name *pp, int nthreads)                \
+{                                                                       \
+        struct _name ## _par *par = NULL;                               \
+        hash_map_size_t span = 0;                                       \
+        int n = pld_hash_map_par_threads(nthreads, pp->p_cap);          \
+        int t = 0;                                                      \
+                                                                        \
+        par = calloc((size_t)n, sizeof(*par));                          \
+        if (par == NULL)                                                \
+                return -1;                                              \
+                                                                        \
+        if (pp->p_old != NULL)                                          \
+                _name ## _free(&pp->p_old);                             \
+        pp->p_mig = 0;                                                  \
+                                                                        \
+        span = pp->p_cap / (hash_map_size_t)n;                          \
+        for (t = 0; t < n; t++) {                                       \
+                par[t].r_dst = pp;                                      \
+                par[t].r_start = span * (hash_map_size_t)t;             \
+                par[t].r_end = par[t].r_start + span;                   \
+        }                                                               \
+                                                                        \
+        pld_hash_map_par_run(n, _name ## _clear_task, par,              \
+                             sizeof(*par));                             \
+                                                                        \
+        if (((_flags) & PLD_HASH_MAP_SIMD) == PLD_HASH_MAP_SIMD)        \
+                memset(&pp->p_meta[pp->p_cap],                          \
+                       PLD_HASH_MAP_META(PLD_HASH_MAP_NEVER),           \
+                       PLD_HASH_MAP_GROUP);                             \
+                                                                        \
+        pp->p_len = 0;                                                  \
+        pp->p_was = 0;                                                  \
+                                                                        \
+        free(par);                                                      \
+        par = NULL;                                                     \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Call back on the entries of one range of slots:                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @arg: pointer to _name_par{} of thread                              \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: NULL                                                      \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void *                                                    \
+_name ## _foreach_task(void *arg)                                       \
+{                                                                       \
+        struct _name ## _par *rp = arg;                                 \
+        const struct _name *pp = rp->r_dst;                             \
+        const struct _name *up = NULL;                                  \
+        const struct _name *old = NULL;                                 \
+        hash_map_size_t lo = 0;                                         \
+        hash_map_size_t hi = 0;                                         \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        for (i = _name ## _scan(pp, rp->r_start, PLD_HASH_MAP_WAS);     \
+             i < rp->r_end;                                             \
+             i = _name ## _scan(pp, i + 1, PLD_HASH_MAP_WAS))           \
+                rp->r_fn(*_name ## _key_at(pp, i),                      \
+                         _name ## _val_at(pp, i), rp->r_t, rp->r_ctx);  \
+                                                                        \
+        /* slots of tables being migrated from, as far as not moved */  \
+        for (up = pp; up->p_old != NULL; up = up->p_old) {              \
+                old = up->p_old;                                        \
+                lo = pld_hash_map_par_scale(rp->r_start, pp->p_cap,     \
+                                            old->p_cap);                \
+                hi = pld_hash_map_par_scale(rp->r_end, pp->p_cap,       \
+                                            old->p_cap);                \
+                if (lo < up->p_mig)                                     \
+                        lo = up->p_mig;                                 \
+                for (i = lo; i < hi; i++) {                             \
+                        if (_name ## _get_meta(old, i) >=               \
+                            PLD_HASH_MAP_WAS)                           \
+                                continue;                               \
+                        rp->r_fn(*_name ## _key_at(old, i),             \
+                                 _name ## _val_at(old, i), rp->r_t,     \
+                                 rp->r_ctx);                            \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        return NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Call back on every entry of _name{} on several threads:              \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:       pointer to _name{}                                       \
+ *  @fn:       called with key, pointer to value, index of the calling  \
+ *             thread below nthreads, and ctx, from several threads at  \
+ *             once; may change the value but not the map               \
+ *  @ctx:      passed through to fn                                     \
+ *  @nthreads: most threads to use                                      \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  each thread walks its own range of slots, so fn can keep a result   \
+ *  per thread index and the caller merge them after                    \
+ */                                                                     \
+static inline int                                                       \
+_name ## _foreach_parallel(struct _name *pp,                            \
+                           void (*fn)(_k, _v *, int, void *),           \
+                           void *ctx, int nthreads)                     \
+{                                                                       \
+        struct _name ## _par *par = NULL;                               \
+        hash_map_size_t span = 0;                                       \
+        int n = pld_hash_map_par_threads(nthreads, pp->p_cap);          \
+        int t = 0;                                                      \
+                                                                        \
+        par = calloc((size_t)n, sizeof(*par));                          \
+        if (par == NULL)                                                \
+                return -1;                                              \
+                                                                        \
+        span = pp->p_cap / (hash_map_size_t)n;                          \
+        for (t = 0; t < n; t++) {                                       \
+                par[t].r_dst = pp;                                      \
+                par[t].r_start = span * (hash_map_size_t)t;             \
+                par[t].r_end = par[t].r_start + span;                   \
+                par[t].r_t = t;                                         \
+                par[t].r_fn = fn;                                       \
+                par[t].r_ctx = ctx;                                     \
+        }                                                               \
+                                                                        \
+        pld_hash_map_par_run(n, _name ## _foreach_task, par,            \
+                             sizeof(*par));                             \
+                                                                        \
+        free(par);                                                      \
+        par = NULL;                                                     \
+                                                                        \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef PLD_HASH_MAP_PAR_H */
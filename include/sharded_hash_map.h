@@ -0,0 +1,555 @@
+#ifndef SHARDED_HASH_MAP_H
+#define SHARDED_HASH_MAP_H
+
+#include "pld_hash_map.h"
+#include "util.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* #if defined(__SSE2__) */
+
+/* log2 of shard count of sharded_hash_map, 1 to 16 */
+#ifndef SHARDED_HASH_MAP_SHARD_BITS
+#define SHARDED_HASH_MAP_SHARD_BITS 6
+#endif /* #ifndef SHARDED_HASH_MAP_SHARD_BITS */
+
+/* misc. constants */
+enum {
+        SHARDED_HASH_MAP_SHARDS   = 1 << SHARDED_HASH_MAP_SHARD_BITS,
+        SHARDED_HASH_MAP_LINE     = 64, /* shards never share a line */
+        SHARDED_HASH_MAP_MAX_DEAD = 64, /* retired tables a shard keeps */
+        SHARDED_HASH_MAP_SPINS    = 64, /* pauses before a reader yields */
+        SHARDED_HASH_MAP_READERS  = 64, /* reader slots, one line each */
+};
+
+/*
+ * readers may still be in any table a shard had, so only the shard
+ * swaps tables, retiring the old one: shard tables are
+ * PLD_HASH_MAP_NOGROW, so an insert that would probe too far fails
+ * rather than growing (and freeing) the table itself, and never
+ * PLD_HASH_MAP_INCREMENTAL, which frees p_old while migrating
+ */
+#define SHARDED_HASH_MAP_FLAGS                                          \
+        (PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOGROW)
+
+/**
+ * Get shard of a hash:
+ *
+ * Arguments:
+ *  @hash: hash of key
+ *
+ * Returns:
+ *  @success: shard in [0, SHARDED_HASH_MAP_SHARDS)
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+sharded_hash_map_shard(hash_map_size_t hash)
+{
+        /*
+         * high bits of the product mix in every bit of the hash, so
+         * they stay apart from the low bits picking the home slot
+         */
+        return (hash * 0x9e3779b97f4a7c15ULL) >>
+               (64 - SHARDED_HASH_MAP_SHARD_BITS);
+}
+
+/**
+ * Back off while a writer holds a shard:
+ *
+ * Arguments:
+ *  @spins: times backed off so far
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+sharded_hash_map_relax(unsigned int *spins)
+{
+        /* the writer may have been preempted, let it run */
+        if (++*spins % SHARDED_HASH_MAP_SPINS == 0) {
+                sched_yield();
+                return;
+        }
+
+#if defined(__SSE2__)
+        _mm_pause();
+#endif /* #if defined(__SSE2__) */
+}
+
+/**
+ * Get reader slot the calling thread tries first:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: slot, the same for every call of a thread
+ *  @failure: does not
+ *
+ * Notes:
+ *  threads are numbered as they first read, so up to
+ *  SHARDED_HASH_MAP_READERS threads started together own a slot each
+ */
+static inline unsigned int
+sharded_hash_map_hint(void)
+{
+        static _Thread_local unsigned int hint = 0; /* slot + 1, or 0 */
+        static unsigned int next = 0;
+
+        if (unlikely(hint == 0))
+                hint = __atomic_add_fetch(&next, 1, __ATOMIC_RELAXED);
+
+        return (hint - 1) % SHARDED_HASH_MAP_READERS;
+}
+
+/**
+ * Define a new hash table safe to share between threads:
+ *
+ * Arguments:
+ *  @_k:    key type
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *  @_hash: hash function
+ *  @_cmp:  key comparison function
+ *
+ * Notes:
+ *  keys are spread over SHARDED_HASH_MAP_SHARDS pld_hash_map tables,
+ *  each resized on its own; writers take the shard mutex and bump the
+ *  shard seqlock, readers take no lock and retry when the seqlock
+ *  moved under them, so _cmp must cope with a key being overwritten
+ *  while it compares (plain values do). A reader holds a slot of its
+ *  own cache line naming the shard it probes, so a table a writer
+ *  grew out of is kept until a later grow finds no slot naming the
+ *  shard (see _reap()); shards never shrink
+ */
+#define SHARDED_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)             \
+                                                                        \
+PLD_HASH_MAP_DEFINE_FLAGS(_k, _v, _name ## _tbl, _hash, _cmp,           \
+                          SHARDED_HASH_MAP_FLAGS)                       \
+                                                                        \
+/* shard of _name{} */                                                  \
+struct _name ## _shard {                                                \
+        _Alignas(SHARDED_HASH_MAP_LINE)                                 \
+        uint64_t              s_seq;   /* odd while a writer is in */   \
+        struct _name ## _tbl *s_tbl;   /* table readers look in */      \
+        pthread_mutex_t       s_lock;  /* taken by writers */           \
+        unsigned int          s_ndead; /* retired tables not freed */   \
+        struct _name ## _tbl *s_dead[SHARDED_HASH_MAP_MAX_DEAD];        \
+};                                                                      \
+                                                                        \
+/* reader slot of _name{}, alone on its line */                         \
+struct _name ## _reader {                                               \
+        _Alignas(SHARDED_HASH_MAP_LINE)                                 \
+        struct _name ## _shard *r_shard; /* shard probed, or NULL */    \
+};                                                                      \
+                                                                        \
+/* sharded hash table */                                                \
+struct _name {                                                          \
+        struct _name ## _shard  s_shard[SHARDED_HASH_MAP_SHARDS];       \
+        struct _name ## _reader s_reader[SHARDED_HASH_MAP_READERS];     \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial capacity over all shards (or 0 for default)           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = aligned_alloc(SHARDED_HASH_MAP_LINE,         \
+                                         sizeof(*pp));                  \
+        struct _name ## _shard *sp = NULL;                              \
+        int i = 0;                                                      \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        memset(pp, 0, sizeof(*pp));                                     \
+        cap /= SHARDED_HASH_MAP_SHARDS;                                 \
+                                                                        \
+        for (i = 0; i < SHARDED_HASH_MAP_SHARDS; i++) {                 \
+                sp = &pp->s_shard[i];                                   \
+                sp->s_tbl = _name ## _tbl_new(cap);                     \
+                if (sp->s_tbl == NULL)                                  \
+                        goto free_shards;                               \
+                pthread_mutex_init(&sp->s_lock, NULL);                  \
+        }                                                               \
+        goto ret;                                                       \
+                                                                        \
+free_shards:                                                            \
+        while (i-- > 0) {                                               \
+                sp = &pp->s_shard[i];                                   \
+                pthread_mutex_destroy(&sp->s_lock);                     \
+                _name ## _tbl_free(&sp->s_tbl);                         \
+        }                                                               \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  no other thread may use _name{} any more                            \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name ## _shard *sp = NULL;                              \
+        struct _name *pp = *ppp;                                        \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < SHARDED_HASH_MAP_SHARDS; i++) {                 \
+                sp = &pp->s_shard[i];                                   \
+                while (sp->s_ndead > 0)                                 \
+                        _name ## _tbl_free(&sp->s_dead[--sp->s_ndead]); \
+                _name ## _tbl_free(&sp->s_tbl);                         \
+                pthread_mutex_destroy(&sp->s_lock);                     \
+        }                                                               \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries, writers may change it meanwhile        \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(struct _name *pp)                                         \
+{                                                                       \
+        struct _name ## _shard *sp = NULL;                              \
+        hash_map_size_t len = 0;                                        \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < SHARDED_HASH_MAP_SHARDS; i++) {                 \
+                sp = &pp->s_shard[i];                                   \
+                pthread_mutex_lock(&sp->s_lock);                        \
+                len += _name ## _tbl_len(sp->s_tbl);                    \
+                pthread_mutex_unlock(&sp->s_lock);                      \
+        }                                                               \
+                                                                        \
+        return len;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Lock shard of _name{} for writing:                                   \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @sp: pointer to _name_shard{}                                       \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _lock(struct _name ## _shard *sp)                              \
+{                                                                       \
+        pthread_mutex_lock(&sp->s_lock);                                \
+        __atomic_store_n(&sp->s_seq, sp->s_seq + 1, __ATOMIC_RELAXED);  \
+        __atomic_thread_fence(__ATOMIC_RELEASE);                        \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unlock shard of _name{} after writing:                               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @sp: pointer to _name_shard{}                                       \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _unlock(struct _name ## _shard *sp)                            \
+{                                                                       \
+        __atomic_store_n(&sp->s_seq, sp->s_seq + 1, __ATOMIC_RELEASE);  \
+        pthread_mutex_unlock(&sp->s_lock);                              \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Take a reader slot of _name{}:                                       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @sp: pointer to _name_shard{} about to be probed                    \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name_reader{} now naming sp                   \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a thread writes only its own slot's line, unless more threads than  \
+ *  SHARDED_HASH_MAP_READERS read at once and it has to look further    \
+ */                                                                     \
+static inline struct _name ## _reader *                                 \
+_name ## _enter(struct _name *pp, struct _name ## _shard *sp)           \
+{                                                                       \
+        struct _name ## _shard *none = NULL;                            \
+        struct _name ## _reader *rp = NULL;                             \
+        unsigned int i = sharded_hash_map_hint();                       \
+        unsigned int spins = 0;                                         \
+                                                                        \
+        for (;;) {                                                      \
+                rp = &pp->s_reader[i];                                  \
+                none = NULL;                                            \
+                if (__atomic_compare_exchange_n(&rp->r_shard, &none,    \
+                                                sp, false,              \
+                                                __ATOMIC_SEQ_CST,       \
+                                                __ATOMIC_RELAXED))      \
+                        return rp;                                      \
+                i = (i + 1) % SHARDED_HASH_MAP_READERS;                 \
+                sharded_hash_map_relax(&spins);                         \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free tables a locked shard of _name{} retired:                       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @sp:   pointer to _name_shard{}                                     \
+ *  @wait: whether to wait for readers to leave rather than give up     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a reader names sp in a slot before it loads s_tbl, and a retired    \
+ *  table was swapped out of s_tbl before the slots are read, so once   \
+ *  no slot names sp no reader is left in one: readers to come see      \
+ *  the odd seqlock or the new table. Readers never wait while they     \
+ *  hold a slot, so waiting here ends                                   \
+ */                                                                     \
+static inline void                                                      \
+_name ## _reap(struct _name *pp, struct _name ## _shard *sp, bool wait) \
+{                                                                       \
+        unsigned int spins = 0;                                         \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < SHARDED_HASH_MAP_READERS; i++) {                \
+                while (__atomic_load_n(&pp->s_reader[i].r_shard,        \
+                                       __ATOMIC_SEQ_CST) == sp) {       \
+                        if (!wait)                                      \
+                                return;                                 \
+                        sharded_hash_map_relax(&spins);                 \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        while (sp->s_ndead > 0)                                         \
+                _name ## _tbl_free(&sp->s_dead[--sp->s_ndead]);         \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Double capacity of a locked shard of _name{}:                        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @sp: pointer to _name_shard{}                                       \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  like _tbl_grow(), but the old table is retired instead of freed,    \
+ *  and retired tables no reader is left in are freed                   \
+ */                                                                     \
+static inline int                                                       \
+_name ## _grow(struct _name *pp, struct _name ## _shard *sp)            \
+{                                                                       \
+        struct _name ## _tbl *tp = sp->s_tbl;                           \
+        struct _name ## _tbl *newpp = NULL;                             \
+                                                                        \
+        if (unlikely(sp->s_ndead == SHARDED_HASH_MAP_MAX_DEAD))         \
+                _name ## _reap(pp, sp, true);                           \
+                                                                        \
+        newpp = _name ## _tbl_new(tp->p_cap << 1);                      \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+        if (_name ## _tbl_move(newpp, tp, 0, tp->p_len) < 0) {          \
+                _name ## _tbl_free(&newpp);                             \
+                errno = EOVERFLOW;                                      \
+                return -1;                                              \
+        }                                                               \
+                                                                        \
+        newpp->p_len = tp->p_len;                                       \
+        sp->s_dead[sp->s_ndead++] = tp;                                 \
+        __atomic_store_n(&sp->s_tbl, newpp, __ATOMIC_SEQ_CST);          \
+        _name ## _reap(pp, sp, false);                                  \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *  @vp: where to copy value                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @true:  if key was found                                            \
+ *  @false: if not                                                      \
+ */                                                                     \
+static inline bool                                                      \
+_name ## _get(struct _name *pp, _k k, _v *vp)                           \
+{                                                                       \
+        hash_map_size_t hash = _hash(k);                                \
+        struct _name ## _shard *sp =                                    \
+                &pp->s_shard[sharded_hash_map_shard(hash)];             \
+        struct _name ## _reader *rp = NULL;                             \
+        struct _name ## _tbl *tp = NULL;                                \
+        hash_map_size_t i = 0;                                          \
+        uint64_t seq = 0;                                               \
+        unsigned int spins = 0;                                         \
+        _v v;                                                           \
+                                                                        \
+        memset(&v, 0, sizeof(v));                                       \
+        for (;;) {                                                      \
+                seq = __atomic_load_n(&sp->s_seq, __ATOMIC_ACQUIRE);    \
+                if (unlikely(seq & 1)) {                                \
+                        sharded_hash_map_relax(&spins);                 \
+                        continue;                                       \
+                }                                                       \
+                                                                        \
+                /* while rp names sp, its table is not freed */         \
+                rp = _name ## _enter(pp, sp);                           \
+                tp = __atomic_load_n(&sp->s_tbl, __ATOMIC_SEQ_CST);     \
+                i = _name ## _tbl_find(tp, hash, k,                     \
+                                       PLD_HASH_MAP_OP_GET);            \
+                if (i != PLD_HASH_MAP_NOT_FOUND)                        \
+                        v = *_name ## _tbl_val_at(tp, i);               \
+                __atomic_store_n(&rp->r_shard, NULL, __ATOMIC_RELEASE); \
+                                                                        \
+                /* what was read is only good if no writer came */      \
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);                \
+                if (__atomic_load_n(&sp->s_seq,                         \
+                                    __ATOMIC_RELAXED) == seq)           \
+                        break;                                          \
+        }                                                               \
+                                                                        \
+        if (i == PLD_HASH_MAP_NOT_FOUND)                                \
+                return false;                                           \
+                                                                        \
+        *vp = v;                                                        \
+        return true;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] = v in _name{}:                                           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *  @v:  value                                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name *pp, _k k, _v v)                             \
+{                                                                       \
+        hash_map_size_t hash = _hash(k);                                \
+        struct _name ## _shard *sp =                                    \
+                &pp->s_shard[sharded_hash_map_shard(hash)];             \
+        struct _name ## _tbl *tp = NULL;                                \
+        bool grown = false;                                             \
+        int ret = 0;                                                    \
+                                                                        \
+        _name ## _lock(sp);                                             \
+                                                                        \
+        if (unlikely(_name ## _tbl_need_to_grow(sp->s_tbl)))            \
+                ret = _name ## _grow(pp, sp);                             \
+                                                                        \
+        /*                                                              \
+         * the table fails an insert that would probe too far; a table  \
+         * at least 1/8 full is grown once, as _tbl_relieve() would,    \
+         * but a sparser one, or one full of the key's twins (see       \
+         * _tbl_twins()), holds keys no growing separates               \
+         */                                                             \
+        while (ret == 0) {                                              \
+                ret = _name ## _tbl_set_hash(&sp->s_tbl, hash, k, v);   \
+                tp = sp->s_tbl;                                         \
+                if (ret == 0 || errno != EOVERFLOW || grown ||          \
+                    _name ## _tbl_len(tp) < (tp->p_cap >> 3) ||         \
+                    _name ## _tbl_twins(tp, _name ## _tbl_seed_hash(tp, \
+                                        hash)) >                        \
+                    PLD_HASH_MAP_PROBE_LIMIT(SHARDED_HASH_MAP_FLAGS))   \
+                        break;                                          \
+                                                                        \
+                grown = true;                                           \
+                ret = _name ## _grow(pp, sp);                             \
+        }                                                               \
+                                                                        \
+        _name ## _unlock(sp);                                           \
+        return ret;                                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] in _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name *pp, _k k)                                 \
+{                                                                       \
+        hash_map_size_t hash = _hash(k);                                \
+        struct _name ## _shard *sp =                                    \
+                &pp->s_shard[sharded_hash_map_shard(hash)];             \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        _name ## _lock(sp);                                             \
+                                                                        \
+        /* _tbl_unset() may shrink, freeing the table under readers */  \
+        i = _name ## _tbl_find(sp->s_tbl, hash, k,                      \
+                               PLD_HASH_MAP_OP_UNSET);                  \
+        if (i != PLD_HASH_MAP_NOT_FOUND)                                \
+                _name ## _tbl_remove(sp->s_tbl, i);                     \
+                                                                        \
+        _name ## _unlock(sp);                                           \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef SHARDED_HASH_MAP_H */
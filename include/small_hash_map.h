@@ -0,0 +1,428 @@
+#ifndef SMALL_HASH_MAP_H
+#define SMALL_HASH_MAP_H
+
+#include "pld_hash_map.h"
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* entries kept in the struct before a map spills to a table */
+#ifndef SMALL_HASH_MAP_INLINE
+#define SMALL_HASH_MAP_INLINE 8
+#endif /* #ifndef SMALL_HASH_MAP_INLINE */
+
+/*
+ * spilled maps are grown past SMALL_HASH_MAP_INLINE entries one insert
+ * at a time and rarely drain, so tables backshift and never shrink
+ */
+#define SMALL_HASH_MAP_FLAGS                                            \
+        (PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOSHRINK)
+
+/**
+ * Define a new hash table for maps that mostly hold a few entries:
+ *
+ * Arguments:
+ *  @_k:    key type
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *  @_hash: hash function
+ *  @_cmp:  key comparison function
+ *
+ * Notes:
+ *  up to SMALL_HASH_MAP_INLINE entries sit in arrays inside _name{}
+ *  and are found by comparing keys one after the other, without
+ *  hashing; the insert past that moves them to a pld_hash_map, which
+ *  the map keeps until _fini(). _name{} may be embedded in another
+ *  struct with _init() and _fini(), so an empty or small map costs
+ *  no allocation at all
+ */
+#define SMALL_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)               \
+                                                                        \
+PLD_HASH_MAP_DEFINE_FLAGS(_k, _v, _name ## _tbl, _hash, _cmp,           \
+                          SMALL_HASH_MAP_FLAGS)                         \
+                                                                        \
+/* hash table with inline storage for a few entries */                  \
+struct _name {                                                          \
+        struct _name ## _tbl *s_tbl; /* table once spilled, or NULL */  \
+        uint32_t              s_len; /* inline entry count */           \
+        _k s_key[SMALL_HASH_MAP_INLINE]; /* inline keys */              \
+        _v s_val[SMALL_HASH_MAP_INLINE]; /* inline values */            \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Initialize an empty _name{} in place:                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _init(struct _name *pp)                                        \
+{                                                                       \
+        pp->s_tbl = NULL;                                               \
+        pp->s_len = 0;                                                  \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Release storage of a _name{} set up by _init():                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: _name{} empty, as after _init()                           \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _fini(struct _name *pp)                                        \
+{                                                                       \
+        if (pp->s_tbl != NULL)                                          \
+                _name ## _tbl_free(&pp->s_tbl);                         \
+                                                                        \
+        pp->s_len = 0;                                                  \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Move entries of _name{} from inline storage to a table:              \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, entries left inline                     \
+ */                                                                     \
+static inline int                                                       \
+_name ## _spill(struct _name *pp)                                       \
+{                                                                       \
+        struct _name ## _tbl *tp = NULL;                                \
+        uint32_t i = 0;                                                 \
+                                                                        \
+        tp = _name ## _tbl_new(_name ## _tbl_cap_for(                   \
+                        SMALL_HASH_MAP_INLINE * 2));                    \
+        if (tp == NULL)                                                 \
+                return -1;                                              \
+                                                                        \
+        /* room for twice the entries, so no insert can grow */         \
+        for (i = 0; i < pp->s_len; i++) {                               \
+                if (_name ## _tbl_set(&tp, pp->s_key[i],                \
+                                      pp->s_val[i]) < 0)                \
+                        goto free_tp;                                   \
+        }                                                               \
+                                                                        \
+        pp->s_tbl = tp;                                                 \
+        pp->s_len = 0;                                                  \
+        return 0;                                                       \
+                                                                        \
+free_tp:                                                                \
+        _name ## _tbl_free(&tp);                                        \
+        return -1;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial capacity (or 0 for default)                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a cap above SMALL_HASH_MAP_INLINE starts out on a table             \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = malloc(sizeof(*pp));                         \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        _name ## _init(pp);                                             \
+        if (cap <= SMALL_HASH_MAP_INLINE)                               \
+                goto ret;                                               \
+                                                                        \
+        pp->s_tbl = _name ## _tbl_new(cap);                             \
+        if (pp->s_tbl == NULL)                                          \
+                goto free_pp;                                           \
+        goto ret;                                                       \
+                                                                        \
+free_pp:                                                                \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        _name ## _fini(pp);                                             \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        if (pp->s_tbl != NULL)                                          \
+                return _name ## _tbl_len(pp->s_tbl);                    \
+                                                                        \
+        return pp->s_len;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find a key in inline storage of _name{}:                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: index of k in s_key                                       \
+ *  @failure: PLD_HASH_MAP_NOT_FOUND                                    \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find(const struct _name *pp, _k k)                            \
+{                                                                       \
+        uint32_t i = 0;                                                 \
+                                                                        \
+        for (i = 0; i < pp->s_len; i++) {                               \
+                if (_cmp(pp->s_key[i], k) == 0)                         \
+                        return i;                                       \
+        }                                                               \
+                                                                        \
+        return PLD_HASH_MAP_NOT_FOUND;                                  \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, _k k)                             \
+{                                                                       \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (pp->s_tbl != NULL)                                          \
+                return _name ## _tbl_get(pp->s_tbl, k);                 \
+                                                                        \
+        i = _name ## _find(pp, k);                                      \
+        if (i == PLD_HASH_MAP_NOT_FOUND)                                \
+                return NULL;                                            \
+                                                                        \
+        return (_v *)&pp->s_val[i];                                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find map[k] in _name{}, inserting k with v if missing:               \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @k:        key                                                      \
+ *  @v:        value to insert with k if k is not in map                \
+ *  @inserted: where to save true if k was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of k, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _insert(struct _name **ppp, _k k, _v v, bool *inserted)        \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (pp->s_tbl == NULL) {                                        \
+                i = _name ## _find(pp, k);                              \
+                if (i != PLD_HASH_MAP_NOT_FOUND) {                      \
+                        *inserted = false;                              \
+                        return &pp->s_val[i];                           \
+                }                                                       \
+                                                                        \
+                if (pp->s_len < SMALL_HASH_MAP_INLINE) {                \
+                        i = pp->s_len++;                                \
+                        pp->s_key[i] = k;                               \
+                        pp->s_val[i] = v;                               \
+                        *inserted = true;                               \
+                        return &pp->s_val[i];                           \
+                }                                                       \
+                                                                        \
+                if (_name ## _spill(pp) < 0)                            \
+                        return NULL;                                    \
+        }                                                               \
+                                                                        \
+        return _name ## _tbl_insert_hash(&pp->s_tbl, _hash(k), k, v,    \
+                                         inserted);                     \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}, inserting a zeroed value if missing:        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @k:        key                                                      \
+ *  @inserted: where to save true if k was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of k, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get_or_insert(struct _name **ppp, _k k, bool *inserted)       \
+{                                                                       \
+        _v v;                                                           \
+                                                                        \
+        memset(&v, 0, sizeof(v));                                       \
+        return _name ## _insert(ppp, k, v, inserted);                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] to v _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, _k k, _v v)                           \
+{                                                                       \
+        bool inserted = false;                                          \
+        _v *vp = _name ## _insert(ppp, k, v, &inserted);                \
+                                                                        \
+        if (vp == NULL)                                                 \
+                return -1;                                              \
+                                                                        \
+        if (!inserted)                                                  \
+                *vp = v;                                                \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  the last inline entry fills the hole, so order is not kept          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, _k k)                               \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (pp->s_tbl != NULL)                                          \
+                return _name ## _tbl_unset(&pp->s_tbl, k);              \
+                                                                        \
+        i = _name ## _find(pp, k);                                      \
+        if (i == PLD_HASH_MAP_NOT_FOUND)                                \
+                return 0;                                               \
+                                                                        \
+        pp->s_len--;                                                    \
+        pp->s_key[i] = pp->s_key[pp->s_len];                            \
+        pp->s_val[i] = pp->s_val[pp->s_len];                            \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Call back on every entry of _name{}:                                 \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @fn:  called with key, pointer to value and ctx; may change the     \
+ *        value but not the map                                         \
+ *  @ctx: passed through to fn                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _foreach(struct _name *pp, void (*fn)(_k, _v *, void *),       \
+                  void *ctx)                                            \
+{                                                                       \
+        uint32_t i = 0;                                                 \
+                                                                        \
+        if (pp->s_tbl != NULL) {                                        \
+                _name ## _tbl_foreach(pp->s_tbl, fn, ctx);              \
+                return;                                                 \
+        }                                                               \
+                                                                        \
+        for (i = 0; i < pp->s_len; i++)                                 \
+                fn(pp->s_key[i], &pp->s_val[i], ctx);                   \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get bytes held by _name{}:                                           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: size of _name{} plus its table block, if spilled          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline size_t                                                    \
+_name ## _bytes(const struct _name *pp)                                 \
+{                                                                       \
+        if (pp->s_tbl != NULL)                                          \
+                return sizeof(*pp) + pp->s_tbl->p_size;                 \
+                                                                        \
+        return sizeof(*pp);                                             \
+}
+
+#endif /* #ifndef SMALL_HASH_MAP_H */
@@ -0,0 +1,544 @@
+#ifndef STR_HASH_MAP_H
+#define STR_HASH_MAP_H
+
+#include "hash_func.h"
+#include "pld_hash_map.h"
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* bytes of a key kept in its slot, longer keys go to the arena */
+#ifndef STR_HASH_MAP_INLINE
+#define STR_HASH_MAP_INLINE 20
+#endif /* #ifndef STR_HASH_MAP_INLINE */
+
+/* bytes of an arena chunk, longer keys get a chunk of their own */
+#ifndef STR_HASH_MAP_CHUNK
+#define STR_HASH_MAP_CHUNK (1 << 16)
+#endif /* #ifndef STR_HASH_MAP_CHUNK */
+
+/*
+ * the key carries its hash, so PLD_HASH_MAP_NOHASH gets it back for
+ * free, and AOS keeps key and value on one line; the bytes are hashed
+ * with a secret seed drawn per map, so chosen keys cannot be made to
+ * share a hash, and the table seed mixed into that finished hash
+ * spreads strings that only share home slots without rehashing bytes
+ */
+#define STR_HASH_MAP_FLAGS                                              \
+        (PLD_HASH_MAP_NOHASH | PLD_HASH_MAP_AOS |                       \
+         PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_SEEDED)
+
+/* key of str_hash_map */
+struct str_hash_map_key {
+        hash_map_size_t k_hash; /* hash of bytes */
+        uint32_t        k_len;  /* number of bytes */
+        char            k_str[STR_HASH_MAP_INLINE]; /* bytes, or pointer
+                                                     * to them if longer */
+};
+
+/* chunk of str_hash_map_arena */
+struct str_hash_map_chunk {
+        struct str_hash_map_chunk *c_next; /* chunk filled before */
+        size_t                     c_size; /* bytes in c_data */
+        size_t                     c_used; /* bytes handed out */
+        char                       c_data[]; /* key bytes */
+};
+
+/* bump allocator of long key bytes */
+struct str_hash_map_arena {
+        struct str_hash_map_chunk *a_head; /* chunk handed out from */
+        size_t                     a_used; /* bytes handed out */
+        size_t                     a_dead; /* bytes of unset keys */
+};
+
+/**
+ * Get bytes of a str_hash_map key:
+ *
+ * Arguments:
+ *  @kp: pointer to str_hash_map_key{}
+ *
+ * Returns:
+ *  @success: pointer to k_len bytes
+ *  @failure: does not
+ */
+static inline const char *
+str_hash_map_key_str(const struct str_hash_map_key *kp)
+{
+        const char *s = NULL;
+
+        if (kp->k_len <= STR_HASH_MAP_INLINE)
+                return kp->k_str;
+
+        memcpy(&s, kp->k_str, sizeof(s));
+        return s;
+}
+
+/**
+ * Make a str_hash_map key of a string:
+ *
+ * Arguments:
+ *  @kp:   pointer to str_hash_map_key{} to fill
+ *  @s:    bytes, must outlive the key if longer than STR_HASH_MAP_INLINE
+ *  @len:  number of bytes
+ *  @seed: seed of hash_bytes()
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set
+ */
+static inline int
+str_hash_map_key_make(struct str_hash_map_key *kp, const char *s,
+                      size_t len, uint64_t seed)
+{
+        if (len > UINT32_MAX) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        kp->k_hash = hash_bytes(s, len, seed);
+        kp->k_len = (uint32_t)len;
+        if (len <= STR_HASH_MAP_INLINE)
+                memcpy(kp->k_str, s, len);
+        else
+                memcpy(kp->k_str, &s, sizeof(s));
+
+        return 0;
+}
+
+/**
+ * Get hash of a str_hash_map key:
+ *
+ * Arguments:
+ *  @k: key
+ *
+ * Returns:
+ *  @success: hash saved in key
+ *  @failure: does not
+ */
+static inline hash_map_size_t
+str_hash_map_key_hash(struct str_hash_map_key k)
+{
+        return k.k_hash;
+}
+
+/**
+ * Compare two str_hash_map keys:
+ *
+ * Arguments:
+ *  @a: key
+ *  @b: key
+ *
+ * Returns:
+ *  @success: 0 if equal, non-zero if not
+ *  @failure: does not
+ *
+ * Notes:
+ *  hashes and lengths are compared before any byte is
+ */
+static inline int
+str_hash_map_key_cmp(struct str_hash_map_key a, struct str_hash_map_key b)
+{
+        if (a.k_hash != b.k_hash || a.k_len != b.k_len)
+                return 1;
+
+        return memcmp(str_hash_map_key_str(&a), str_hash_map_key_str(&b),
+                      a.k_len);
+}
+
+/**
+ * Hand out bytes of a str_hash_map arena:
+ *
+ * Arguments:
+ *  @ap: pointer to str_hash_map_arena{}
+ *  @n:  number of bytes
+ *
+ * Returns:
+ *  @success: pointer to n bytes, valid until str_hash_map_arena_free()
+ *  @failure: NULL and errno set
+ */
+static inline char *
+str_hash_map_arena_alloc(struct str_hash_map_arena *ap, size_t n)
+{
+        struct str_hash_map_chunk *cp = ap->a_head;
+        size_t size = STR_HASH_MAP_CHUNK;
+
+        if (cp == NULL || cp->c_size - cp->c_used < n) {
+                if (n > size)
+                        size = n;
+                cp = malloc(sizeof(*cp) + size);
+                if (cp == NULL)
+                        return NULL;
+                cp->c_next = ap->a_head;
+                cp->c_size = size;
+                cp->c_used = 0;
+                ap->a_head = cp;
+        }
+
+        cp->c_used += n;
+        ap->a_used += n;
+        return &cp->c_data[cp->c_used - n];
+}
+
+/**
+ * Take back the last bytes handed out by a str_hash_map arena:
+ *
+ * Arguments:
+ *  @ap: pointer to str_hash_map_arena{}
+ *  @n:  number of bytes last str_hash_map_arena_alloc() handed out
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static inline void
+str_hash_map_arena_undo(struct str_hash_map_arena *ap, size_t n)
+{
+        ap->a_head->c_used -= n;
+        ap->a_used -= n;
+}
+
+/**
+ * Free all chunks of a str_hash_map arena:
+ *
+ * Arguments:
+ *  @ap: pointer to str_hash_map_arena{}
+ *
+ * Returns:
+ *  @success: arena empty
+ *  @failure: does not
+ */
+static inline void
+str_hash_map_arena_free(struct str_hash_map_arena *ap)
+{
+        struct str_hash_map_chunk *cp = ap->a_head;
+        struct str_hash_map_chunk *next = NULL;
+
+        for (; cp != NULL; cp = next) {
+                next = cp->c_next;
+                free(cp);
+        }
+
+        ap->a_head = NULL;
+        ap->a_used = 0;
+        ap->a_dead = 0;
+}
+
+/**
+ * Define a new hash table keyed by byte strings:
+ *
+ * Arguments:
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *
+ * Notes:
+ *  a pld_hash_map of str_hash_map_key{} holding the hash, the length
+ *  and up to STR_HASH_MAP_INLINE bytes in the slot; longer keys point
+ *  into an arena owned by _name{}. Bytes of unset long keys are only
+ *  reclaimed when they are half of the arena, by copying the live ones
+ *  to a new arena
+ */
+#define STR_HASH_MAP_DEFINE(_v, _name)                                  \
+                                                                        \
+PLD_HASH_MAP_DEFINE_FLAGS(struct str_hash_map_key, _v, _name ## _tbl,   \
+                          str_hash_map_key_hash, str_hash_map_key_cmp,  \
+                          STR_HASH_MAP_FLAGS)                           \
+                                                                        \
+/* hash table keyed by byte strings */                                  \
+struct _name {                                                          \
+        struct _name ## _tbl     *s_tbl;   /* table */                  \
+        struct str_hash_map_arena s_arena; /* bytes of long keys */     \
+        uint64_t                  s_seed;  /* secret seed of k_hash */  \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial capacity (or 0 for default)                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = malloc(sizeof(*pp));                         \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        memset(pp, 0, sizeof(*pp));                                     \
+        pp->s_seed = pld_hash_map_seed(pp);                             \
+        pp->s_tbl = _name ## _tbl_new(cap);                             \
+        if (pp->s_tbl == NULL)                                          \
+                goto free_pp;                                           \
+        goto ret;                                                       \
+                                                                        \
+free_pp:                                                                \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        _name ## _tbl_free(&pp->s_tbl);                                 \
+        str_hash_map_arena_free(&pp->s_arena);                          \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        return _name ## _tbl_len(pp->s_tbl);                            \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[s] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:  pointer to _name{}                                            \
+ *  @s:   key bytes                                                     \
+ *  @len: number of key bytes                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, const char *s, size_t len)        \
+{                                                                       \
+        struct str_hash_map_key k;                                      \
+                                                                        \
+        if (str_hash_map_key_make(&k, s, len, pp->s_seed) < 0)          \
+                return NULL;                                            \
+                                                                        \
+        return _name ## _tbl_get_hash(pp->s_tbl, k.k_hash, k);          \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find map[s] in _name{}, inserting s with v if missing, in one probe: \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @s:        key bytes                                                \
+ *  @len:      number of key bytes                                      \
+ *  @v:        value to insert with s if s is not in map                \
+ *  @inserted: where to save true if s was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of s, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a long key is copied to the arena up front and the copy taken back  \
+ *  if the key was already there, so the table is probed only once      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _insert(struct _name **ppp, const char *s, size_t len, _v v,   \
+                 bool *inserted)                                        \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        struct str_hash_map_key k;                                      \
+        char *copy = NULL;                                              \
+        _v *vp = NULL;                                                  \
+                                                                        \
+        if (str_hash_map_key_make(&k, s, len, pp->s_seed) < 0)          \
+                return NULL;                                            \
+                                                                        \
+        if (len > STR_HASH_MAP_INLINE) {                                \
+                copy = str_hash_map_arena_alloc(&pp->s_arena, len);     \
+                if (copy == NULL)                                       \
+                        return NULL;                                    \
+                memcpy(copy, s, len);                                   \
+                memcpy(k.k_str, &copy, sizeof(copy));                   \
+        }                                                               \
+                                                                        \
+        vp = _name ## _tbl_insert_hash(&pp->s_tbl, k.k_hash, k, v,      \
+                                       inserted);                       \
+        if (copy != NULL && (vp == NULL || !*inserted))                 \
+                str_hash_map_arena_undo(&pp->s_arena, len);             \
+                                                                        \
+        return vp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[s] from _name{}, inserting a zeroed value if missing:        \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp:      pointer to pointer to _name{}                            \
+ *  @s:        key bytes                                                \
+ *  @len:      number of key bytes                                      \
+ *  @inserted: where to save true if s was inserted, false if found     \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{} of s, valid until map is next changed     \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get_or_insert(struct _name **ppp, const char *s, size_t len,  \
+                        bool *inserted)                                 \
+{                                                                       \
+        _v v;                                                           \
+                                                                        \
+        memset(&v, 0, sizeof(v));                                       \
+        return _name ## _insert(ppp, s, len, v, inserted);              \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[s] to v _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @s:   key bytes, copied                                             \
+ *  @len: number of key bytes                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, const char *s, size_t len, _v v)      \
+{                                                                       \
+        bool inserted = false;                                          \
+        _v *vp = _name ## _insert(ppp, s, len, v, &inserted);           \
+                                                                        \
+        if (vp == NULL)                                                 \
+                return -1;                                              \
+                                                                        \
+        if (!inserted)                                                  \
+                *vp = v;                                                \
+                                                                        \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Copy live long keys of _name{} to a new arena:                       \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set, keys untouched                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  room for every live key is allocated before any key is moved        \
+ */                                                                     \
+static inline int                                                       \
+_name ## _compact(struct _name *pp)                                     \
+{                                                                       \
+        struct str_hash_map_arena arena;                                \
+        struct _name ## _tbl *tp = pp->s_tbl;                           \
+        struct str_hash_map_key *kp = NULL;                             \
+        size_t live = pp->s_arena.a_used - pp->s_arena.a_dead;          \
+        hash_map_size_t i = 0;                                          \
+        char *copy = NULL;                                              \
+                                                                        \
+        memset(&arena, 0, sizeof(arena));                               \
+        if (live > 0) {                                                 \
+                if (str_hash_map_arena_alloc(&arena, live) == NULL)     \
+                        return -1;                                      \
+                str_hash_map_arena_undo(&arena, live);                  \
+        }                                                               \
+                                                                        \
+        for (i = _name ## _tbl_scan(tp, 0, PLD_HASH_MAP_WAS);           \
+             i < tp->p_cap;                                             \
+             i = _name ## _tbl_scan(tp, i + 1, PLD_HASH_MAP_WAS)) {     \
+                kp = _name ## _tbl_key_at(tp, i);                       \
+                if (kp->k_len <= STR_HASH_MAP_INLINE)                   \
+                        continue;                                       \
+                                                                        \
+                copy = str_hash_map_arena_alloc(&arena, kp->k_len);     \
+                memcpy(copy, str_hash_map_key_str(kp), kp->k_len);      \
+                memcpy(kp->k_str, &copy, sizeof(copy));                 \
+        }                                                               \
+                                                                        \
+        str_hash_map_arena_free(&pp->s_arena);                          \
+        pp->s_arena = arena;                                            \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[s] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @s:   key bytes                                                     \
+ *  @len: number of key bytes                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, const char *s, size_t len)          \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        struct str_hash_map_arena *ap = &pp->s_arena;                   \
+        struct str_hash_map_key k;                                      \
+        hash_map_size_t cap = pp->s_tbl->p_cap;                         \
+        hash_map_size_t i = 0;                                          \
+                                                                        \
+        if (str_hash_map_key_make(&k, s, len, pp->s_seed) < 0)          \
+                return -1;                                              \
+                                                                        \
+        /* a shrink that would overflow displacement is skipped */      \
+        if (unlikely(_name ## _tbl_need_to_shrink(pp->s_tbl)) &&        \
+            _name ## _tbl_resize(&pp->s_tbl, cap >> 1) < 0 &&           \
+            errno != EOVERFLOW)                                         \
+                return -1;                                              \
+                                                                        \
+        i = _name ## _tbl_find(pp->s_tbl, k.k_hash, k,                  \
+                               PLD_HASH_MAP_OP_UNSET);                  \
+        if (i == PLD_HASH_MAP_NOT_FOUND)                                \
+                return 0;                                               \
+                                                                        \
+        _name ## _tbl_remove(pp->s_tbl, i);                             \
+        if (len <= STR_HASH_MAP_INLINE)                                 \
+                return 0;                                               \
+                                                                        \
+        /* a failed compaction leaves the dead bytes to the next */     \
+        ap->a_dead += len;                                              \
+        if (ap->a_dead >= STR_HASH_MAP_CHUNK &&                         \
+            ap->a_dead * 2 >= ap->a_used)                               \
+                (void)_name ## _compact(pp);                            \
+                                                                        \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef STR_HASH_MAP_H */
@@ -0,0 +1,449 @@
+#ifndef SWISS_HASH_MAP_H
+#define SWISS_HASH_MAP_H
+
+#include "util.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif /* #if defined(__SSE2__) */
+
+/* initial capacity of swiss_hash_map */
+#ifndef SWISS_HASH_MAP_INIT_CAP
+#define SWISS_HASH_MAP_INIT_CAP 32
+#endif /* #ifndef SWISS_HASH_MAP_INIT_CAP */
+
+/* misc. constants */
+enum {
+        SWISS_HASH_MAP_GROUP       = 16, /* control bytes matched at once */
+        SWISS_HASH_MAP_LOAD_FACTOR = 14, /* load factor */
+};
+
+/* control bytes, full slots hold the low 7 bits of the hash */
+enum {
+        SWISS_HASH_MAP_EMPTY   = 0x80, /* slot never occupied */
+        SWISS_HASH_MAP_DELETED = 0xfe, /* slot was occupied */
+};
+
+/**
+ * Match a group of control bytes:
+ *
+ * Arguments:
+ *  @ctrl: SWISS_HASH_MAP_GROUP control bytes
+ *  @h2:   control byte to match
+ *
+ * Returns:
+ *  @success: bit i set if ctrl[i] == h2
+ *  @failure: does not
+ */
+static inline uint32_t
+swiss_hash_map_match(const uint8_t *ctrl, uint8_t h2)
+{
+#if defined(__SSE2__)
+        __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+        return (uint32_t)_mm_movemask_epi8(
+                _mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+#else
+        uint32_t match = 0;
+        int i = 0;
+
+        for (i = 0; i < SWISS_HASH_MAP_GROUP; i++) {
+                if (ctrl[i] == h2)
+                        match |= (uint32_t)1 << i;
+        }
+
+        return match;
+#endif /* #if defined(__SSE2__) */
+}
+
+/**
+ * Define a new swiss table (grouped control bytes, quadratic probing):
+ *
+ * Arguments:
+ *  @_k:    key type
+ *  @_v:    value type
+ *  @_name: name of generated struct and prefix of all function names
+ *  @_hash: hash function
+ *  @_cmp:  key comparison function
+ *
+ * Notes:
+ *  probes SWISS_HASH_MAP_GROUP control bytes per step, jumping by 1, 2,
+ *  3, ... groups; slots keep no hash, _hash is called again on resize
+ */
+#define SWISS_HASH_MAP_DEFINE(_k, _v, _name, _hash, _cmp)               \
+                                                                        \
+/* key and value of one slot */                                         \
+struct _name ## _slot {                                                 \
+        _k s_key; /* key */                                             \
+        _v s_val; /* value */                                           \
+};                                                                      \
+                                                                        \
+/* swiss table */                                                       \
+struct _name {                                                          \
+        hash_map_size_t        s_cap;  /* capacity */                   \
+        hash_map_size_t        s_len;  /* entry count */                \
+        hash_map_size_t        s_del;  /* number of DELETED slots */    \
+        uint8_t               *s_ctrl; /* control bytes */              \
+        struct _name ## _slot *s_slot; /* slots */                      \
+};                                                                      \
+                                                                        \
+/**                                                                     \
+ * Create a new _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @cap: initial capacity (or 0 for default)                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _name{}                                        \
+ *  @failure: NULL and errno set                                        \
+ */                                                                     \
+static inline struct _name *                                            \
+_name ## _new(hash_map_size_t cap)                                      \
+{                                                                       \
+        struct _name *pp = malloc(sizeof(*pp));                         \
+                                                                        \
+        if (pp == NULL)                                                 \
+                goto ret;                                               \
+                                                                        \
+        if (cap < SWISS_HASH_MAP_GROUP)                                 \
+                cap = cap == 0 ? SWISS_HASH_MAP_INIT_CAP :              \
+                                 SWISS_HASH_MAP_GROUP;                  \
+                                                                        \
+        cap = next_pow2(cap);                                           \
+                                                                        \
+        /* group loads read SWISS_HASH_MAP_GROUP bytes past any slot */ \
+        pp->s_ctrl = malloc(cap + SWISS_HASH_MAP_GROUP);                \
+        if (pp->s_ctrl == NULL)                                         \
+                goto free_pp;                                           \
+        memset(pp->s_ctrl, SWISS_HASH_MAP_EMPTY,                        \
+               cap + SWISS_HASH_MAP_GROUP);                             \
+                                                                        \
+        pp->s_slot = malloc(sizeof(*pp->s_slot) * cap);                 \
+        if (pp->s_slot == NULL)                                         \
+                goto free_ctrl;                                         \
+                                                                        \
+        pp->s_cap = cap;                                                \
+        pp->s_len = 0;                                                  \
+        pp->s_del = 0;                                                  \
+        goto ret;                                                       \
+                                                                        \
+free_ctrl:                                                              \
+        free(pp->s_ctrl);                                               \
+        pp->s_ctrl = NULL;                                              \
+                                                                        \
+free_pp:                                                                \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+ret:                                                                    \
+        return pp;                                                      \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Free a _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: *ppp set to NULL                                          \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _free(struct _name **ppp)                                      \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+                                                                        \
+        free(pp->s_slot);                                               \
+        pp->s_slot = NULL;                                              \
+                                                                        \
+        free(pp->s_ctrl);                                               \
+        pp->s_ctrl = NULL;                                              \
+                                                                        \
+        free(pp);                                                       \
+        pp = NULL;                                                      \
+                                                                        \
+        *ppp = NULL;                                                    \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get entry count of _name{}:                                          \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: number of entries                                         \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _len(const struct _name *pp)                                   \
+{                                                                       \
+        return pp->s_len;                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set control byte of _name{}:                                         \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @i:    slot                                                         \
+ *  @ctrl: control byte                                                 \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: does not                                                  \
+ *  @failure: does not                                                  \
+ */                                                                     \
+static inline void                                                      \
+_name ## _put_ctrl(struct _name *pp, hash_map_size_t i, uint8_t ctrl)   \
+{                                                                       \
+        pp->s_ctrl[i] = ctrl;                                           \
+                                                                        \
+        /* mirror the first group past the end for wrapping loads */    \
+        if (i < SWISS_HASH_MAP_GROUP)                                   \
+                pp->s_ctrl[pp->s_cap + i] = ctrl;                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find first EMPTY or DELETED slot on the probe sequence of a hash:    \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: free slot                                                 \
+ *  @failure: does not, the table always has an EMPTY slot              \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find_free(const struct _name *pp, hash_map_size_t hash)       \
+{                                                                       \
+        hash_map_size_t mask = pp->s_cap - 1;                           \
+        hash_map_size_t i = (hash >> 7) & mask;                         \
+        hash_map_size_t step = 0;                                       \
+        hash_map_size_t j = 0;                                          \
+        uint32_t match = 0;                                             \
+                                                                        \
+        for (;;) {                                                      \
+                match = swiss_hash_map_match(&pp->s_ctrl[i],            \
+                                             SWISS_HASH_MAP_EMPTY) |    \
+                        swiss_hash_map_match(&pp->s_ctrl[i],            \
+                                             SWISS_HASH_MAP_DELETED);   \
+                if (match != 0) {                                       \
+                        j = (hash_map_size_t)__builtin_ctz(match);      \
+                        return (i + j) & mask;                          \
+                }                                                       \
+                                                                        \
+                step += SWISS_HASH_MAP_GROUP;                           \
+                i = (i + step) & mask;                                  \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Resize _name{}:                                                      \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @cap: new capacity                                                  \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _resize(struct _name **ppp, hash_map_size_t cap)               \
+{                                                                       \
+        struct _name *newpp = _name ## _new(cap);                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t hash = 0;                                       \
+        hash_map_size_t i = 0;                                          \
+        hash_map_size_t j = 0;                                          \
+                                                                        \
+        if (newpp == NULL)                                              \
+                return -1;                                              \
+                                                                        \
+        for (i = 0; i < pp->s_cap; i++) {                               \
+                if (pp->s_ctrl[i] & 0x80)                               \
+                        continue;                                       \
+                hash = _hash(pp->s_slot[i].s_key);                      \
+                j = _name ## _find_free(newpp, hash);                   \
+                _name ## _put_ctrl(newpp, j, (uint8_t)(hash & 0x7f));   \
+                newpp->s_slot[j] = pp->s_slot[i];                       \
+        }                                                               \
+                                                                        \
+        newpp->s_len = pp->s_len;                                       \
+        _name ## _free(ppp);                                            \
+        *ppp = newpp;                                                   \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Find slot of key in _name{}:                                         \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp:   pointer to _name{}                                           \
+ *  @hash: hash of key                                                  \
+ *  @k:    key                                                          \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: slot holding key                                          \
+ *  @failure: pp->s_cap                                                 \
+ */                                                                     \
+static inline hash_map_size_t                                           \
+_name ## _find(const struct _name *pp, hash_map_size_t hash, _k k)      \
+{                                                                       \
+        hash_map_size_t mask = pp->s_cap - 1;                           \
+        hash_map_size_t i = (hash >> 7) & mask;                         \
+        hash_map_size_t step = 0;                                       \
+        hash_map_size_t j = 0;                                          \
+        uint32_t match = 0;                                             \
+                                                                        \
+        for (;;) {                                                      \
+                match = swiss_hash_map_match(&pp->s_ctrl[i],            \
+                                             (uint8_t)(hash & 0x7f));   \
+                while (match != 0) {                                    \
+                        j = (hash_map_size_t)__builtin_ctz(match);      \
+                        j = (i + j) & mask;                             \
+                        if (_cmp(pp->s_slot[j].s_key, k) == 0)          \
+                                return j;                               \
+                        match &= match - 1;                             \
+                }                                                       \
+                                                                        \
+                if (swiss_hash_map_match(&pp->s_ctrl[i],                \
+                                         SWISS_HASH_MAP_EMPTY) != 0)    \
+                        return pp->s_cap;                               \
+                                                                        \
+                step += SWISS_HASH_MAP_GROUP;                           \
+                if (unlikely(step > pp->s_cap))                         \
+                        return pp->s_cap;                               \
+                i = (i + step) & mask;                                  \
+        }                                                               \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Get map[k] from _name{}:                                             \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @pp: pointer to _name{}                                             \
+ *  @k:  key                                                            \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: pointer to _v{}                                           \
+ *  @failure: NULL                                                      \
+ */                                                                     \
+static inline _v *                                                      \
+_name ## _get(const struct _name *pp, _k k)                             \
+{                                                                       \
+        hash_map_size_t i = _name ## _find(pp, _hash(k), k);            \
+                                                                        \
+        return i == pp->s_cap ? NULL : &pp->s_slot[i].s_val;            \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Set map[k] = v in _name{}:                                           \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *  @v:   value                                                         \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ */                                                                     \
+static inline int                                                       \
+_name ## _set(struct _name **ppp, _k k, _v v)                           \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t hash = _hash(k);                                \
+        hash_map_size_t i = _name ## _find(pp, hash, k);                \
+        hash_map_size_t cap = pp->s_cap;                                \
+                                                                        \
+        if (i != pp->s_cap) {                                           \
+                pp->s_slot[i].s_val = v;                                \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        /* a table full of DELETED is rehashed at the same size */      \
+        if (unlikely(((pp->s_len + pp->s_del) << 4) >=                  \
+                     cap * SWISS_HASH_MAP_LOAD_FACTOR)) {               \
+                if ((pp->s_len << 5) >=                                 \
+                    cap * SWISS_HASH_MAP_LOAD_FACTOR)                   \
+                        cap <<= 1;                                      \
+                if (_name ## _resize(ppp, cap) < 0)                     \
+                        return -1;                                      \
+                pp = *ppp;                                              \
+        }                                                               \
+                                                                        \
+        i = _name ## _find_free(pp, hash);                              \
+        if (pp->s_ctrl[i] == SWISS_HASH_MAP_DELETED)                    \
+                pp->s_del--;                                            \
+        _name ## _put_ctrl(pp, i, (uint8_t)(hash & 0x7f));              \
+        pp->s_slot[i].s_key = k;                                        \
+        pp->s_slot[i].s_val = v;                                        \
+        pp->s_len++;                                                    \
+        return 0;                                                       \
+}                                                                       \
+                                                                        \
+/**                                                                     \
+ * Unset map[k] _name{}:                                                \
+ *                                                                      \
+ * Arguments:                                                           \
+ *  @ppp: pointer to pointer to _name{}                                 \
+ *  @k:   key                                                           \
+ *                                                                      \
+ * Returns:                                                             \
+ *  @success: 0                                                         \
+ *  @failure: -1 and errno set                                          \
+ *                                                                      \
+ * Notes:                                                               \
+ *  a slot goes back to EMPTY rather than DELETED when no probe can     \
+ *  have passed it, i.e. when the EMPTY slots around it leave no run of \
+ *  SWISS_HASH_MAP_GROUP full slots                                     \
+ */                                                                     \
+static inline int                                                       \
+_name ## _unset(struct _name **ppp, _k k)                               \
+{                                                                       \
+        struct _name *pp = *ppp;                                        \
+        hash_map_size_t mask = 0;                                       \
+        hash_map_size_t i = 0;                                          \
+        uint32_t before = 0;                                            \
+        uint32_t after = 0;                                             \
+                                                                        \
+        if (unlikely(pp->s_len < (pp->s_cap >> 2)) &&                   \
+            pp->s_cap > SWISS_HASH_MAP_INIT_CAP) {                      \
+                if (_name ## _resize(ppp, pp->s_cap >> 1) < 0)          \
+                        return -1;                                      \
+                pp = *ppp;                                              \
+        }                                                               \
+                                                                        \
+        mask = pp->s_cap - 1;                                           \
+        i = _name ## _find(pp, _hash(k), k);                            \
+        if (i == pp->s_cap)                                             \
+                return 0;                                               \
+                                                                        \
+        after = swiss_hash_map_match(&pp->s_ctrl[i],                    \
+                                     SWISS_HASH_MAP_EMPTY);             \
+        before = swiss_hash_map_match(                                  \
+                &pp->s_ctrl[(i - SWISS_HASH_MAP_GROUP) & mask],         \
+                SWISS_HASH_MAP_EMPTY);                                  \
+                                                                        \
+        /* before holds 16 bits, so clz counts 16 bits too many */      \
+        if (after != 0 && before != 0 &&                                \
+            __builtin_ctz(after) + __builtin_clz(before) <              \
+            2 * SWISS_HASH_MAP_GROUP) {                                 \
+                _name ## _put_ctrl(pp, i, SWISS_HASH_MAP_EMPTY);        \
+        } else {                                                        \
+                _name ## _put_ctrl(pp, i, SWISS_HASH_MAP_DELETED);      \
+                pp->s_del++;                                            \
+        }                                                               \
+        pp->s_len--;                                                    \
+        return 0;                                                       \
+}
+
+#endif /* #ifndef SWISS_HASH_MAP_H */
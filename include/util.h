@@ -20,6 +20,17 @@ typedef uint64_t hash_map_size_t;
 #define unlikely(_cond) \
         __builtin_expect(!!(_cond), 0)
 
+/**
+ * inline a function whatever its size:
+ *
+ * Notes:
+ *  a function that only prefetches must be inlined before GCC's
+ *  pure-const pass sees it, which finds it has no side effects and
+ *  deletes every call to it
+ */
+#define force_inline \
+        inline __attribute__((__always_inline__))
+
 /**
  * Get next power of 2:
  *
@@ -1,32 +1,1143 @@
+#include "include/bench.h"
 #include "include/pld_hash_map.h"
+#include "include/sharded_hash_map.h"
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+/**
+ * Hash an int key to itself:
+ *
+ * Arguments:
+ *  @i: key
+ *
+ * Returns:
+ *  @success: key, so keys sharing low bits share home slots
+ *  @failure: does not
+ */
 static inline hash_map_size_t
-inthash(int i)
+idhash(int i)
 {
-        hash_map_size_t hash = (hash_map_size_t)i;
-
-        hash ^= hash >> 15;
-        hash ^= hash >> 7;
-        hash ^= hash >> 3;
-        hash ^= hash << 5;
-        hash ^= hash >> 16;
-
-        return hash;
+        return (uint32_t)i;
 }
 
-#define intcmp(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
-
 PLD_HASH_MAP_DEFINE(int, int, int2intmap, inthash, intcmp)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_bs, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_tag, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_TAGGED)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_simd, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_SIMD)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_inc, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_INCREMENTAL)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_aos, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_AOS)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_aos_simd, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_SIMD |
+                          PLD_HASH_MAP_AOS)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_nohash, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOHASH)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_aos_nohash, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOHASH |
+                          PLD_HASH_MAP_AOS)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_counted, inthash, intcmp,
+                          PLD_HASH_MAP_STATS)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_id, idhash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_seeded, idhash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_SEEDED)
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_quarter, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_LOAD(12, 4))
+PLD_HASH_MAP_DEFINE_FLAGS(int, int, int2intmap_noshrink, inthash, intcmp,
+                          PLD_HASH_MAP_BACKSHIFT | PLD_HASH_MAP_NOSHRINK)
+SHARDED_HASH_MAP_DEFINE(int, int, int2intmap_sharded, idhash, intcmp)
 
 static int key[1 << 24] = {0};
 static int val[1 << 24] = {0};
+static uint32_t lat[1 << 24] = {0};
 
-int
-main(void)
+/* churn benchmark sizes */
+enum {
+        CHURN_LIVE = 1 << 20, /* live keys */
+        CHURN_OPS  = 1 << 23, /* unset+set pairs */
+        CHURN_MISS = 1 << 16, /* sampled miss probes */
+};
+
+/* lookup benchmark sizes */
+enum {
+        LOOKUP_LEN = 3 << 20, /* keys, just under 75% of 4M slots */
+};
+
+/* latency benchmark sizes */
+enum {
+        LAT_OPS = 1 << 24, /* timed _set calls */
+};
+
+/* batch benchmark sizes */
+enum {
+        BATCH_LEN   = 1 << 24, /* keys */
+        BATCH_BLOCK = 4096,    /* keys per _get_batch/_set_batch call */
+};
+
+static int *vps[BATCH_BLOCK] = {0};
+
+/* bulk load benchmark sizes */
+enum {
+        BUILD_LEN = 1 << 24, /* keys */
+};
+
+/* resize benchmark sizes */
+enum {
+        RESIZE_LEN = 3 << 21, /* keys, just under 75% of 8M slots */
+};
+
+/* page size benchmark sizes */
+enum {
+        TLB_LEN = 3 << 22, /* keys, just under 75% of 16M slots */
+        TLB_OPS = 1 << 24, /* random hits timed */
+};
+
+/* statistics run sizes */
+enum {
+        STATS_LEN = 1 << 20, /* keys */
+};
+
+/* counting benchmark sizes */
+enum {
+        COUNT_OPS  = 1 << 24, /* keys counted */
+        COUNT_KEYS = 1 << 28, /* key space, most keys counted are new */
+};
+
+/* snapshot benchmark sizes */
+enum {
+        SNAP_LEN = 1 << 22, /* keys */
+        SNAP_OPS = 1 << 20, /* random hits timed after open */
+};
+
+/* expiry sweep benchmark sizes */
+enum {
+        SWEEP_LEN = 1 << 22, /* keys */
+};
+
+/* oscillating size benchmark sizes */
+enum {
+        OSC_LO     = 7 << 16,  /* keys at the bottom, 44% of 2^20 */
+        OSC_HI     = 13 << 16, /* keys at the top, 81% of 2^20 */
+        OSC_CYCLES = 32,       /* swings up and back down */
+};
+
+/* colliding keys benchmark sizes */
+enum {
+        FLOOD_LEN   = 1 << 14, /* keys, all 0 in their low 16 bits */
+        FLOOD_SHIFT = 16,      /* keys are i << this */
+};
+
+/* colliding keys of one shard check sizes */
+enum {
+        COLLIDE_LEN = 384, /* keys, all 0 in their low 16 bits */
+};
+
+static int collide_key[COLLIDE_LEN] = {0};
+static int collide_done = 0;
+
+/**
+ * Print probe lengths of a table:
+ *
+ * Arguments:
+ *  @name: name of table
+ *  @meta: slot metadata as stored (see PLD_HASH_MAP_META())
+ *  @cap:  capacity
+ *  @len:  entry count
+ *  @was:  number of slots marked as WAS
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+probe_report(const char *name, const uint8_t *meta, hash_map_size_t cap,
+             hash_map_size_t len, hash_map_size_t was)
+{
+        hash_map_size_t mask = cap - 1;
+        hash_map_size_t hit = 0;
+        hash_map_size_t miss = 0;
+        hash_map_size_t i = 0;
+        hash_map_size_t j = 0;
+        uint8_t disp = 0;
+        uint8_t m = 0;
+
+        /* successful lookup of slot i takes its displacement + 1 probes */
+        for (i = 0; i < cap; i++) {
+                m = PLD_HASH_MAP_META(meta[i]);
+                if (m < PLD_HASH_MAP_WAS)
+                        hit += (hash_map_size_t)m + 1;
+        }
+
+        /* unsuccessful lookup walks until NEVER or a richer entry */
+        for (i = 0; i < CHURN_MISS; i++) {
+                j = (i * (cap / CHURN_MISS + 1)) & mask;
+                for (disp = 0; disp < PLD_HASH_MAP_WAS; disp++) {
+                        miss++;
+                        m = PLD_HASH_MAP_META(meta[j]);
+                        if (m == PLD_HASH_MAP_NEVER)
+                                break;
+                        if (m != PLD_HASH_MAP_WAS && m < disp)
+                                break;
+                        j = (j + 1) & mask;
+                }
+        }
+
+        printf("%-16s cap=%-9lu len=%-9lu was=%-9lu "
+               "hit_probe=%.2f miss_probe=%.2f\n",
+               name, (unsigned long)cap, (unsigned long)len,
+               (unsigned long)was,
+               len ? (double)hit / (double)len : 0.0,
+               (double)miss / CHURN_MISS);
+}
+
+/**
+ * Define steady-state churn benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define CHURN_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _churn(void)                                                   \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        hash_map_size_t resizes = 0;                                    \
+        hash_map_size_t cap = 0;                                        \
+        uint64_t state = 0x9e3779b97f4a7c15ULL;                         \
+        clock_t start = 0;                                              \
+        double secs = 0;                                                \
+        int *vp = NULL;                                                 \
+        int miss = 0;                                                   \
+        int i = 0;                                                      \
+        int j = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < CHURN_LIVE; i++) {                              \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        }                                                               \
+        cap = pp->p_cap;                                                \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < CHURN_OPS; i++) {                               \
+                j = (int)(xorshift64(&state) & (CHURN_LIVE - 1));       \
+                assert(_name ## _unset(&pp, key[j]) == 0);              \
+                key[j] = (int)(xorshift64(&state) >> 33);               \
+                assert(_name ## _set(&pp, key[j], j) == 0);             \
+                if (pp->p_cap != cap) {                                 \
+                        cap = pp->p_cap;                                \
+                        resizes++;                                      \
+                }                                                       \
+        }                                                               \
+        secs = ((double)clock() - (double)start) / CLOCKS_PER_SEC;      \
+        printf("%-16s churn: %.3fs %.2f Mops/s resizes=%lu\n",          \
+               #_name, secs, 2.0 * CHURN_OPS / secs / 1e6,              \
+               (unsigned long)resizes);                                 \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < CHURN_LIVE; i++) {                              \
+                vp = _name ## _get(pp, (int)(xorshift64(&state) >> 33)  \
+                                   | (int)0x80000000);                  \
+                miss += vp == NULL;                                     \
+        }                                                               \
+        secs = ((double)clock() - (double)start) / CLOCKS_PER_SEC;      \
+        printf("%-16s miss lookup: %.2f Mops/s (%d misses)\n",          \
+               #_name, CHURN_LIVE / secs / 1e6, miss);                  \
+                                                                        \
+        probe_report(#_name, pp->p_meta, pp->p_cap, pp->p_len,          \
+                     pp->p_was);                                        \
+        _name ## _free(&pp);                                            \
+}
+
+CHURN_DEFINE(int2intmap)
+CHURN_DEFINE(int2intmap_bs)
+
+/**
+ * Define hit and miss lookup benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define LOOKUP_DEFINE(_name)                                            \
+static void                                                             \
+_name ## _lookup(void)                                                  \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        uint64_t state = 0x2545f4914f6cdd1dULL;                         \
+        clock_t start = 0;                                              \
+        double hit = 0;                                                 \
+        double miss = 0;                                                \
+        int found = 0;                                                  \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < LOOKUP_LEN; i++) {                              \
+                key[i] = (int)(xorshift64(&state) >> 34);               \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        }                                                               \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < LOOKUP_LEN; i++)                                \
+                found += _name ## _get(pp, key[i]) != NULL;             \
+        hit = ((double)clock() - (double)start) / CLOCKS_PER_SEC;       \
+        assert(found == LOOKUP_LEN);                                    \
+                                                                        \
+        /* keys are below 1 << 30, so setting bit 30 always misses */   \
+        start = clock();                                                \
+        for (i = 0; i < LOOKUP_LEN; i++)                                \
+                found -= _name ## _get(pp, key[i] | 1 << 30) == NULL;   \
+        miss = ((double)clock() - (double)start) / CLOCKS_PER_SEC;      \
+        assert(found == 0);                                             \
+                                                                        \
+        printf("%-16s hit: %.2f Mops/s miss: %.2f Mops/s\n",            \
+               #_name, LOOKUP_LEN / hit / 1e6, LOOKUP_LEN / miss / 1e6); \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Compare two latencies for qsort():
+ *
+ * Arguments:
+ *  @a: pointer to first latency
+ *  @b: pointer to second latency
+ *
+ * Returns:
+ *  @success: <0, 0 or >0 like strcmp()
+ *  @failure: does not
+ */
+static int
+latcmp(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+/**
+ * Get nanoseconds between two times:
+ *
+ * Arguments:
+ *  @start: start time
+ *  @end:   end time
+ *
+ * Returns:
+ *  @success: nanoseconds, saturated to UINT32_MAX
+ *  @failure: does not
+ */
+static inline uint32_t
+nsec(const struct timespec *start, const struct timespec *end)
+{
+        int64_t ns = (int64_t)(end->tv_sec - start->tv_sec) * 1000000000 +
+                     (end->tv_nsec - start->tv_nsec);
+
+        return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+/**
+ * Define per-operation _set latency benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define LATENCY_DEFINE(_name)                                           \
+static void                                                             \
+_name ## _latency(void)                                                 \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        struct timespec start;                                          \
+        struct timespec end;                                            \
+        uint64_t state = 0x5851f42d4c957f2dULL;                         \
+        double total = 0;                                               \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < LAT_OPS; i++)                                   \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                                                                        \
+        for (i = 0; i < LAT_OPS; i++) {                                 \
+                clock_gettime(CLOCK_MONOTONIC, &start);                 \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+                clock_gettime(CLOCK_MONOTONIC, &end);                   \
+                lat[i] = nsec(&start, &end);                            \
+                total += lat[i];                                        \
+        }                                                               \
+                                                                        \
+        qsort(lat, LAT_OPS, sizeof(*lat), latcmp);                      \
+        printf("%-16s set latency ns: p50=%u p99=%u p999=%u "           \
+               "max=%u total=%.3fs\n", #_name,                          \
+               lat[LAT_OPS / 2], lat[LAT_OPS / 100 * 99],               \
+               lat[LAT_OPS / 1000 * 999], lat[LAT_OPS - 1],             \
+               total / 1e9);                                            \
+        _name ## _free(&pp);                                            \
+}
+
+LATENCY_DEFINE(int2intmap_bs)
+LATENCY_DEFINE(int2intmap_inc)
+
+/**
+ * Get seconds since a clock() reading:
+ *
+ * Arguments:
+ *  @start: clock() reading
+ *
+ * Returns:
+ *  @success: seconds
+ *  @failure: does not
+ */
+static inline double
+secs_since(clock_t start)
+{
+        return ((double)clock() - (double)start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * Define one-at-a-time versus batched benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define BATCH_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _batch(void)                                                   \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        uint64_t state = 0xda942042e4dd58b5ULL;                         \
+        clock_t start = 0;                                              \
+        double set = 0;                                                 \
+        double set_batch = 0;                                           \
+        double get = 0;                                                 \
+        double get_batch = 0;                                           \
+        size_t found = 0;                                               \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < BATCH_LEN; i++) {                               \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                val[i] = i;                                             \
+        }                                                               \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < BATCH_LEN; i++)                                 \
+                assert(_name ## _set(&pp, key[i], val[i]) == 0);        \
+        set = secs_since(start);                                        \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        start = clock();                                                \
+        for (i = 0; i < BATCH_LEN; i += BATCH_BLOCK) {                  \
+                assert(_name ## _set_batch(&pp, &key[i], &val[i],       \
+                                           BATCH_BLOCK) == 0);          \
+        }                                                               \
+        set_batch = secs_since(start);                                  \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < BATCH_LEN; i++)                                 \
+                found += _name ## _get(pp, key[i]) != NULL;             \
+        get = secs_since(start);                                        \
+        assert(found == BATCH_LEN);                                     \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < BATCH_LEN; i += BATCH_BLOCK)                    \
+                found -= _name ## _get_batch(pp, &key[i], vps,          \
+                                             BATCH_BLOCK);              \
+        get_batch = secs_since(start);                                  \
+        assert(found == 0);                                             \
+                                                                        \
+        printf("%-16s set: %.2f Mops/s set_batch: %.2f Mops/s "         \
+               "get: %.2f Mops/s get_batch: %.2f Mops/s\n", #_name,     \
+               BATCH_LEN / set / 1e6, BATCH_LEN / set_batch / 1e6,      \
+               BATCH_LEN / get / 1e6, BATCH_LEN / get_batch / 1e6);     \
+        _name ## _free(&pp);                                            \
+}
+
+BATCH_DEFINE(int2intmap_bs)
+BATCH_DEFINE(int2intmap_aos)
+
+/**
+ * Define memory footprint and _resize benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define RESIZE_DEFINE(_name)                                            \
+static void                                                             \
+_name ## _resize_bench(void)                                            \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        uint64_t state = 0x9e3779b97f4a7c15ULL;                         \
+        clock_t start = 0;                                              \
+        size_t slot = 0;                                                \
+        double elapsed = 0;                                             \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < RESIZE_LEN; i++) {                              \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        }                                                               \
+                                                                        \
+        slot = sizeof(*pp->p_meta);                                     \
+        if (pp->p_hash != NULL)                                         \
+                slot += sizeof(*pp->p_hash);                            \
+        if (pp->p_key != NULL)                                          \
+                slot += sizeof(*pp->p_key) + sizeof(*pp->p_val);        \
+        if (pp->p_slot != NULL)                                         \
+                slot += sizeof(*pp->p_slot);                            \
+        if (pp->p_kv != NULL)                                           \
+                slot += sizeof(*pp->p_kv);                              \
+                                                                        \
+        start = clock();                                                \
+        assert(_name ## _resize(&pp, pp->p_cap << 1) == 0);             \
+        elapsed = secs_since(start);                                    \
+                                                                        \
+        printf("%-16s bytes/slot: %zu bytes/entry: %.2f "               \
+               "resize %lu->%lu: %.3fs\n", #_name, slot,                \
+               (double)slot * (double)(pp->p_cap >> 1) /                \
+               (double)pp->p_len, (unsigned long)(pp->p_cap >> 1),      \
+               (unsigned long)pp->p_cap, elapsed);                      \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Define cold start load benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define BUILD_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _build(void)                                                   \
+{                                                                       \
+        struct _name *pp = NULL;                                        \
+        uint64_t state = 0x2545f4914f6cdd1dULL;                         \
+        clock_t start = 0;                                              \
+        double grow = 0;                                                \
+        double reserve = 0;                                             \
+        double build = 0;                                               \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < BUILD_LEN; i++) {                               \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                val[i] = i;                                             \
+        }                                                               \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < BUILD_LEN; i++)                                 \
+                assert(_name ## _set(&pp, key[i], val[i]) == 0);        \
+        grow = secs_since(start);                                       \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        assert(_name ## _reserve(&pp, BUILD_LEN) == 0);                 \
+        for (i = 0; i < BUILD_LEN; i++)                                 \
+                assert(_name ## _set(&pp, key[i], val[i]) == 0);        \
+        reserve = secs_since(start);                                    \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _build_from_arrays(key, val, BUILD_LEN);          \
+        assert(pp != NULL);                                             \
+        build = secs_since(start);                                      \
+                                                                        \
+        for (i = 0; i < BUILD_LEN; i += 4096)                           \
+                assert(_name ## _get(pp, key[i]) != NULL);              \
+                                                                        \
+        printf("%-16s load %d keys: set: %.3fs reserve+set: %.3fs "     \
+               "build_from_arrays: %.3fs\n", #_name, BUILD_LEN, grow,   \
+               reserve, build);                                         \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Allocate table storage on regular pages:
+ *
+ * Arguments:
+ *  @ctx:  unused
+ *  @size: number of bytes
+ *
+ * Returns:
+ *  @success: pointer to memory
+ *  @failure: NULL and errno set
+ */
+static void *
+small_alloc(void *ctx, size_t size)
+{
+        return aligned_alloc(PLD_HASH_MAP_ALIGN,
+                             pld_hash_map_round(size, PLD_HASH_MAP_ALIGN));
+}
+
+/**
+ * Free table storage from small_alloc():
+ *
+ * Arguments:
+ *  @ctx:  unused
+ *  @ptr:  pointer to memory
+ *  @size: number of bytes
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+small_free(void *ctx, void *ptr, size_t size)
+{
+        free(ptr);
+}
+
+/* allocator keeping tables off huge pages */
+static const struct pld_hash_map_alloc small_pages = {
+        small_alloc, small_free, NULL,
+};
+
+/**
+ * Define random lookup benchmark on huge and on regular pages for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define TLB_DEFINE(_name)                                               \
+static void                                                             \
+_name ## _tlb(void)                                                     \
+{                                                                       \
+        const struct pld_hash_map_alloc *ap[] = { NULL, &small_pages }; \
+        const char *pages[] = { "huge", "small" };                      \
+        struct _name *pp = NULL;                                        \
+        uint64_t state = 0;                                             \
+        clock_t start = 0;                                              \
+        double elapsed = 0;                                             \
+        int found = 0;                                                  \
+        int a = 0;                                                      \
+        int i = 0;                                                      \
+                                                                        \
+        for (a = 0; a < 2; a++) {                                       \
+                pp = _name ## _new_alloc(0, ap[a]);                     \
+                assert(pp != NULL);                                     \
+                assert(_name ## _reserve(&pp, TLB_LEN) == 0);           \
+                                                                        \
+                state = 0x2545f4914f6cdd1dULL;                          \
+                for (i = 0; i < TLB_LEN; i++) {                         \
+                        key[i] = (int)(xorshift64(&state) >> 34);       \
+                        assert(_name ## _set(&pp, key[i], i) == 0);     \
+                }                                                       \
+                                                                        \
+                /* each hit lands on a random page of a table far       \
+                 * bigger than dTLB reach */                            \
+                found = 0;                                              \
+                start = clock();                                        \
+                for (i = 0; i < TLB_OPS; i++) {                         \
+                        found += _name ## _get(pp, key[                 \
+                                xorshift64(&state) % TLB_LEN]) != NULL; \
+                }                                                       \
+                elapsed = secs_since(start);                            \
+                assert(found == TLB_OPS);                               \
+                                                                        \
+                printf("%-16s %s pages: %zu MB, hit: %.2f Mops/s\n",    \
+                       #_name, pages[a], pp->p_size >> 20,              \
+                       TLB_OPS / elapsed / 1e6);                        \
+                _name ## _free(&pp);                                    \
+        }                                                               \
+}
+
+/**
+ * Add one to a counter:
+ *
+ * Arguments:
+ *  @vp:       pointer to counter, zeroed if just inserted
+ *  @inserted: unused
+ *  @ctx:      unused
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+count_add(int *vp, bool inserted, void *ctx)
+{
+        (void)inserted;
+        (void)ctx;
+        (*vp)++;
+}
+
+/**
+ * Define group-by counting benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ */
+#define COUNT_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _count(void)                                                   \
+{                                                                       \
+        struct _name *pp = NULL;                                        \
+        uint64_t state = 0x2545f4914f6cdd1dULL;                         \
+        clock_t start = 0;                                              \
+        double twice = 0;                                               \
+        double once = 0;                                                \
+        double update = 0;                                              \
+        bool inserted = false;                                          \
+        int *vp = NULL;                                                 \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < COUNT_OPS; i++)                                 \
+                key[i] = (int)(xorshift64(&state) % COUNT_KEYS);        \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < COUNT_OPS; i++) {                               \
+                vp = _name ## _get(pp, key[i]);                         \
+                if (vp != NULL)                                         \
+                        (*vp)++;                                        \
+                else                                                    \
+                        assert(_name ## _set(&pp, key[i], 1) == 0);     \
+        }                                                               \
+        twice = secs_since(start);                                      \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < COUNT_OPS; i++) {                               \
+                vp = _name ## _get_or_insert(&pp, key[i], &inserted);   \
+                assert(vp != NULL);                                     \
+                (*vp)++;                                                \
+        }                                                               \
+        once = secs_since(start);                                       \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < COUNT_OPS; i++)                                 \
+                assert(_name ## _update(&pp, key[i], count_add,         \
+                                        NULL) == 0);                    \
+        update = secs_since(start);                                     \
+                                                                        \
+        vp = _name ## _get(pp, key[0]);                                 \
+        assert(vp != NULL && *vp > 0);                                  \
+                                                                        \
+        printf("%-16s count %d keys: get+set: %.3fs "                   \
+               "get_or_insert: %.3fs update: %.3fs\n", #_name,          \
+               COUNT_OPS, twice, once, update);                         \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Define save and mapped open benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ *
+ * Notes:
+ *  the file was just written, so open and hits fault pages in from the
+ *  page cache; a cold start adds reading only the pages hits touch
+ */
+#define SNAP_DEFINE(_name)                                              \
+static void                                                             \
+_name ## _snapshot(void)                                                \
+{                                                                       \
+        struct _name *pp = NULL;                                        \
+        char path[] = "/tmp/pld_hash_map_XXXXXX";                       \
+        uint64_t state = 0x2545f4914f6cdd1dULL;                         \
+        clock_t start = 0;                                              \
+        double built = 0;                                               \
+        double saved = 0;                                               \
+        double opened = 0;                                              \
+        double hits = 0;                                                \
+        double verified = 0;                                            \
+        int fd = -1;                                                    \
+        int i = 0;                                                      \
+        int j = 0;                                                      \
+                                                                        \
+        for (i = 0; i < SNAP_LEN; i++)                                  \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < SNAP_LEN; i++)                                  \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        built = secs_since(start);                                      \
+                                                                        \
+        fd = mkstemp(path);                                             \
+        assert(fd >= 0);                                                \
+        start = clock();                                                \
+        assert(_name ## _save(pp, fd) == 0);                            \
+        saved = secs_since(start);                                      \
+        close(fd);                                                      \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        start = clock();                                                \
+        pp = _name ## _open_mapped(path);                               \
+        assert(pp != NULL);                                             \
+        opened = secs_since(start);                                     \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < SNAP_OPS; i++) {                                \
+                j = key[xorshift64(&state) & (SNAP_LEN - 1)];          \
+                assert(_name ## _get(pp, j) != NULL);                   \
+        }                                                               \
+        hits = secs_since(start);                                       \
+                                                                        \
+        start = clock();                                                \
+        assert(_name ## _verify(pp) == 0);                              \
+        verified = secs_since(start);                                   \
+                                                                        \
+        printf("%-16s snapshot %d keys: set: %.3fs save: %.3fs "        \
+               "open: %.6fs %d hits: %.3fs verify: %.3fs\n", #_name,    \
+               SNAP_LEN, built, saved, opened, SNAP_OPS, hits,          \
+               verified);                                               \
+        _name ## _free(&pp);                                            \
+        unlink(path);                                                   \
+}
+
+/**
+ * Define colliding keys benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map hashed with idhash()
+ *
+ * Notes:
+ *  every key shares a home slot until the table outgrows 2^16 slots,
+ *  so inserts stop at PLD_HASH_MAP_PROBE_LIMIT() unless seeded; the
+ *  insert that fails must not leave the table grown for it
+ */
+#define FLOOD_DEFINE(_name)                                             \
+static void                                                             \
+_name ## _flood(void)                                                   \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        clock_t start = 0;                                              \
+        double secs = 0;                                                \
+        int err = 0;                                                    \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < FLOOD_LEN; i++) {                               \
+                if (_name ## _set(&pp, i << FLOOD_SHIFT, i) < 0) {      \
+                        err = errno;                                    \
+                        break;                                          \
+                }                                                       \
+        }                                                               \
+        secs = ((double)clock() - (double)start) / CLOCKS_PER_SEC;      \
+        printf("%-16s flood: %d/%d keys set in %.3fs (%s)\n",           \
+               #_name, i, FLOOD_LEN, secs,                              \
+               err ? strerror(err) : "ok");                             \
+        assert(err == 0 ||                                              \
+               pp->p_cap <= _name ## _cap_for(pp->p_len + 1));          \
+                                                                        \
+        probe_report(#_name, pp->p_meta, pp->p_cap, pp->p_len,          \
+                     pp->p_was);                                        \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Define expiry sweep benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ *
+ * Notes:
+ *  values are insert times; unsetting the expired keys one by one
+ *  needs a side list of keys and shrinks the table once per halving,
+ *  _erase_if() walks the table once and shrinks once
+ */
+#define SWEEP_DEFINE(_name)                                             \
+static bool                                                             \
+_name ## _expired(int k, int *vp, void *ctx)                            \
+{                                                                       \
+        return *vp < *(int *)ctx;                                       \
+}                                                                       \
+                                                                        \
+static void                                                             \
+_name ## _add(int k, int *vp, void *ctx)                                \
+{                                                                       \
+        *(long *)ctx += *vp;                                            \
+}                                                                       \
+                                                                        \
+static void                                                             \
+_name ## _sweep(void)                                                   \
+{                                                                       \
+        struct _name *pp = NULL;                                        \
+        uint64_t state = 0x2545f4914f6cdd1dULL;                         \
+        hash_map_size_t len = 0;                                        \
+        clock_t start = 0;                                              \
+        double walked = 0;                                              \
+        double unset = 0;                                               \
+        double erased = 0;                                              \
+        long sum = 0;                                                   \
+        int cutoff = SWEEP_LEN - SWEEP_LEN / 8;                         \
+        int *vp = NULL;                                                 \
+        int i = 0;                                                      \
+                                                                        \
+        for (i = 0; i < SWEEP_LEN; i++)                                 \
+                key[i] = (int)(xorshift64(&state) >> 33);               \
+                                                                        \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < SWEEP_LEN; i++)                                 \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        len = _name ## _len(pp);                                        \
+                                                                        \
+        start = clock();                                                \
+        _name ## _foreach(pp, _name ## _add, &sum);                     \
+        walked = secs_since(start);                                     \
+                                                                        \
+        start = clock();                                                \
+        for (i = 0; i < SWEEP_LEN; i++) {                               \
+                vp = _name ## _get(pp, key[i]);                         \
+                if (vp != NULL && *vp < cutoff)                         \
+                        assert(_name ## _unset(&pp, key[i]) == 0);      \
+        }                                                               \
+        unset = secs_since(start);                                      \
+        _name ## _free(&pp);                                            \
+                                                                        \
+        pp = _name ## _new(0);                                          \
+        assert(pp != NULL);                                             \
+        for (i = 0; i < SWEEP_LEN; i++)                                 \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+                                                                        \
+        start = clock();                                                \
+        len -= _name ## _erase_if(&pp, _name ## _expired, &cutoff);     \
+        erased = secs_since(start);                                     \
+        assert(len == _name ## _len(pp));                               \
+                                                                        \
+        printf("%-16s sweep %d keys: foreach: %.3fs expire 7/8 by "     \
+               "key list: %.3fs erase_if: %.3fs\n", #_name,             \
+               SWEEP_LEN, walked, unset, erased);                       \
+        _name ## _free(&pp);                                            \
+}
+
+/**
+ * Define oscillating size benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ *
+ * Notes:
+ *  the size swings across the grow threshold of a 2^20 slot table and
+ *  back down to 44% of it, every cycle, then drains to empty and calls
+ *  _shrink_to_fit()
+ */
+#define OSC_DEFINE(_name)                                               \
+static void                                                             \
+_name ## _oscillate(void)                                               \
+{                                                                       \
+        struct _name *pp = _name ## _new(0);                            \
+        hash_map_size_t resizes = 0;                                    \
+        hash_map_size_t drains = 0;                                     \
+        hash_map_size_t cap = 0;                                        \
+        clock_t start = 0;                                              \
+        double secs = 0;                                                \
+        int c = 0;                                                      \
+        int i = 0;                                                      \
+                                                                        \
+        assert(pp != NULL);                                             \
+                                                                        \
+        for (i = 0; i < OSC_HI; i++)                                    \
+                key[i] = (int)((uint32_t)i * 0x9e3779b1u & 0x7fffffff); \
+        for (i = 0; i < OSC_LO; i++)                                    \
+                assert(_name ## _set(&pp, key[i], i) == 0);             \
+        cap = pp->p_cap;                                                \
+                                                                        \
+        start = clock();                                                \
+        for (c = 0; c < OSC_CYCLES; c++) {                              \
+                for (i = OSC_LO; i < OSC_HI; i++) {                     \
+                        assert(_name ## _set(&pp, key[i], i) == 0);     \
+                        resizes += pp->p_cap != cap;                    \
+                        cap = pp->p_cap;                                \
+                }                                                       \
+                for (i = OSC_LO; i < OSC_HI; i++) {                     \
+                        assert(_name ## _unset(&pp, key[i]) == 0);      \
+                        resizes += pp->p_cap != cap;                    \
+                        cap = pp->p_cap;                                \
+                }                                                       \
+        }                                                               \
+        secs = ((double)clock() - (double)start) / CLOCKS_PER_SEC;      \
+                                                                        \
+        for (i = 0; i < OSC_LO; i++) {                                  \
+                assert(_name ## _unset(&pp, key[i]) == 0);              \
+                drains += pp->p_cap != cap;                             \
+                cap = pp->p_cap;                                        \
+        }                                                               \
+        assert(_name ## _shrink_to_fit(&pp) == 0);                      \
+        drains += pp->p_cap != cap;                                     \
+                                                                        \
+        printf("%-16s oscillate %d..%d keys x%d: %.3fs resizes=%lu "    \
+               "drain resizes=%lu cap=%lu\n", #_name, OSC_LO, OSC_HI,   \
+               OSC_CYCLES, secs, (unsigned long)resizes,                \
+               (unsigned long)drains, (unsigned long)pp->p_cap);        \
+        _name ## _free(&pp);                                            \
+}
+
+BUILD_DEFINE(int2intmap_bs)
+BUILD_DEFINE(int2intmap_simd)
+
+TLB_DEFINE(int2intmap_bs)
+TLB_DEFINE(int2intmap_aos)
+
+COUNT_DEFINE(int2intmap)
+COUNT_DEFINE(int2intmap_bs)
+COUNT_DEFINE(int2intmap_simd)
+COUNT_DEFINE(int2intmap_inc)
+
+SNAP_DEFINE(int2intmap_bs)
+SNAP_DEFINE(int2intmap_aos)
+
+FLOOD_DEFINE(int2intmap_id)
+FLOOD_DEFINE(int2intmap_seeded)
+
+/**
+ * Look up colliding keys of one shard until told to stop:
+ *
+ * Arguments:
+ *  @arg: pointer to int2intmap_sharded{}
+ *
+ * Returns:
+ *  @success: NULL
+ *  @failure: does not
+ */
+static void *
+collide_reader(void *arg)
+{
+        struct int2intmap_sharded *pp = arg;
+        int v = 0;
+        int i = 0;
+
+        while (!__atomic_load_n(&collide_done, __ATOMIC_ACQUIRE)) {
+                for (i = 0; i < COLLIDE_LEN; i++) {
+                        if (int2intmap_sharded_get(pp, collide_key[i], &v))
+                                assert(v == i);
+                }
+                sched_yield();
+        }
+
+        return NULL;
+}
+
+/**
+ * Set colliding keys of one shard while another thread reads them:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ *
+ * Notes:
+ *  the keys share a home slot, so the shard table overflows
+ *  PLD_HASH_MAP_PROBE_LIMIT(); only the shard may then swap tables,
+ *  retiring the old one for readers still in it. A table freed while
+ *  the reader holds a slot naming the shard is a read make safe
+ *  reports
+ */
+static void
+sharded_collide(void)
+{
+        struct int2intmap_sharded *pp = int2intmap_sharded_new(0);
+        struct int2intmap_sharded_shard *sp = &pp->s_shard[0];
+        struct int2intmap_sharded_tbl *tp = NULL;
+        pthread_t reader;
+        unsigned int grows = 0;
+        int found = 0;
+        int set = 0;
+        int k = 0;
+        int i = 0;
+        int v = 0;
+
+        assert(pp != NULL);
+
+        for (k = 0; i < COLLIDE_LEN; k++) {
+                if (sharded_hash_map_shard(idhash(k << FLOOD_SHIFT)) == 0)
+                        collide_key[i++] = k << FLOOD_SHIFT;
+        }
+
+        __atomic_store_n(&collide_done, 0, __ATOMIC_RELEASE);
+        assert(pthread_create(&reader, NULL, collide_reader, pp) == 0);
+
+        for (i = 0; i < COLLIDE_LEN; i++) {
+                tp = sp->s_tbl;
+                if (int2intmap_sharded_set(pp, collide_key[i], i) == 0)
+                        set++;
+                else
+                        assert(errno == EOVERFLOW);
+
+                /* retired tables are freed once the reader is out */
+                if (sp->s_tbl != tp)
+                        grows++;
+                assert(sp->s_ndead <= grows);
+                sched_yield();
+        }
+
+        __atomic_store_n(&collide_done, 1, __ATOMIC_RELEASE);
+        assert(pthread_join(reader, NULL) == 0);
+
+        for (i = 0; i < COLLIDE_LEN; i++)
+                found += int2intmap_sharded_get(pp, collide_key[i], &v);
+        assert(found == set);
+        assert(int2intmap_sharded_len(pp) == (hash_map_size_t)set);
+
+        printf("%-16s collide: %d/%d keys set, %u tables retired, "
+               "%u not freed\n", "int2intmap_sharded", set, COLLIDE_LEN,
+               grows, sp->s_ndead);
+        int2intmap_sharded_free(&pp);
+}
+
+SWEEP_DEFINE(int2intmap)
+SWEEP_DEFINE(int2intmap_bs)
+
+OSC_DEFINE(int2intmap_bs)
+OSC_DEFINE(int2intmap_quarter)
+OSC_DEFINE(int2intmap_noshrink)
+
+RESIZE_DEFINE(int2intmap_bs)
+RESIZE_DEFINE(int2intmap_nohash)
+RESIZE_DEFINE(int2intmap_aos)
+RESIZE_DEFINE(int2intmap_aos_nohash)
+
+LOOKUP_DEFINE(int2intmap_bs)
+LOOKUP_DEFINE(int2intmap_tag)
+LOOKUP_DEFINE(int2intmap_simd)
+LOOKUP_DEFINE(int2intmap_aos)
+LOOKUP_DEFINE(int2intmap_aos_simd)
+LOOKUP_DEFINE(int2intmap_nohash)
+
+/**
+ * Insert, look up and remove random keys in one timed region:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+mixed(void)
 {
         struct int2intmap *i2imap = NULL;
         clock_t start = 0;
@@ -37,8 +1148,6 @@ main(void)
         i2imap = int2intmap_new(0);
         assert(i2imap != NULL);
 
-        srand((unsigned int)time(NULL));
-
         for (i = 0; i < nkey; i++) {
                 key[i] = rand();
                 val[i] = rand();
@@ -63,3 +1172,86 @@ main(void)
 
         int2intmap_free(&i2imap);
 }
+
+/**
+ * Insert, look up and remove random keys and dump map statistics:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+stats(void)
+{
+        struct int2intmap_counted *pp = NULL;
+        uint64_t state = 0x2545f4914f6cdd1dULL;
+        int i = 0;
+
+        pp = int2intmap_counted_new(0);
+        assert(pp != NULL);
+
+        for (i = 0; i < STATS_LEN; i++) {
+                key[i] = (int)(xorshift64(&state) >> 33);
+                assert(int2intmap_counted_set(&pp, key[i], i) == 0);
+        }
+
+        for (i = 0; i < STATS_LEN; i++) {
+                assert(int2intmap_counted_get(pp, key[i]) != NULL);
+                (void)int2intmap_counted_get(pp, key[i] | 1 << 30);
+        }
+
+        /* unset 3 keys in 4, below 3/16 full, shrinking the table once */
+        for (i = 0; i < STATS_LEN; i++) {
+                if (i % 4 != 0)
+                        assert(int2intmap_counted_unset(&pp, key[i]) == 0);
+        }
+
+        assert(int2intmap_counted_stats_dump(pp, stdout) == 0);
+        int2intmap_counted_free(&pp);
+}
+
+int
+main(void)
+{
+        srand((unsigned int)time(NULL));
+
+        sharded_collide();
+        mixed();
+        int2intmap_churn();
+        int2intmap_bs_churn();
+        int2intmap_bs_lookup();
+        int2intmap_tag_lookup();
+        int2intmap_simd_lookup();
+        int2intmap_aos_lookup();
+        int2intmap_aos_simd_lookup();
+        int2intmap_nohash_lookup();
+        int2intmap_bs_latency();
+        int2intmap_inc_latency();
+        int2intmap_bs_batch();
+        int2intmap_aos_batch();
+        int2intmap_bs_resize_bench();
+        int2intmap_bs_build();
+        int2intmap_simd_build();
+        int2intmap_nohash_resize_bench();
+        int2intmap_aos_resize_bench();
+        int2intmap_aos_nohash_resize_bench();
+        int2intmap_bs_tlb();
+        int2intmap_aos_tlb();
+        int2intmap_count();
+        int2intmap_bs_count();
+        int2intmap_simd_count();
+        int2intmap_inc_count();
+        int2intmap_bs_snapshot();
+        int2intmap_aos_snapshot();
+        int2intmap_id_flood();
+        int2intmap_seeded_flood();
+        int2intmap_sweep();
+        int2intmap_bs_sweep();
+        int2intmap_bs_oscillate();
+        int2intmap_quarter_oscillate();
+        int2intmap_noshrink_oscillate();
+        stats();
+}
@@ -0,0 +1,477 @@
+#include "include/bench.h"
+#include "include/pld_hash_map.h"
+#include "include/sharded_hash_map.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+PLD_HASH_MAP_DEFINE(int, int, int2intmap, inthash, intcmp)
+SHARDED_HASH_MAP_DEFINE(int, int, int2intmap_sharded, inthash, intcmp)
+
+/* benchmark settings */
+enum {
+        MTBENCH_LEN         = 1 << 20, /* default entries in table */
+        MTBENCH_MS          = 1000,    /* default ms per run */
+        MTBENCH_MAX_THREADS = 64,      /* most threads swept */
+        MTBENCH_BATCH       = 1 << 10, /* ops between checks for stop */
+};
+
+/* percent of ops that are reads, the rest are half _set half _unset */
+static const unsigned int read_pcts[] = { 100, 95, 50 };
+
+/* thread of one run */
+struct mtbench_thread {
+        pthread_t t_tid;   /* thread */
+        uint64_t  t_state; /* xorshift state */
+        uint64_t  t_ops;   /* ops done */
+};
+
+/* map under test */
+struct mtbench_map {
+        const char *m_name;                    /* map name */
+        void (*m_setup)(size_t);               /* fill with n keys */
+        void (*m_teardown)(void);              /* free */
+        bool (*m_get)(int);                    /* look key up */
+        void (*m_set)(int, int);               /* set key */
+        void (*m_unset)(int);                  /* unset key */
+};
+
+/* benchmark state shared by all threads */
+static pthread_barrier_t start;       /* lines threads up with main */
+static const struct mtbench_map *cur; /* map of current run */
+static unsigned int read_pct = 0;     /* read percent of current run */
+static size_t len = 0;                /* keys present at start */
+static int stop = 0;                  /* set when run is over */
+static size_t sink = 0;
+
+/* pld_hash_map behind one mutex, what callers do without sharding */
+static pthread_mutex_t locked_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct int2intmap *locked = NULL;
+
+/* sharded map */
+static struct int2intmap_sharded *sharded = NULL;
+
+/**
+ * Fill the mutex wrapped map:
+ *
+ * Arguments:
+ *  @n: number of keys
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+locked_setup(size_t n)
+{
+        size_t i = 0;
+
+        locked = int2intmap_new(0);
+        if (locked == NULL)
+                fail("int2intmap_new");
+
+        for (i = 0; i < n; i++) {
+                if (int2intmap_set(&locked, scramble((uint32_t)i),
+                                   (int)i) < 0)
+                        fail("int2intmap_set");
+        }
+}
+
+/**
+ * Free the mutex wrapped map:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+locked_teardown(void)
+{
+        int2intmap_free(&locked);
+}
+
+/**
+ * Look a key up in the mutex wrapped map:
+ *
+ * Arguments:
+ *  @k: key
+ *
+ * Returns:
+ *  @true:  if key was found
+ *  @false: if not
+ */
+static bool
+locked_get(int k)
+{
+        bool found = false;
+
+        pthread_mutex_lock(&locked_lock);
+        found = int2intmap_get(locked, k) != NULL;
+        pthread_mutex_unlock(&locked_lock);
+
+        return found;
+}
+
+/**
+ * Set a key in the mutex wrapped map:
+ *
+ * Arguments:
+ *  @k: key
+ *  @v: value
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+locked_set(int k, int v)
+{
+        int ret = 0;
+
+        pthread_mutex_lock(&locked_lock);
+        ret = int2intmap_set(&locked, k, v);
+        pthread_mutex_unlock(&locked_lock);
+
+        if (ret < 0)
+                fail("int2intmap_set");
+}
+
+/**
+ * Unset a key in the mutex wrapped map:
+ *
+ * Arguments:
+ *  @k: key
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+locked_unset(int k)
+{
+        int ret = 0;
+
+        pthread_mutex_lock(&locked_lock);
+        ret = int2intmap_unset(&locked, k);
+        pthread_mutex_unlock(&locked_lock);
+
+        if (ret < 0)
+                fail("int2intmap_unset");
+}
+
+/**
+ * Fill the sharded map:
+ *
+ * Arguments:
+ *  @n: number of keys
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+sharded_setup(size_t n)
+{
+        size_t i = 0;
+
+        sharded = int2intmap_sharded_new(0);
+        if (sharded == NULL)
+                fail("int2intmap_sharded_new");
+
+        for (i = 0; i < n; i++) {
+                if (int2intmap_sharded_set(sharded,
+                                           scramble((uint32_t)i),
+                                           (int)i) < 0)
+                        fail("int2intmap_sharded_set");
+        }
+}
+
+/**
+ * Free the sharded map:
+ *
+ * Arguments:
+ *  @nothing
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+sharded_teardown(void)
+{
+        int2intmap_sharded_free(&sharded);
+}
+
+/**
+ * Look a key up in the sharded map:
+ *
+ * Arguments:
+ *  @k: key
+ *
+ * Returns:
+ *  @true:  if key was found
+ *  @false: if not
+ */
+static bool
+sharded_get(int k)
+{
+        int v = 0;
+
+        return int2intmap_sharded_get(sharded, k, &v);
+}
+
+/**
+ * Set a key in the sharded map:
+ *
+ * Arguments:
+ *  @k: key
+ *  @v: value
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+sharded_set(int k, int v)
+{
+        if (int2intmap_sharded_set(sharded, k, v) < 0)
+                fail("int2intmap_sharded_set");
+}
+
+/**
+ * Unset a key in the sharded map:
+ *
+ * Arguments:
+ *  @k: key
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+sharded_unset(int k)
+{
+        (void)int2intmap_sharded_unset(sharded, k);
+}
+
+static const struct mtbench_map maps[] = {
+        { "int2intmap_locked", locked_setup, locked_teardown,
+          locked_get, locked_set, locked_unset },
+        { "int2intmap_sharded", sharded_setup, sharded_teardown,
+          sharded_get, sharded_set, sharded_unset },
+};
+
+/**
+ * Run ops on the map under test until told to stop:
+ *
+ * Arguments:
+ *  @arg: pointer to mtbench_thread{}
+ *
+ * Returns:
+ *  @success: NULL
+ *  @failure: does not
+ */
+static void *
+worker(void *arg)
+{
+        struct mtbench_thread *tp = arg;
+        uint64_t ops = 0;
+        uint64_t r = 0;
+        size_t found = 0;
+        int k = 0;
+        int i = 0;
+
+        pthread_barrier_wait(&start);
+
+        while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+                for (i = 0; i < MTBENCH_BATCH; i++) {
+                        /* 2 len keys, about half of them present */
+                        r = xorshift64(&tp->t_state);
+                        k = scramble((uint32_t)(r % (2 * len)));
+                        if ((r >> 32) % 100 < read_pct)
+                                found += cur->m_get(k);
+                        else if (r >> 63)
+                                cur->m_set(k, k);
+                        else
+                                cur->m_unset(k);
+                }
+                ops += MTBENCH_BATCH;
+        }
+
+        tp->t_ops = ops;
+        __atomic_fetch_add(&sink, found, __ATOMIC_RELAXED);
+        return NULL;
+}
+
+/**
+ * Time one map at one thread count and read percent:
+ *
+ * Arguments:
+ *  @out:      where to print
+ *  @nthreads: number of threads
+ *  @ms:       milliseconds to run for
+ *
+ * Returns:
+ *  @success: 0
+ *  @failure: -1 and errno set
+ */
+static int
+run(FILE *out, size_t nthreads, unsigned int ms)
+{
+        struct mtbench_thread threads[MTBENCH_MAX_THREADS];
+        struct timespec from;
+        struct timespec nap;
+        uint64_t ops = 0;
+        uint64_t ns = 0;
+        size_t i = 0;
+        int ret = -1;
+
+        cur->m_setup(len);
+        stop = 0;
+
+        errno = pthread_barrier_init(&start, NULL,
+                                     (unsigned int)nthreads + 1);
+        if (errno != 0)
+                goto teardown;
+
+        for (i = 0; i < nthreads; i++) {
+                threads[i].t_state = 0x2545f4914f6cdd1dULL * (i + 1);
+                threads[i].t_ops = 0;
+                errno = pthread_create(&threads[i].t_tid, NULL, worker,
+                                       &threads[i]);
+                if (errno != 0)
+                        fail("pthread_create");
+        }
+
+        pthread_barrier_wait(&start);
+        clock_gettime(CLOCK_MONOTONIC, &from);
+
+        nap.tv_sec = ms / 1000;
+        nap.tv_nsec = (long)(ms % 1000) * 1000000;
+        nanosleep(&nap, NULL);
+        __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+        for (i = 0; i < nthreads; i++) {
+                pthread_join(threads[i].t_tid, NULL);
+                ops += threads[i].t_ops;
+        }
+        ns = since(&from);
+
+        fprintf(out, "%s,%zu,%u,%zu,%llu,%.2f\n", cur->m_name, nthreads,
+                read_pct, len, (unsigned long long)ops,
+                (double)ops * 1000 / (double)ns);
+        fflush(out);
+
+        pthread_barrier_destroy(&start);
+        ret = 0;
+
+teardown:
+        cur->m_teardown();
+        return ret;
+}
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-m map] [-t threads] [-n len] "
+                "[-d ms] [-o file]\n"
+                "  sweeps 1, 2, 4, ... up to threads (default %d) "
+                "at read percents", prog, MTBENCH_MAX_THREADS);
+        for (i = 0; i < sizeof(read_pcts) / sizeof(*read_pcts); i++)
+                fprintf(stderr, " %u", read_pcts[i]);
+        fprintf(stderr, "\n  maps:");
+        for (i = 0; i < sizeof(maps) / sizeof(*maps); i++)
+                fprintf(stderr, " %s", maps[i].m_name);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        FILE *out = NULL;
+        const char *path = NULL;
+        const char *map = NULL;
+        size_t max = MTBENCH_MAX_THREADS;
+        size_t t = 0;
+        size_t m = 0;
+        size_t p = 0;
+        unsigned int ms = MTBENCH_MS;
+        int ret = 1;
+        int opt = 0;
+
+        len = MTBENCH_LEN;
+        while ((opt = getopt(argc, argv, "m:t:n:d:o:h")) != -1) {
+                switch (opt) {
+                case 'm':
+                        map = optarg;
+                        break;
+                case 't':
+                        max = strtoul(optarg, NULL, 0);
+                        break;
+                case 'n':
+                        len = strtoul(optarg, NULL, 0);
+                        break;
+                case 'd':
+                        ms = (unsigned int)strtoul(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || max == 0 || max > MTBENCH_MAX_THREADS ||
+            len == 0 || len > (1 << 29) || ms == 0)
+                goto usage;
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        fprintf(out, "map,threads,read_pct,len,ops,mops_per_s\n");
+        for (m = 0; m < sizeof(maps) / sizeof(*maps); m++) {
+                if (map != NULL && strcmp(map, maps[m].m_name) != 0)
+                        continue;
+                cur = &maps[m];
+
+                for (p = 0; p < sizeof(read_pcts) / sizeof(*read_pcts);
+                     p++) {
+                        read_pct = read_pcts[p];
+                        for (t = 1; t <= max; t <<= 1) {
+                                if (run(out, t, ms) < 0) {
+                                        perror("run");
+                                        goto close;
+                                }
+                        }
+                }
+        }
+        ret = 0;
+
+close:
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
@@ -0,0 +1,227 @@
+#include "include/bench.h"
+#include "include/hash_func.h"
+#include "include/pld_hash_map_par.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+PLD_HASH_MAP_PAR_DEFINE(int, int, parmap, hash_int_mix, intcmp, 0)
+
+/* benchmark settings */
+enum {
+        PARBENCH_MIN_LEN   = 1 << 20, /* smallest table swept */
+        PARBENCH_MAX_LEN   = 1 << 28, /* largest table swept */
+        PARBENCH_LIMIT_LEN = 1 << 30, /* scrambled keys stay distinct */
+        PARBENCH_REPS      = 3,       /* runs per point, fastest kept */
+};
+
+/* operations timed */
+enum parbench_op {
+        PARBENCH_BUILD,   /* _build_parallel() from arrays */
+        PARBENCH_RESIZE,  /* _resize_parallel() to twice the capacity */
+        PARBENCH_FOREACH, /* _foreach_parallel() summing values */
+        PARBENCH_CLEAR,   /* _clear_parallel() */
+        PARBENCH_NOP,
+};
+
+static const char *const parbench_op_name[PARBENCH_NOP] = {
+        "build", "resize", "foreach", "clear",
+};
+
+/* benchmark state */
+static int *keys = NULL;
+static int *vals = NULL;
+static uint64_t sums[PLD_HASH_MAP_PAR_MAX];
+static volatile uint64_t sink = 0;
+
+/**
+ * Add a value to the sum of the calling thread:
+ *
+ * Arguments:
+ *  @k:   key
+ *  @v:   pointer to value
+ *  @t:   thread index
+ *  @ctx: unused
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+sum_val(int k, int *v, int t, void *ctx)
+{
+        sums[t] += (uint64_t)*v;
+}
+
+/**
+ * Time every operation once:
+ *
+ * Arguments:
+ *  @n:       number of keys
+ *  @threads: most threads to use
+ *  @ns:      nanoseconds per operation, lowered to this run's if faster
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+run(size_t n, int threads, uint64_t ns[PARBENCH_NOP])
+{
+        struct parmap *pp = NULL;
+        struct timespec start;
+        uint64_t took[PARBENCH_NOP] = { 0 };
+        size_t t = 0;
+        int op = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pp = parmap_build_parallel(keys, vals, n, threads);
+        if (pp == NULL)
+                fail("parmap_build_parallel");
+        took[PARBENCH_BUILD] = since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (parmap_resize_parallel(&pp, pp->p_cap << 1, threads) < 0)
+                fail("parmap_resize_parallel");
+        took[PARBENCH_RESIZE] = since(&start);
+
+        memset(sums, 0, sizeof(sums));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (parmap_foreach_parallel(pp, sum_val, NULL, threads) < 0)
+                fail("parmap_foreach_parallel");
+        took[PARBENCH_FOREACH] = since(&start);
+        for (t = 0; t < PLD_HASH_MAP_PAR_MAX; t++)
+                sink += sums[t];
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (parmap_clear_parallel(pp, threads) < 0)
+                fail("parmap_clear_parallel");
+        took[PARBENCH_CLEAR] = since(&start);
+
+        parmap_free(&pp);
+
+        for (op = 0; op < PARBENCH_NOP; op++) {
+                if (ns[op] == 0 || took[op] < ns[op])
+                        ns[op] = took[op];
+        }
+}
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-n min] [-N max] [-t threads] "
+                "[-o file]\n"
+                "  sweeps table sizes min, 4 * min, ... up to max "
+                "(default %d to %d)\n"
+                "  and 1, 2, 4, ... up to threads (default online cpus)\n"
+                "  ops:", prog, PARBENCH_MIN_LEN, PARBENCH_MAX_LEN);
+        for (i = 0; i < PARBENCH_NOP; i++)
+                fprintf(stderr, " %s", parbench_op_name[i]);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        FILE *out = NULL;
+        const char *path = NULL;
+        uint64_t base[PARBENCH_NOP] = { 0 };
+        uint64_t ns[PARBENCH_NOP] = { 0 };
+        size_t min = PARBENCH_MIN_LEN;
+        size_t max = PARBENCH_MAX_LEN;
+        size_t n = 0;
+        size_t i = 0;
+        long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        int threads = 0;
+        int ret = 1;
+        int opt = 0;
+        int op = 0;
+        int r = 0;
+
+        while ((opt = getopt(argc, argv, "n:N:t:o:h")) != -1) {
+                switch (opt) {
+                case 'n':
+                        min = strtoul(optarg, NULL, 0);
+                        break;
+                case 'N':
+                        max = strtoul(optarg, NULL, 0);
+                        break;
+                case 't':
+                        max_threads = strtol(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || min == 0 || min > max ||
+            max > PARBENCH_LIMIT_LEN || max_threads < 1 ||
+            max_threads > PLD_HASH_MAP_PAR_MAX)
+                goto usage;
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        keys = malloc(sizeof(*keys) * max);
+        vals = malloc(sizeof(*vals) * max);
+        if (keys == NULL || vals == NULL) {
+                perror("malloc");
+                goto free;
+        }
+
+        for (i = 0; i < max; i++) {
+                keys[i] = scramble((uint32_t)i);
+                vals[i] = (int)i;
+        }
+
+        fprintf(out, "op,len,threads,secs,speedup\n");
+        for (n = min; n <= max; n <<= 2) {
+                for (threads = 1; threads <= max_threads; threads <<= 1) {
+                        memset(ns, 0, sizeof(ns));
+                        for (r = 0; r < PARBENCH_REPS; r++)
+                                run(n, threads, ns);
+                        if (threads == 1)
+                                memcpy(base, ns, sizeof(base));
+
+                        for (op = 0; op < PARBENCH_NOP; op++)
+                                fprintf(out, "%s,%zu,%d,%.6f,%.2f\n",
+                                        parbench_op_name[op], n, threads,
+                                        (double)ns[op] / 1e9,
+                                        (double)base[op] /
+                                        (double)ns[op]);
+                        fflush(out);
+                }
+        }
+        ret = 0;
+
+free:
+        free(vals);
+        vals = NULL;
+        free(keys);
+        keys = NULL;
+
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
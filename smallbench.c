@@ -0,0 +1,285 @@
+#include "include/bench.h"
+#include "include/hash_func.h"
+#include "include/pld_hash_map.h"
+#include "include/small_hash_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+SMALL_HASH_MAP_DEFINE(int, int, small_map, hash_int_mix, intcmp)
+PLD_HASH_MAP_DEFINE(int, int, pld_map, hash_int_mix, intcmp)
+
+/* benchmark settings */
+enum {
+        SMALLBENCH_MAPS     = 1 << 16, /* default maps */
+        SMALLBENCH_MAX_MAPS = 1 << 22, /* scrambled keys stay distinct */
+        SMALLBENCH_ENTRIES  = 16,      /* default most entries per map */
+        SMALLBENCH_MAX_ENT  = 32,      /* most entries per map */
+        SMALLBENCH_OPS      = 1 << 22, /* lookups timed */
+};
+
+/* map under test */
+struct smallbench_map {
+        const char *m_name;                    /* map name */
+        void (*m_run)(FILE *, size_t, size_t); /* run on maps */
+};
+
+/* benchmark state shared by all maps */
+static uint32_t *order = NULL;
+static volatile uint64_t sink = 0;
+
+/**
+ * Get key of an entry of a map:
+ *
+ * Arguments:
+ *  @m: map index
+ *  @i: entry index, at or past the map's entry count for a miss
+ *
+ * Returns:
+ *  @success: key, distinct for each m and i
+ *  @failure: does not
+ */
+static inline int
+key_of(size_t m, size_t i)
+{
+        return scramble((uint32_t)(m * SMALLBENCH_MAX_ENT * 2 + i));
+}
+
+/**
+ * Shuffle the order maps are visited in:
+ *
+ * Arguments:
+ *  @maps: number of maps
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ *
+ * Notes:
+ *  a fixed seed keeps runs comparable
+ */
+static void
+make_order(size_t maps)
+{
+        uint64_t x = HASH_FIB;
+        uint32_t t = 0;
+        size_t i = 0;
+        size_t j = 0;
+
+        for (i = 0; i < maps; i++)
+                order[i] = (uint32_t)i;
+
+        for (i = maps - 1; i > 0; i--) {
+                x = hash_mix(x + HASH_FIB);
+                j = x % (i + 1);
+                t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+        }
+}
+
+/**
+ * Get bytes held by a pld_map{}:
+ *
+ * Arguments:
+ *  @pp: pointer to pld_map{}
+ *
+ * Returns:
+ *  @success: bytes of its table block, which holds the struct too
+ *  @failure: does not
+ */
+static inline size_t
+pld_map_bytes(const struct pld_map *pp)
+{
+        return pp->p_size;
+}
+
+/**
+ * Define memory and lookup benchmark for a map:
+ *
+ * Arguments:
+ *  @_name: name of map
+ *
+ * Notes:
+ *  every map holds n entries; lookups visit the maps in shuffled
+ *  order, so each one starts with a cache miss as it would for maps
+ *  hanging off millions of objects
+ */
+#define SMALLBENCH_DEFINE(_name)                                        \
+static void                                                             \
+_name ## _run(FILE *out, size_t maps, size_t n)                         \
+{                                                                       \
+        struct _name **pps = NULL;                                      \
+        struct timespec start;                                          \
+        size_t reps = SMALLBENCH_OPS / maps;                            \
+        size_t bytes = 0;                                               \
+        size_t found = 0;                                               \
+        size_t r = 0;                                                   \
+        size_t m = 0;                                                   \
+        size_t i = 0;                                                   \
+        uint64_t ns[3] = { 0 };                                         \
+                                                                        \
+        if (reps == 0)                                                  \
+                reps = 1;                                               \
+                                                                        \
+        pps = calloc(maps, sizeof(*pps));                               \
+        if (pps == NULL)                                                \
+                fail("calloc");                                         \
+                                                                        \
+        clock_gettime(CLOCK_MONOTONIC, &start);                         \
+        for (m = 0; m < maps; m++) {                                    \
+                pps[m] = _name ## _new(0);                              \
+                if (pps[m] == NULL)                                     \
+                        fail(#_name "_new");                            \
+                for (i = 0; i < n; i++) {                               \
+                        if (_name ## _set(&pps[m], key_of(m, i),        \
+                                          (int)i) < 0)                  \
+                                fail(#_name "_set");                    \
+                }                                                       \
+        }                                                               \
+        ns[0] = since(&start);                                          \
+                                                                        \
+        for (m = 0; m < maps; m++)                                      \
+                bytes += _name ## _bytes(pps[m]);                       \
+                                                                        \
+        clock_gettime(CLOCK_MONOTONIC, &start);                         \
+        for (r = 0; n > 0 && r < reps; r++) {                           \
+                for (i = 0; i < maps; i++) {                            \
+                        m = order[i];                                   \
+                        if (_name ## _get(pps[m],                       \
+                                          key_of(m, (m + r) % n)) !=    \
+                            NULL)                                       \
+                                found++;                                \
+                }                                                       \
+        }                                                               \
+        ns[1] = since(&start);                                          \
+                                                                        \
+        clock_gettime(CLOCK_MONOTONIC, &start);                         \
+        for (r = 0; r < reps; r++) {                                    \
+                for (i = 0; i < maps; i++) {                            \
+                        m = order[i];                                   \
+                        if (_name ## _get(pps[m], key_of(m, n + r %     \
+                                          SMALLBENCH_MAX_ENT)) !=       \
+                            NULL)                                       \
+                                found++;                                \
+                }                                                       \
+        }                                                               \
+        ns[2] = since(&start);                                          \
+        sink += found;                                                  \
+                                                                        \
+        fprintf(out, "%s,%zu,%zu,%.1f,%.2f,%.2f,%.2f\n", #_name, n,     \
+                maps, (double)bytes / (double)maps,                     \
+                (double)ns[0] / (double)(maps * (n > 0 ? n : 1)),       \
+                n > 0 ? (double)ns[1] / (double)(reps * maps) : 0.0,    \
+                (double)ns[2] / (double)(reps * maps));                 \
+        fflush(out);                                                    \
+                                                                        \
+        for (m = 0; m < maps; m++)                                      \
+                _name ## _free(&pps[m]);                                \
+        free(pps);                                                      \
+}
+
+SMALLBENCH_DEFINE(small_map)
+SMALLBENCH_DEFINE(pld_map)
+
+static const struct smallbench_map maps[] = {
+        { "small", small_map_run },
+        { "pld",   pld_map_run },
+};
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-m map] [-n maps] [-e entries] "
+                "[-o file]\n"
+                "  fills maps with 0, 1, ... up to entries each "
+                "(default %d maps, %d entries)\n"
+                "  maps:", prog, SMALLBENCH_MAPS, SMALLBENCH_ENTRIES);
+        for (i = 0; i < sizeof(maps) / sizeof(*maps); i++)
+                fprintf(stderr, " %s", maps[i].m_name);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        FILE *out = NULL;
+        const char *path = NULL;
+        const char *map = NULL;
+        size_t nmaps = SMALLBENCH_MAPS;
+        size_t entries = SMALLBENCH_ENTRIES;
+        size_t n = 0;
+        size_t m = 0;
+        int ret = 1;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "m:n:e:o:h")) != -1) {
+                switch (opt) {
+                case 'm':
+                        map = optarg;
+                        break;
+                case 'n':
+                        nmaps = strtoul(optarg, NULL, 0);
+                        break;
+                case 'e':
+                        entries = strtoul(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || nmaps == 0 || nmaps > SMALLBENCH_MAX_MAPS ||
+            entries > SMALLBENCH_MAX_ENT)
+                goto usage;
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        order = malloc(sizeof(*order) * nmaps);
+        if (order == NULL) {
+                perror("malloc");
+                goto close;
+        }
+        make_order(nmaps);
+
+        fprintf(out, "map,entries,maps,bytes_per_map,insert_ns,hit_ns,"
+                "miss_ns\n");
+        for (n = 0; n <= entries; n++) {
+                for (m = 0; m < sizeof(maps) / sizeof(*maps); m++) {
+                        if (map != NULL && strcmp(map, maps[m].m_name) != 0)
+                                continue;
+                        maps[m].m_run(out, nmaps, n);
+                }
+        }
+        ret = 0;
+
+        free(order);
+        order = NULL;
+
+close:
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}
@@ -0,0 +1,419 @@
+#include "include/bench.h"
+#include "include/hash_func.h"
+#include "include/pld_hash_map.h"
+#include "include/str_hash_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+STR_HASH_MAP_DEFINE(int, strmap)
+PLD_HASH_MAP_DEFINE(const char *, int, cstrmap, hash_str, strcmp)
+
+/* benchmark settings */
+enum {
+        STRBENCH_LEN     = 1 << 20, /* default keys */
+        STRBENCH_MAX_LEN = 1 << 24, /* most keys */
+        STRBENCH_OPS     = 1 << 23, /* lookups timed */
+        STRBENCH_KEY_MAX = 128,     /* longest key with its NUL */
+};
+
+/* key sets */
+enum strbench_set {
+        STRBENCH_URL,   /* URLs, mostly 40 to 100 bytes */
+        STRBENCH_IDENT, /* identifiers, mostly 8 to 24 bytes */
+        STRBENCH_NSET,
+};
+
+static const char *const strbench_set_name[STRBENCH_NSET] = {
+        "url", "ident",
+};
+
+/* words keys are made of */
+static const char *const strbench_words[] = {
+        "user", "account", "order", "item", "cache", "index", "search",
+        "api", "v2", "static", "image", "profile", "session", "event",
+        "count", "total", "get", "set", "max", "min", "buf", "len",
+        "node", "list", "map", "entry", "config", "handler", "query",
+        "page",
+};
+
+static const char *const strbench_hosts[] = {
+        "www.example.com", "api.example.org", "cdn.static-assets.net",
+        "shop.example.co.uk", "news.example.io", "m.example.com",
+};
+
+/* key made by make_keys() */
+struct strbench_key {
+        const char *k_str; /* NUL terminated bytes */
+        size_t      k_len; /* bytes before the NUL */
+};
+
+/* map under test */
+struct strbench_map {
+        const char *m_name;                          /* map name */
+        void (*m_run)(FILE *, const char *, size_t); /* run on keys */
+};
+
+/* benchmark state shared by all maps */
+static struct strbench_key *keys = NULL;
+static struct strbench_key *misses = NULL;
+static char *bytes = NULL;
+static volatile uint64_t sink = 0;
+
+/**
+ * Pick a word for a key:
+ *
+ * Arguments:
+ *  @x: random number, advanced
+ *
+ * Returns:
+ *  @success: word
+ *  @failure: does not
+ */
+static const char *
+word(uint64_t *x)
+{
+        size_t n = sizeof(strbench_words) / sizeof(*strbench_words);
+
+        *x = hash_mix(*x + HASH_FIB);
+        return strbench_words[*x % n];
+}
+
+/**
+ * Write a distinct key of a key set:
+ *
+ * Arguments:
+ *  @set: key set
+ *  @id:  number making the key distinct
+ *  @buf: where to write STRBENCH_KEY_MAX bytes at most
+ *
+ * Returns:
+ *  @success: bytes written, not counting the NUL
+ *  @failure: does not
+ */
+static size_t
+make_key(enum strbench_set set, size_t id, char *buf)
+{
+        size_t n = sizeof(strbench_hosts) / sizeof(*strbench_hosts);
+        uint64_t x = hash_mix(id);
+        int len = 0;
+
+        switch (set) {
+        case STRBENCH_URL:
+                len = snprintf(buf, STRBENCH_KEY_MAX,
+                               "https://%s/%s/%s/%s?id=%zu",
+                               strbench_hosts[x % n], word(&x), word(&x),
+                               word(&x), id);
+                break;
+        case STRBENCH_IDENT:
+                len = snprintf(buf, STRBENCH_KEY_MAX, "%s_%s%zx",
+                               word(&x), word(&x), id);
+                break;
+        case STRBENCH_NSET:
+                break;
+        }
+
+        return (size_t)len;
+}
+
+/**
+ * Make hit and miss keys of a key set:
+ *
+ * Arguments:
+ *  @set: key set
+ *  @n:   number of keys of each kind
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ *
+ * Notes:
+ *  keys are laid out back to back in bytes, as if read from a file
+ */
+static void
+make_keys(enum strbench_set set, size_t n)
+{
+        char *p = bytes;
+        size_t i = 0;
+
+        for (i = 0; i < n; i++) {
+                keys[i].k_str = p;
+                keys[i].k_len = make_key(set, i, p);
+                p += keys[i].k_len + 1;
+
+                misses[i].k_str = p;
+                misses[i].k_len = make_key(set, n + i, p);
+                p += misses[i].k_len + 1;
+        }
+}
+
+/**
+ * Print a result row:
+ *
+ * Arguments:
+ *  @out:  where to print
+ *  @map:  map name
+ *  @set:  key set name
+ *  @n:    number of keys
+ *  @reps: lookup passes over the keys
+ *  @ns:   insert, hit and miss nanoseconds
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+report(FILE *out, const char *map, const char *set, size_t n,
+       size_t reps, const uint64_t ns[3])
+{
+        double ops = (double)(reps * n) * 1000;
+
+        fprintf(out, "%s,%s,%zu,%.2f,%.2f,%.2f\n", map, set, n,
+                (double)n * 1000 / (double)ns[0], ops / (double)ns[1],
+                ops / (double)ns[2]);
+        fflush(out);
+}
+
+/**
+ * Time str_hash_map keyed by the keys:
+ *
+ * Arguments:
+ *  @out: where to print
+ *  @set: key set name
+ *  @n:   number of keys
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+strmap_run(FILE *out, const char *set, size_t n)
+{
+        struct strmap *pp = NULL;
+        struct timespec start;
+        size_t reps = STRBENCH_OPS / n;
+        size_t found = 0;
+        size_t r = 0;
+        size_t i = 0;
+        uint64_t ns[3] = { 0 };
+
+        if (reps == 0)
+                reps = 1;
+
+        pp = strmap_new(0);
+        if (pp == NULL)
+                fail("strmap_new");
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n; i++) {
+                if (strmap_set(&pp, keys[i].k_str, keys[i].k_len,
+                               (int)i) < 0)
+                        fail("strmap_set");
+        }
+        ns[0] = since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++) {
+                for (i = 0; i < n; i++) {
+                        if (strmap_get(pp, keys[i].k_str,
+                                       keys[i].k_len) != NULL)
+                                found++;
+                }
+        }
+        ns[1] = since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++) {
+                for (i = 0; i < n; i++) {
+                        if (strmap_get(pp, misses[i].k_str,
+                                       misses[i].k_len) != NULL)
+                                found++;
+                }
+        }
+        ns[2] = since(&start);
+        sink += found;
+
+        report(out, "strmap", set, n, reps, ns);
+        strmap_free(&pp);
+}
+
+/**
+ * Time pld_hash_map of strdup()ed char * keys:
+ *
+ * Arguments:
+ *  @out: where to print
+ *  @set: key set name
+ *  @n:   number of keys
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ *
+ * Notes:
+ *  the baseline a caller gets from PLD_HASH_MAP_DEFINE, a malloc() per
+ *  key and every compare chasing the key pointer
+ */
+static void
+cstrmap_run(FILE *out, const char *set, size_t n)
+{
+        struct cstrmap_iter it;
+        struct cstrmap *pp = NULL;
+        struct timespec start;
+        const char *key = NULL;
+        size_t reps = STRBENCH_OPS / n;
+        size_t found = 0;
+        size_t r = 0;
+        size_t i = 0;
+        uint64_t ns[3] = { 0 };
+        char *s = NULL;
+
+        if (reps == 0)
+                reps = 1;
+
+        pp = cstrmap_new(0);
+        if (pp == NULL)
+                fail("cstrmap_new");
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < n; i++) {
+                s = strdup(keys[i].k_str);
+                if (s == NULL || cstrmap_set(&pp, s, (int)i) < 0)
+                        fail("cstrmap_set");
+        }
+        ns[0] = since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++) {
+                for (i = 0; i < n; i++) {
+                        if (cstrmap_get(pp, keys[i].k_str) != NULL)
+                                found++;
+                }
+        }
+        ns[1] = since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < reps; r++) {
+                for (i = 0; i < n; i++) {
+                        if (cstrmap_get(pp, misses[i].k_str) != NULL)
+                                found++;
+                }
+        }
+        ns[2] = since(&start);
+        sink += found;
+
+        report(out, "cstrmap", set, n, reps, ns);
+
+        cstrmap_iter_init(pp, &it);
+        while (cstrmap_iter_next(&it, &key) != NULL)
+                free((char *)key);
+        cstrmap_free(&pp);
+}
+
+static const struct strbench_map maps[] = {
+        { "strmap",  strmap_run },
+        { "cstrmap", cstrmap_run },
+};
+
+/**
+ * Print usage:
+ *
+ * Arguments:
+ *  @prog: program name
+ *
+ * Returns:
+ *  @success: does not
+ *  @failure: does not
+ */
+static void
+usage(const char *prog)
+{
+        size_t i = 0;
+
+        fprintf(stderr, "usage: %s [-m map] [-k keys] [-n len] [-o file]\n"
+                "  maps:", prog);
+        for (i = 0; i < sizeof(maps) / sizeof(*maps); i++)
+                fprintf(stderr, " %s", maps[i].m_name);
+        fprintf(stderr, "\n  keys:");
+        for (i = 0; i < STRBENCH_NSET; i++)
+                fprintf(stderr, " %s", strbench_set_name[i]);
+        fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+        FILE *out = NULL;
+        const char *path = NULL;
+        const char *map = NULL;
+        const char *set = NULL;
+        size_t len = STRBENCH_LEN;
+        size_t m = 0;
+        int ret = 1;
+        int opt = 0;
+        int k = 0;
+
+        while ((opt = getopt(argc, argv, "m:k:n:o:h")) != -1) {
+                switch (opt) {
+                case 'm':
+                        map = optarg;
+                        break;
+                case 'k':
+                        set = optarg;
+                        break;
+                case 'n':
+                        len = strtoul(optarg, NULL, 0);
+                        break;
+                case 'o':
+                        path = optarg;
+                        break;
+                default:
+                        goto usage;
+                }
+        }
+
+        if (optind != argc || len == 0 || len > STRBENCH_MAX_LEN)
+                goto usage;
+
+        out = bench_open(path);
+        if (out == NULL)
+                return 1;
+
+        keys = malloc(sizeof(*keys) * len);
+        misses = malloc(sizeof(*misses) * len);
+        bytes = malloc(STRBENCH_KEY_MAX * 2 * len);
+        if (keys == NULL || misses == NULL || bytes == NULL) {
+                perror("malloc");
+                goto free;
+        }
+
+        fprintf(out, "map,keys,len,insert_mops,hit_mops,miss_mops\n");
+        for (k = 0; k < STRBENCH_NSET; k++) {
+                if (set != NULL && strcmp(set, strbench_set_name[k]) != 0)
+                        continue;
+                make_keys((enum strbench_set)k, len);
+
+                for (m = 0; m < sizeof(maps) / sizeof(*maps); m++) {
+                        if (map != NULL && strcmp(map, maps[m].m_name) != 0)
+                                continue;
+                        maps[m].m_run(out, strbench_set_name[k], len);
+                }
+        }
+        ret = 0;
+
+free:
+        free(bytes);
+        bytes = NULL;
+        free(misses);
+        misses = NULL;
+        free(keys);
+        keys = NULL;
+
+        bench_close(out);
+        return ret;
+
+usage:
+        usage(argv[0]);
+        return 1;
+}